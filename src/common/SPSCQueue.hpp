@@ -32,6 +32,21 @@ public:
     return true;
   }
 
+  /*up to count items written in place by fill(item, i) and published with
+   * one release store, returns how many fit*/
+  template <typename F> std::size_t try_push_n(std::size_t count, F &&fill) {
+    const auto w = write_pos_.load(std::memory_order_relaxed);
+    const auto r = read_pos_.load(std::memory_order_acquire);
+    const std::size_t space = (r - w - 1) & kMask;
+    if (count > space)
+      count = space;
+    for (std::size_t i = 0; i < count; ++i)
+      fill(buffer_[(w + i) & kMask], i);
+    if (count != 0)
+      write_pos_.store((w + count) & kMask, std::memory_order_release);
+    return count;
+  }
+
   bool try_pop(T &item) {
     const auto r = read_pos_.load(std::memory_order_relaxed);
     if (r == write_pos_.load(std::memory_order_acquire))
@@ -41,6 +56,17 @@ public:
     return true;
   }
 
+  /*most entries the queue holds at once, one slot is kept free*/
+  static constexpr std::size_t capacity() { return Capacity - 1; }
+
+  /*entries currently queued. exact from the producer's side, may lag by the
+   * consumer's in-flight pops*/
+  std::size_t size_approx() const {
+    const auto w = write_pos_.load(std::memory_order_relaxed);
+    const auto r = read_pos_.load(std::memory_order_acquire);
+    return (w - r) & kMask;
+  }
+
 private:
   static constexpr std::size_t kMask = Capacity - 1;
 
@@ -0,0 +1,178 @@
+#ifndef YINHE_SRC_COMMON_COMMANDJOURNAL_H
+#define YINHE_SRC_COMMON_COMMANDJOURNAL_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SPSCQueue.hpp"
+#include "types.hpp"
+
+namespace fs = std::filesystem;
+
+/**************************************
+ * input command journal
+ * every command accepted by the orderbook is recorded with the order ID and
+ * tick it was assigned, so replaying the journal into a fresh book rebuilds
+ * the exact same state
+ **************************************/
+enum class CommandType : std::uint8_t {
+  ADD,
+  CANCEL,
+  MODIFY,
+  ADD_STOP,
+  ADD_PEG,
+  AUCTION_START, // tick only
+  UNCROSS,       // tick only
+  CANCEL_OWNER   // tick and account only
+};
+
+struct JournalRecord {
+  SimTick tick;
+  OrderID id;
+  Price price;       // ADD/ADD_STOP/MODIFY only, the offset for ADD_PEG
+  Quantity quantity; // ADD/ADD_STOP/ADD_PEG/MODIFY only
+  CommandType type;
+  std::uint8_t side;       // Side, ADD/ADD_STOP/ADD_PEG only
+  std::uint8_t order_type; // orderType, ADD/ADD_STOP only
+  union {
+    Quantity display_quantity; // ADD only, iceberg peak, 0 for plain orders
+    Price trigger_price;       // ADD_STOP only
+    std::uint8_t peg_type;     // ADD_PEG only, PegType
+  };
+  AccountID account;     // ADD/ADD_STOP/ADD_PEG/CANCEL_OWNER only
+  std::uint8_t stp_mode; // StpMode, ADD/ADD_STOP/ADD_PEG only
+};
+
+static_assert(sizeof(JournalRecord) == 40, "JournalRecord should stay 40 bytes");
+
+/*file layout: JournalHeader followed by packed JournalRecords*/
+struct JournalHeader {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint16_t record_size;
+};
+
+constexpr std::uint32_t JOURNAL_MAGIC = 0x4A4E4859; // "YHNJ"
+constexpr std::uint16_t JOURNAL_VERSION = 1;
+
+class CommandJournal {
+public:
+  CommandJournal() = default;
+
+  ~CommandJournal() { close_Journal(); }
+
+  /*open (truncate) the journal file and start the writer thread*/
+  void open_Journal(const std::string &filepath) {
+    fs::path path(filepath);
+    if (path.has_parent_path() && !fs::exists(path.parent_path()))
+      fs::create_directories(path.parent_path());
+    journalFile.open(filepath, std::ios::binary | std::ios::trunc);
+    if (!journalFile.is_open()) {
+      std::cerr << "Error opening command journal, exiting program"
+                << std::endl;
+      std::exit(1);
+    }
+    JournalHeader header{JOURNAL_MAGIC, JOURNAL_VERSION,
+                         static_cast<std::uint16_t>(sizeof(JournalRecord))};
+    journalFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    journal_location = filepath;
+
+    stop_flag_.store(false, std::memory_order_relaxed);
+    writer_thread_ = std::thread(&CommandJournal::writer_loop, this);
+  }
+
+  void append(const JournalRecord &record) {
+    while (!queue_.try_push(record)) {
+      std::this_thread::yield();
+    }
+  }
+
+  void close_Journal() {
+    if (!writer_thread_.joinable())
+      return;
+
+    stop_flag_.store(true, std::memory_order_release);
+    writer_thread_.join();
+
+    JournalRecord record;
+    while (queue_.try_pop(record)) {
+      write_record(record);
+    }
+    journalFile.close();
+  }
+
+  std::string get_journal_location() { return journal_location; }
+
+  /*read a whole journal back, returns false if the file is missing or was not
+   * written by this version of the journal*/
+  static bool load(const std::string &filepath,
+                   std::vector<JournalRecord> &records) {
+    std::ifstream in(filepath, std::ios::binary);
+    if (!in.is_open())
+      return false;
+    JournalHeader header{};
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || header.magic != JOURNAL_MAGIC ||
+        header.version != JOURNAL_VERSION ||
+        header.record_size != sizeof(JournalRecord))
+      return false;
+
+    in.seekg(0, std::ios::end);
+    auto bytes = static_cast<std::size_t>(in.tellg()) - sizeof(header);
+    in.seekg(sizeof(header), std::ios::beg);
+    /*a torn final record from a crash is dropped*/
+    records.resize(bytes / sizeof(JournalRecord));
+    in.read(reinterpret_cast<char *>(records.data()),
+            records.size() * sizeof(JournalRecord));
+    return static_cast<bool>(in);
+  }
+
+private:
+  std::string journal_location;
+  std::ofstream journalFile;
+
+  SPSCQueue<JournalRecord> queue_;
+  std::thread writer_thread_;
+  std::atomic<bool> stop_flag_{false};
+
+  void writer_loop() {
+    constexpr int kMaxSpins = 256;
+    JournalRecord record;
+    int idle_spins = 0;
+    while (true) {
+      if (queue_.try_pop(record)) {
+        write_record(record);
+        idle_spins = 0;
+        while (queue_.try_pop(record)) {
+          write_record(record);
+        }
+        /*push each burst to the OS so a crash loses at most the records
+         * still in the queue*/
+        journalFile.flush();
+      } else if (stop_flag_.load(std::memory_order_acquire)) {
+        break;
+      } else {
+        if (++idle_spins >= kMaxSpins) {
+          std::this_thread::yield();
+          idle_spins = 0;
+        }
+      }
+    }
+    while (queue_.try_pop(record)) {
+      write_record(record);
+    }
+    journalFile.flush();
+  }
+
+  void write_record(const JournalRecord &record) {
+    journalFile.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  }
+};
+
+#endif
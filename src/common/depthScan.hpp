@@ -0,0 +1,242 @@
+#ifndef YINHE_SRC_COMMON_DEPTHSCAN_H
+#define YINHE_SRC_COMMON_DEPTHSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define YINHE_HAS_X86_DISPATCH 1
+#else
+#define YINHE_HAS_X86_DISPATCH 0
+#endif
+
+/**************************************
+ * depth scan kernels
+ * work on contiguous per-level quantities, best level first:
+ *
+ *   cover(qty, n, target)    fewest leading levels whose total reaches target,
+ *                            and that total. {n, sum of all} if it never does
+ *   prefix_sum(qty, out, n)  out[i] = qty[0] + ... + qty[i]
+ *
+ * scalar, SSE4.2 (2 lanes) and AVX2 (4 lanes) versions. the widest one the
+ * CPU runs is picked on first use, so binaries built without -march still
+ * use AVX2 where it exists. quantities are 64-bit, a level total must stay
+ * below 2^63 (the vector compares are signed)
+ **************************************/
+namespace depth_scan {
+
+struct DepthCover {
+  std::size_t levels = 0;     /*leading levels needed*/
+  std::uint64_t quantity = 0; /*their total, >= target when covered*/
+};
+
+using cover_fn = DepthCover (*)(const std::uint64_t *, std::size_t,
+                                std::uint64_t);
+using prefix_sum_fn = void (*)(const std::uint64_t *, std::uint64_t *,
+                               std::size_t);
+
+struct Kernels {
+  const char *name;
+  cover_fn cover;
+  prefix_sum_fn prefix_sum;
+};
+
+/* ==================== scalar ==================== */
+
+inline DepthCover cover_scalar(const std::uint64_t *qty, std::size_t n,
+                               std::uint64_t target) {
+  DepthCover result;
+  if (target == 0)
+    return result;
+  while (result.levels < n) {
+    result.quantity += qty[result.levels++];
+    if (result.quantity >= target)
+      break;
+  }
+  return result;
+}
+
+inline void prefix_sum_scalar(const std::uint64_t *qty, std::uint64_t *out,
+                              std::size_t n) {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = total += qty[i];
+}
+
+#if YINHE_HAS_X86_DISPATCH
+
+/*
+ * every block is prefix-summed on its own and only then offset by the
+ * running total, which advances by one add per block. the shuffles stay off
+ * that chain, so blocks overlap instead of waiting on each other
+ */
+
+/* ==================== SSE4.2 ==================== */
+
+/*[a, b] -> [a, a+b]*/
+__attribute__((target("sse4.2"))) inline __m128i prefix2(__m128i x) {
+  return _mm_add_epi64(x, _mm_slli_si128(x, 8));
+}
+
+__attribute__((target("sse4.2"))) inline DepthCover
+cover_sse42(const std::uint64_t *qty, std::size_t n, std::uint64_t target) {
+  DepthCover result;
+  if (target == 0)
+    return result;
+  /*running >= target  <=>  running > target - 1*/
+  const __m128i limit = _mm_set1_epi64x(static_cast<long long>(target - 1));
+  __m128i carry = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i block =
+        prefix2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(qty + i)));
+    __m128i x = _mm_add_epi64(block, carry);
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(x, limit)));
+    if (mask != 0) {
+      unsigned lane = __builtin_ctz(static_cast<unsigned>(mask));
+      result.levels = i + lane + 1;
+      result.quantity = static_cast<std::uint64_t>(
+          lane == 0 ? _mm_cvtsi128_si64(x)
+                    : _mm_cvtsi128_si64(_mm_unpackhi_epi64(x, x)));
+      return result;
+    }
+    carry = _mm_add_epi64(carry, _mm_unpackhi_epi64(block, block));
+  }
+  result.levels = i;
+  result.quantity = static_cast<std::uint64_t>(_mm_cvtsi128_si64(carry));
+  DepthCover tail = cover_scalar(qty + i, n - i, target - result.quantity);
+  result.levels += tail.levels;
+  result.quantity += tail.quantity;
+  return result;
+}
+
+__attribute__((target("sse4.2"))) inline void
+prefix_sum_sse42(const std::uint64_t *qty, std::uint64_t *out, std::size_t n) {
+  __m128i carry = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i block =
+        prefix2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(qty + i)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_add_epi64(block, carry));
+    carry = _mm_add_epi64(carry, _mm_unpackhi_epi64(block, block));
+  }
+  std::uint64_t total = static_cast<std::uint64_t>(_mm_cvtsi128_si64(carry));
+  for (; i < n; ++i)
+    out[i] = total += qty[i];
+}
+
+/* ==================== AVX2 ==================== */
+
+/*[a, b, c, d] -> [a, a+b, a+b+c, a+b+c+d]*/
+__attribute__((target("avx2"))) inline __m256i prefix4(__m256i x) {
+  const __m256i zero = _mm256_setzero_si256();
+  /*shift up one lane, then two*/
+  x = _mm256_add_epi64(
+      x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), zero, 0x03));
+  x = _mm256_add_epi64(
+      x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x40), zero, 0x0F));
+  return x;
+}
+
+__attribute__((target("avx2"))) inline DepthCover
+cover_avx2(const std::uint64_t *qty, std::size_t n, std::uint64_t target) {
+  DepthCover result;
+  if (target == 0)
+    return result;
+  const __m256i limit =
+      _mm256_set1_epi64x(static_cast<long long>(target - 1));
+  __m256i carry = _mm256_setzero_si256();
+  std::size_t i = 0;
+  /*two blocks per step, one branch for both*/
+  for (; i + 8 <= n; i += 8) {
+    __m256i lo = prefix4(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(qty + i)));
+    __m256i hi = prefix4(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(qty + i + 4)));
+    /*broadcast the last lane: each block's total*/
+    __m256i lo_total = _mm256_permute4x64_epi64(lo, 0xFF);
+    __m256i x0 = _mm256_add_epi64(lo, carry);
+    __m256i x1 = _mm256_add_epi64(hi, _mm256_add_epi64(carry, lo_total));
+    int mask = _mm256_movemask_pd(
+                   _mm256_castsi256_pd(_mm256_cmpgt_epi64(x0, limit))) |
+               _mm256_movemask_pd(
+                   _mm256_castsi256_pd(_mm256_cmpgt_epi64(x1, limit)))
+                   << 4;
+    if (mask != 0) {
+      unsigned lane = __builtin_ctz(static_cast<unsigned>(mask));
+      alignas(32) std::uint64_t lanes[8];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), x0);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes + 4), x1);
+      result.levels = i + lane + 1;
+      result.quantity = lanes[lane];
+      return result;
+    }
+    carry = _mm256_add_epi64(
+        carry,
+        _mm256_add_epi64(lo_total, _mm256_permute4x64_epi64(hi, 0xFF)));
+  }
+  result.levels = i;
+  result.quantity = static_cast<std::uint64_t>(
+      _mm_cvtsi128_si64(_mm256_castsi256_si128(carry)));
+  DepthCover tail = cover_scalar(qty + i, n - i, target - result.quantity);
+  result.levels += tail.levels;
+  result.quantity += tail.quantity;
+  return result;
+}
+
+__attribute__((target("avx2"))) inline void
+prefix_sum_avx2(const std::uint64_t *qty, std::uint64_t *out, std::size_t n) {
+  __m256i carry = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i block = prefix4(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(qty + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_add_epi64(block, carry));
+    carry = _mm256_add_epi64(carry, _mm256_permute4x64_epi64(block, 0xFF));
+  }
+  std::uint64_t total = static_cast<std::uint64_t>(
+      _mm_cvtsi128_si64(_mm256_castsi256_si128(carry)));
+  for (; i < n; ++i)
+    out[i] = total += qty[i];
+}
+
+#endif
+
+/* ==================== dispatch ==================== */
+
+/*every kernel set this CPU can run, scalar first and the widest last*/
+inline std::vector<Kernels> available() {
+  std::vector<Kernels> kernels{{"scalar", cover_scalar, prefix_sum_scalar}};
+#if YINHE_HAS_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2"))
+    kernels.push_back({"sse4.2", cover_sse42, prefix_sum_sse42});
+  if (__builtin_cpu_supports("avx2"))
+    kernels.push_back({"avx2", cover_avx2, prefix_sum_avx2});
+#endif
+  return kernels;
+}
+
+/*resolved on first use, afterwards a call through a cached pointer*/
+inline const Kernels &active() {
+  static const Kernels kernels = available().back();
+  return kernels;
+}
+
+inline DepthCover cover(const std::uint64_t *qty, std::size_t n,
+                        std::uint64_t target) {
+  return active().cover(qty, n, target);
+}
+
+inline void prefix_sum(const std::uint64_t *qty, std::uint64_t *out,
+                       std::size_t n) {
+  active().prefix_sum(qty, out, n);
+}
+
+} // namespace depth_scan
+
+#endif
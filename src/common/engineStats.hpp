@@ -0,0 +1,210 @@
+#ifndef YINHE_SRC_COMMON_ENGINESTATS_H
+#define YINHE_SRC_COMMON_ENGINESTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "enums.hpp"
+
+/**************************************
+ * engine counters
+ * every counter has exactly one writer (the matching thread) and sits on its
+ * own cache line, so bumping it is a plain relaxed load + store and a
+ * monitoring thread reading a snapshot never bounces the writer's lines
+ **************************************/
+/*a fixed line size: the std interference size depends on -mtune and warns
+ * in every translation unit that uses it*/
+constexpr std::size_t STAT_COUNTER_ALIGN = 64;
+struct alignas(STAT_COUNTER_ALIGN) StatCounter {
+  std::atomic<std::uint64_t> value{0};
+
+  void add(std::uint64_t n = 1) noexcept {
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+  }
+  void set(std::uint64_t n) noexcept {
+    value.store(n, std::memory_order_relaxed);
+  }
+  void set_max(std::uint64_t n) noexcept {
+    if (n > value.load(std::memory_order_relaxed))
+      value.store(n, std::memory_order_relaxed);
+  }
+  std::uint64_t load() const noexcept {
+    return value.load(std::memory_order_relaxed);
+  }
+};
+
+constexpr int NUM_ORDER_TYPES = 6;
+constexpr const char *ORDER_TYPE_NAMES[NUM_ORDER_TYPES] = {
+    "good_to_cancel", "fill_or_kill", "market",
+    "good_for_day",   "fill_and_kill", "limit"};
+
+/*producer-side view of an async queue (logger, journal)*/
+struct QueueStats {
+  StatCounter high_water;  // most entries queued at once, sampled
+  StatCounter full_events; // pushes that found the queue full
+  StatCounter spin_ticks;  // LatencyClock ticks spent waiting on a full queue
+
+  /*all zero, reported when no queue is attached*/
+  static const QueueStats &none() {
+    static const QueueStats empty;
+    return empty;
+  }
+};
+
+/*a modify is a cancel/replace, it also counts one cancel and one add*/
+struct EngineStats {
+  StatCounter orders_added[NUM_ORDER_TYPES];
+  StatCounter cancels;
+  StatCounter cancel_misses; // cancel of an unknown or finished order
+  StatCounter modifies;
+  StatCounter fok_rejects;
+  StatCounter risk_rejects; // refused by the pre-trade risk checks
+  StatCounter self_trades_prevented;
+  StatCounter iceberg_refills; // tranches shown after the first
+  StatCounter stops_triggered; // stops released into the book
+  StatCounter auction_uncrosses;
+  StatCounter l3_overflows; // L3 events dropped on a full feed
+  StatCounter trades;
+  StatCounter traded_quantity;
+  /*gauges, refreshed after every command*/
+  StatCounter resting_orders;
+  StatCounter bid_levels;
+  StatCounter ask_levels;
+};
+
+/*plain copy taken by the monitoring thread*/
+struct EngineStatsSnapshot {
+  std::int64_t taken_at_ns = 0; // steady_clock, for rates between snapshots
+  std::uint64_t orders_added[NUM_ORDER_TYPES] = {};
+  std::uint64_t cancels = 0;
+  std::uint64_t cancel_misses = 0;
+  std::uint64_t modifies = 0;
+  std::uint64_t fok_rejects = 0;
+  std::uint64_t risk_rejects = 0;
+  std::uint64_t self_trades_prevented = 0;
+  std::uint64_t iceberg_refills = 0;
+  std::uint64_t stops_triggered = 0;
+  std::uint64_t auction_uncrosses = 0;
+  std::uint64_t l3_overflows = 0;
+  std::uint64_t trades = 0;
+  std::uint64_t traded_quantity = 0;
+  std::uint64_t resting_orders = 0;
+  std::uint64_t bid_levels = 0;
+  std::uint64_t ask_levels = 0;
+  std::uint64_t logger_high_water = 0;
+  std::uint64_t logger_full_events = 0;
+  double logger_spin_ns = 0;
+
+  static EngineStatsSnapshot take(const EngineStats &stats,
+                                  const QueueStats &logger,
+                                  double ns_per_tick) {
+    EngineStatsSnapshot s;
+    s.taken_at_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+    for (int i = 0; i < NUM_ORDER_TYPES; ++i)
+      s.orders_added[i] = stats.orders_added[i].load();
+    s.cancels = stats.cancels.load();
+    s.cancel_misses = stats.cancel_misses.load();
+    s.modifies = stats.modifies.load();
+    s.fok_rejects = stats.fok_rejects.load();
+    s.risk_rejects = stats.risk_rejects.load();
+    s.self_trades_prevented = stats.self_trades_prevented.load();
+    s.iceberg_refills = stats.iceberg_refills.load();
+    s.stops_triggered = stats.stops_triggered.load();
+    s.auction_uncrosses = stats.auction_uncrosses.load();
+    s.l3_overflows = stats.l3_overflows.load();
+    s.trades = stats.trades.load();
+    s.traded_quantity = stats.traded_quantity.load();
+    s.resting_orders = stats.resting_orders.load();
+    s.bid_levels = stats.bid_levels.load();
+    s.ask_levels = stats.ask_levels.load();
+    s.logger_high_water = logger.high_water.load();
+    s.logger_full_events = logger.full_events.load();
+    s.logger_spin_ns = static_cast<double>(logger.spin_ticks.load()) * ns_per_tick;
+    return s;
+  }
+
+  std::uint64_t get_orders_added() const {
+    std::uint64_t total = 0;
+    for (auto n : orders_added)
+      total += n;
+    return total;
+  }
+
+  /*trades per second between an earlier snapshot and this one*/
+  double trades_per_sec(const EngineStatsSnapshot &earlier) const {
+    std::int64_t dt = taken_at_ns - earlier.taken_at_ns;
+    return dt <= 0 ? 0.0
+                   : static_cast<double>(trades - earlier.trades) * 1e9 / dt;
+  }
+
+  std::string to_text() const {
+    std::ostringstream out;
+    out << "orders_added: " << get_orders_added() << "\n";
+    for (int i = 0; i < NUM_ORDER_TYPES; ++i)
+      out << "  " << ORDER_TYPE_NAMES[i] << ": " << orders_added[i] << "\n";
+    out << "cancels: " << cancels << "\n"
+        << "cancel_misses: " << cancel_misses << "\n"
+        << "modifies: " << modifies << "\n"
+        << "fok_rejects: " << fok_rejects << "\n"
+        << "risk_rejects: " << risk_rejects << "\n"
+        << "self_trades_prevented: " << self_trades_prevented << "\n"
+        << "iceberg_refills: " << iceberg_refills << "\n"
+        << "stops_triggered: " << stops_triggered << "\n"
+        << "auction_uncrosses: " << auction_uncrosses << "\n"
+        << "l3_overflows: " << l3_overflows << "\n"
+        << "trades: " << trades << "\n"
+        << "traded_quantity: " << traded_quantity << "\n"
+        << "resting_orders: " << resting_orders << "\n"
+        << "bid_levels: " << bid_levels << "\n"
+        << "ask_levels: " << ask_levels << "\n"
+        << "logger_high_water: " << logger_high_water << "\n"
+        << "logger_full_events: " << logger_full_events << "\n"
+        << "logger_spin_ns: " << static_cast<std::uint64_t>(logger_spin_ns)
+        << "\n";
+    return out.str();
+  }
+
+  std::string to_json() const {
+    std::ostringstream out;
+    out << "{\"taken_at_ns\":" << taken_at_ns << ",\"orders_added\":{";
+    for (int i = 0; i < NUM_ORDER_TYPES; ++i)
+      out << (i ? "," : "") << "\"" << ORDER_TYPE_NAMES[i]
+          << "\":" << orders_added[i];
+    out << "},\"cancels\":" << cancels << ",\"cancel_misses\":" << cancel_misses
+        << ",\"modifies\":" << modifies << ",\"fok_rejects\":" << fok_rejects
+        << ",\"risk_rejects\":" << risk_rejects
+        << ",\"self_trades_prevented\":" << self_trades_prevented
+        << ",\"iceberg_refills\":" << iceberg_refills
+        << ",\"stops_triggered\":" << stops_triggered
+        << ",\"auction_uncrosses\":" << auction_uncrosses
+        << ",\"l3_overflows\":" << l3_overflows
+        << ",\"trades\":" << trades
+        << ",\"traded_quantity\":" << traded_quantity
+        << ",\"resting_orders\":" << resting_orders
+        << ",\"bid_levels\":" << bid_levels << ",\"ask_levels\":" << ask_levels
+        << ",\"logger_high_water\":" << logger_high_water
+        << ",\"logger_full_events\":" << logger_full_events
+        << ",\"logger_spin_ns\":" << static_cast<std::uint64_t>(logger_spin_ns)
+        << "}";
+    return out.str();
+  }
+
+  /*write to filepath as text or JSON, returns false on I/O failure*/
+  bool dump(const std::string &filepath, bool as_json) const {
+    std::ofstream out(filepath, std::ios::trunc);
+    if (!out.is_open())
+      return false;
+    out << (as_json ? to_json() + "\n" : to_text());
+    return static_cast<bool>(out);
+  }
+};
+
+#endif
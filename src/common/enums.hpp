@@ -1,9 +1,11 @@
 #ifndef YINHE_SRC_COMMON_ENUMS_H
 #define YINHE_SRC_COMMON_ENUMS_H
 
-enum Side { BUY, SELL };
+#include <cstdint>
 
-enum orderType {
+enum Side : std::uint8_t { BUY, SELL };
+
+enum orderType : std::uint8_t {
   GOODTOCANCEL, // remains on the book until fully cancelled
   FILLORKILL,   // must be fully filled immediately or cancelled entirely
   MARKET,       // execute at best available price
@@ -12,4 +14,21 @@ enum orderType {
   LIMIT
 };
 
+enum class PegType : std::uint8_t {
+  NONE,
+  PRIMARY, // best price on the order's own side, plus an offset
+  MIDPOINT // midpoint of the best bid and ask, plus an offset
+};
+
+/*what happens when an order would trade against one of its own account's.
+ * the incoming order's instruction decides*/
+enum class StpMode : std::uint8_t {
+  NONE,             // trade as usual
+  CANCEL_RESTING,   // cancel the resting order, the incoming one carries on
+  CANCEL_AGGRESSOR, // cancel the incoming order
+  CANCEL_BOTH,
+  DECREMENT // cut both by the smaller shown quantity without a trade, the
+            // order left with nothing is cancelled
+};
+
 #endif
\ No newline at end of file
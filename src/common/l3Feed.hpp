@@ -0,0 +1,58 @@
+#ifndef YINHE_SRC_COMMON_L3FEED_H
+#define YINHE_SRC_COMMON_L3FEED_H
+
+#include <cstdint>
+
+#include "SPSCQueue.hpp"
+#include "enums.hpp"
+#include "types.hpp"
+
+/**************************************
+ * order-by-order (L3) event stream
+ * every change to a resting order is published as one fixed-size record so a
+ * replica can rebuild the book without seeing the engine's internals
+ **************************************/
+enum class L3EventType : std::uint8_t {
+  ADD,          // order rested on the book with quantity
+  PARTIAL_FILL, // order traded quantity at price and is still resting
+  FILL,         // order traded quantity at price and left the book
+  CANCEL,       // order removed with quantity still remaining
+  REJECT,       // order refused (FOK), removed if it was resting
+  REPLENISH,    // iceberg showed a new tranche of quantity and moved to the
+                // back of its level
+  REDUCE        // order cut by quantity without trading (self-trade
+                // decrement) and still resting
+};
+
+struct L3Event {
+  std::uint64_t seq; // per-book sequence number, starts at 1; a gap is
+                     // events publish() dropped on a full queue
+  OrderID id;
+  Price price;
+  Quantity quantity;
+  L3EventType type;
+  std::uint8_t side; // Side, narrowed to keep the record at 32 bytes
+};
+
+static_assert(sizeof(L3Event) == 32, "L3Event should stay one half line");
+
+template <std::size_t Capacity = 8192> class BasicL3Feed {
+public:
+  /*producer side, called from the matching thread. never waits: on a full
+   * queue the event is dropped and false returned. the dropped event keeps
+   * its sequence number, so the consumer sees the drop as a gap*/
+  bool publish(const L3Event &event) { return queue_.try_push(event); }
+
+  /*consumer side, returns false if there is no pending event*/
+  bool poll(L3Event &event) { return queue_.try_pop(event); }
+
+  /*most events waiting at once before publish() drops*/
+  static constexpr std::size_t capacity() { return Capacity - 1; }
+
+private:
+  SPSCQueue<L3Event, Capacity> queue_;
+};
+
+using L3Feed = BasicL3Feed<>;
+
+#endif
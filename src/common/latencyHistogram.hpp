@@ -0,0 +1,196 @@
+#ifndef YINHE_SRC_COMMON_LATENCYHISTOGRAM_H
+#define YINHE_SRC_COMMON_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#define YINHE_HAS_RDTSC 1
+#else
+#define YINHE_HAS_RDTSC 0
+#endif
+
+/**************************************
+ * latency clock
+ * rdtsc on x86 (a few ns, no syscall), steady_clock everywhere else. values
+ * are raw ticks, converted to ns only when a histogram is read
+ **************************************/
+struct LatencyClock {
+  static std::uint64_t now() noexcept {
+#if YINHE_HAS_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+  }
+
+  /*calibrated once on first call, callers should be off the hot path*/
+  static double ns_per_tick() {
+    static const double ratio = calibrate();
+    return ratio;
+  }
+
+private:
+  static double calibrate() {
+#if YINHE_HAS_RDTSC
+    auto wall0 = std::chrono::steady_clock::now();
+    std::uint64_t tsc0 = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto wall1 = std::chrono::steady_clock::now();
+    std::uint64_t tsc1 = __rdtsc();
+    double ns = std::chrono::duration<double, std::nano>(wall1 - wall0).count();
+    return ns / static_cast<double>(tsc1 - tsc0);
+#else
+    return 1e9 * std::chrono::steady_clock::period::num /
+           std::chrono::steady_clock::period::den;
+#endif
+  }
+};
+
+/**************************************
+ * log-linear latency histogram (HDR style)
+ * values below 2^kSubBits get one bucket each, above that every power of two
+ * is split into 2^kSubBits linear sub-buckets, so any recorded value is known
+ * to within 1/2^kSubBits (~6%). fixed memory, no allocation after
+ * construction
+ *
+ * single writer: record() is a relaxed load + store per bucket, no locked
+ * instruction. any number of readers may call snapshot() concurrently and
+ * get a consistent-enough copy without stopping the writer
+ **************************************/
+class LatencyHistogramSnapshot;
+
+class LatencyHistogram {
+public:
+  static constexpr int kSubBits = 4;
+  static constexpr int kSubBuckets = 1 << kSubBits;
+  static constexpr int kMaxBits = 40; // values >= 2^40 ticks land in the last bucket
+  static constexpr int kBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+  void record(std::uint64_t ticks) noexcept {
+    bump(counts_[bucket_of(ticks)]);
+    sum_.store(sum_.load(std::memory_order_relaxed) + ticks,
+               std::memory_order_relaxed);
+    if (ticks > max_.load(std::memory_order_relaxed))
+      max_.store(ticks, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] LatencyHistogramSnapshot snapshot() const;
+
+  static int bucket_of(std::uint64_t value) noexcept {
+    if (value < static_cast<std::uint64_t>(kSubBuckets))
+      return static_cast<int>(value);
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= kMaxBits)
+      return kBuckets - 1;
+    int shift = msb - kSubBits;
+    int sub = static_cast<int>(value >> shift) - kSubBuckets;
+    return (shift + 1) * kSubBuckets + sub;
+  }
+
+  /*largest value that maps to the bucket*/
+  static std::uint64_t bucket_upper(int bucket) noexcept {
+    if (bucket < kSubBuckets)
+      return static_cast<std::uint64_t>(bucket);
+    int shift = bucket / kSubBuckets - 1;
+    std::uint64_t sub = static_cast<std::uint64_t>(bucket % kSubBuckets);
+    return ((kSubBuckets + sub + 1) << shift) - 1;
+  }
+
+private:
+  std::array<std::atomic<std::uint64_t>, kBuckets> counts_{};
+  std::atomic<std::uint64_t> sum_{0};
+  std::atomic<std::uint64_t> max_{0};
+
+  static void bump(std::atomic<std::uint64_t> &counter) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  friend class LatencyHistogramSnapshot;
+};
+
+/*plain copy of a histogram, percentiles are reported in ns*/
+class LatencyHistogramSnapshot {
+public:
+  std::uint64_t get_count() const { return total_count_; }
+  double get_mean_ns() const {
+    return total_count_ == 0 ? 0.0
+                             : static_cast<double>(sum_) / total_count_ *
+                                   LatencyClock::ns_per_tick();
+  }
+  double get_max_ns() const {
+    return static_cast<double>(max_) * LatencyClock::ns_per_tick();
+  }
+
+  /*upper bound of the bucket holding the pct-th percentile*/
+  double percentile_ns(double pct) const {
+    if (total_count_ == 0)
+      return 0.0;
+    std::uint64_t target =
+        static_cast<std::uint64_t>(static_cast<double>(total_count_) * pct / 100.0);
+    std::uint64_t seen = 0;
+    for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen > target) {
+        std::uint64_t upper = LatencyHistogram::bucket_upper(i);
+        if (upper > max_)
+          upper = max_;
+        return static_cast<double>(upper) * LatencyClock::ns_per_tick();
+      }
+    }
+    return get_max_ns();
+  }
+
+  std::uint64_t get_bucket_count(int bucket) const { return counts_[bucket]; }
+
+private:
+  std::array<std::uint64_t, LatencyHistogram::kBuckets> counts_{};
+  std::uint64_t total_count_ = 0;
+  std::uint64_t sum_ = 0;
+  std::uint64_t max_ = 0;
+
+  friend class LatencyHistogram;
+};
+
+inline LatencyHistogramSnapshot LatencyHistogram::snapshot() const {
+  LatencyHistogramSnapshot copy;
+  std::uint64_t total = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    copy.counts_[i] = counts_[i].load(std::memory_order_relaxed);
+    total += copy.counts_[i];
+  }
+  /*the count is the sum of the copied buckets so percentiles always add up*/
+  copy.total_count_ = total;
+  copy.sum_ = sum_.load(std::memory_order_relaxed);
+  copy.max_ = max_.load(std::memory_order_relaxed);
+  return copy;
+}
+
+/*times the enclosing scope into a histogram. the disabled specialisation is
+ * empty so instrumentation compiles away*/
+template <bool Enabled> class ScopedLatency {
+public:
+  explicit ScopedLatency(LatencyHistogram &histogram) noexcept
+      : histogram_(histogram), start_(LatencyClock::now()) {}
+  ~ScopedLatency() { histogram_.record(LatencyClock::now() - start_); }
+  ScopedLatency(const ScopedLatency &) = delete;
+  ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+  LatencyHistogram &histogram_;
+  std::uint64_t start_;
+};
+
+template <> class ScopedLatency<false> {
+public:
+  template <typename Histogram>
+  explicit ScopedLatency(Histogram &) noexcept {}
+};
+
+#endif
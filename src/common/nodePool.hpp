@@ -0,0 +1,158 @@
+#ifndef YINHE_SRC_COMMON_NODEPOOL_H
+#define YINHE_SRC_COMMON_NODEPOOL_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**************************************
+ * fixed-size block pool
+ * blocks are carved in order out of large slabs, so nodes allocated one
+ * after another (the orders of a level, mostly) sit next to each other and a
+ * FIFO walk streams through memory instead of hopping around the heap. freed
+ * blocks go on an intrusive free list and are reused LIFO while still warm
+ *
+ * one book allocates a few node kinds from the same pool (level nodes or ring
+ * chunks, stop nodes, peg buckets), so every block size gets its own slabs and
+ * free list, up to kMaxSizes of them. sizes past that, or over-aligned types,
+ * are refused and the caller falls back to operator new. single threaded: one
+ * pool per book, used only by the matching thread. memory goes back to the
+ * system when the pool is destroyed, not before
+ **************************************/
+class NodePool {
+public:
+  static constexpr int kMaxSizes = 4;
+
+  explicit NodePool(std::size_t max_blocks_per_slab = 4096)
+      : max_blocks_per_slab_(max_blocks_per_slab) {}
+  ~NodePool() {
+    for (void *slab : slabs_)
+      ::operator delete(slab);
+  }
+  NodePool(const NodePool &) = delete;
+  NodePool &operator=(const NodePool &) = delete;
+
+  /*true if this pool serves objects of the given size and alignment. the
+   * first request of a new size claims a free size class*/
+  bool accepts(std::size_t bytes, std::size_t align) {
+    if (align > alignof(std::max_align_t))
+      return false;
+    return find_class(block_size(bytes, align), true) != nullptr;
+  }
+
+  /*bytes and align must have been accepted*/
+  void *allocate(std::size_t bytes, std::size_t align) {
+    SizeClass &c = *find_class(block_size(bytes, align), false);
+    if (c.free != nullptr) {
+      FreeBlock *block = c.free;
+      c.free = block->next;
+      return block;
+    }
+    if (c.slab_next == c.slab_end)
+      grow(c);
+    void *block = c.slab_next;
+    c.slab_next += c.block_size;
+    return block;
+  }
+
+  void deallocate(void *p, std::size_t bytes, std::size_t align) noexcept {
+    SizeClass &c = *find_class(block_size(bytes, align), false);
+    auto *block = static_cast<FreeBlock *>(p);
+    block->next = c.free;
+    c.free = block;
+  }
+
+  std::size_t get_slab_count() const { return slabs_.size(); }
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+  struct SizeClass {
+    std::size_t block_size = 0; /*0: unclaimed*/
+    std::size_t next_slab_blocks = 0; /*first slab is ~4KB, later ones
+                                         double up to the max*/
+    FreeBlock *free = nullptr;
+    char *slab_next = nullptr;
+    char *slab_end = nullptr;
+  };
+
+  std::size_t max_blocks_per_slab_;
+  SizeClass classes_[kMaxSizes];
+  std::vector<void *> slabs_;
+
+  /*a multiple of align, so every block of a slab is aligned*/
+  static std::size_t block_size(std::size_t bytes, std::size_t align) noexcept {
+    std::size_t size = bytes < sizeof(FreeBlock) ? sizeof(FreeBlock) : bytes;
+    return (size + align - 1) & ~(align - 1);
+  }
+
+  SizeClass *find_class(std::size_t size, bool claim) noexcept {
+    for (SizeClass &c : classes_) {
+      if (c.block_size == size)
+        return &c;
+      if (c.block_size == 0) {
+        if (!claim)
+          return nullptr;
+        c.block_size = size;
+        return &c;
+      }
+    }
+    return nullptr;
+  }
+
+  void grow(SizeClass &c) {
+    if (c.next_slab_blocks == 0)
+      c.next_slab_blocks = c.block_size < 4096 ? 4096 / c.block_size : 1;
+    std::size_t blocks = c.next_slab_blocks;
+    if (c.next_slab_blocks < max_blocks_per_slab_)
+      c.next_slab_blocks = c.next_slab_blocks * 2 < max_blocks_per_slab_
+                               ? c.next_slab_blocks * 2
+                               : max_blocks_per_slab_;
+    void *slab = ::operator new(c.block_size * blocks);
+    slabs_.push_back(slab);
+    c.slab_next = static_cast<char *>(slab);
+    c.slab_end = c.slab_next + c.block_size * blocks;
+  }
+};
+
+/*std allocator over a NodePool. a default constructed allocator (no pool)
+ * or a request the pool refuses goes to operator new, so containers built
+ * without a pool still work*/
+template <typename T> class PoolAllocator {
+public:
+  using value_type = T;
+
+  PoolAllocator() noexcept = default;
+  explicit PoolAllocator(NodePool *pool) noexcept : pool_(pool) {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &other) noexcept
+      : pool_(other.get_pool()) {}
+
+  T *allocate(std::size_t n) {
+    if (n == 1 && pool_ != nullptr && pool_->accepts(sizeof(T), alignof(T)))
+      return static_cast<T *>(pool_->allocate(sizeof(T), alignof(T)));
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) noexcept {
+    if (n == 1 && pool_ != nullptr && pool_->accepts(sizeof(T), alignof(T)))
+      pool_->deallocate(p, sizeof(T), alignof(T));
+    else
+      ::operator delete(p);
+  }
+
+  NodePool *get_pool() const noexcept { return pool_; }
+
+  template <typename U> bool operator==(const PoolAllocator<U> &other) const {
+    return pool_ == other.get_pool();
+  }
+  template <typename U> bool operator!=(const PoolAllocator<U> &other) const {
+    return pool_ != other.get_pool();
+  }
+
+private:
+  NodePool *pool_ = nullptr;
+};
+
+#endif
@@ -11,6 +11,8 @@
 #include <thread>
 
 #include "SPSCQueue.hpp"
+#include "engineStats.hpp"
+#include "latencyHistogram.hpp"
 #include "types.hpp"
 
 namespace fs = std::filesystem;
@@ -27,11 +29,17 @@ struct LogEntry {
   char message[128]; // MESSAGE type only
 };
 
-class OrderbookLogger {
+/**************************************
+ * async logger, the matching thread only pushes into an SPSC queue and a
+ * consumer thread does the file I/O
+ * text mode writes one readable line per entry, binary mode writes the raw
+ * LogEntry records so nothing is formatted on either thread
+ **************************************/
+template <bool Binary> class BasicOrderbookLogger {
 public:
-  OrderbookLogger() = default;
+  BasicOrderbookLogger() = default;
 
-  ~OrderbookLogger() { close_Log(); }
+  ~BasicOrderbookLogger() { close_Log(); }
 
   void set_logfile_save_location(std::string filepath) {
     if (!fs::is_directory(filepath)) {
@@ -48,7 +56,8 @@ public:
     if (!fs::exists(log_dir))
       fs::create_directories(log_dir);
     logfile_location = log_dir + logfile_name;
-    logFile.open(logfile_location, std::ios::app);
+    logFile.open(logfile_location,
+                 Binary ? std::ios::app | std::ios::binary : std::ios::app);
     if (!logFile.is_open()) {
       std::cerr << "Error opening logger file, exiting program" << std::endl;
       std::exit(1);
@@ -59,7 +68,8 @@ public:
 
     // Start consumer thread
     stop_flag_.store(false, std::memory_order_relaxed);
-    consumer_thread_ = std::thread(&OrderbookLogger::consumer_loop, this);
+    consumer_thread_ =
+        std::thread(&BasicOrderbookLogger::consumer_loop, this);
   }
 
   void log_Trade(SimTick tick, OrderID bid_id, OrderID ask_id, Price price,
@@ -74,6 +84,37 @@ public:
     push_entry(entry);
   }
 
+  /*count trades in as few queue publishes as there is room for, one when the
+   * queue has space. fill(entry, i) sets the i-th trade's tick, IDs, price
+   * and quantity*/
+  template <typename F> void log_Trades(std::size_t count, F &&fill) {
+    auto fill_trade = [&fill](LogEntry &entry, std::size_t i) {
+      entry = LogEntry{};
+      entry.type = LogEntryType::TRADE;
+      fill(entry, i);
+    };
+    std::size_t done = 0;
+    std::uint64_t start = 0;
+    while (true) {
+      std::size_t pushed = queue_.try_push_n(
+          count - done,
+          [&](LogEntry &entry, std::size_t i) { fill_trade(entry, done + i); });
+      done += pushed;
+      if (done == count)
+        break;
+      if (start == 0) {
+        queue_stats_.full_events.add();
+        start = LatencyClock::now();
+      }
+      std::this_thread::yield();
+    }
+    if (start != 0) {
+      queue_stats_.spin_ticks.add(LatencyClock::now() - start);
+      queue_stats_.high_water.set_max(queue_.capacity());
+    }
+    sample_high_water(count);
+  }
+
   void log_message(std::string message, SimTick simulation_tick_time) {
     LogEntry entry{};
     entry.type = LogEntryType::MESSAGE;
@@ -103,8 +144,10 @@ public:
       write_entry(entry);
     }
 
-    logFile << "End logger" << std::endl;
-    logFile << "Tick: " << std::to_string(lastLogTick) << std::endl;
+    if constexpr (!Binary) {
+      logFile << "End logger" << std::endl;
+      logFile << "Tick: " << std::to_string(lastLogTick) << std::endl;
+    }
     logFile.close();
     std::cout << "Closed logger" << std::endl;
   }
@@ -131,6 +174,8 @@ public:
 
   std::string get_logfile_location() { return logfile_location; }
 
+  const QueueStats &get_queue_stats() const { return queue_stats_; }
+
 private:
   const std::string DEFAULT_LOGFILE_SAVE_LOCATION = "logs/";
   std::string CUSTOM_LOGFILE_SAVE_LOCATION;
@@ -142,11 +187,33 @@ private:
   SPSCQueue<LogEntry> queue_;
   std::thread consumer_thread_;
   std::atomic<bool> stop_flag_{false};
+  QueueStats queue_stats_;
+  std::size_t until_sample_ = 0; /*entries left before the next depth sample*/
+
+  /*reading the depth is an acquire load of the consumer's index, so it is
+   * sampled every kHighWaterSample entries, starting with the first. a full
+   * queue is recorded as full without a load*/
+  static constexpr std::size_t kHighWaterSample = 64;
+  void sample_high_water(std::size_t pushed) {
+    if (until_sample_ > pushed) {
+      until_sample_ -= pushed;
+      return;
+    }
+    until_sample_ = kHighWaterSample;
+    queue_stats_.high_water.set_max(queue_.size_approx());
+  }
 
   void push_entry(const LogEntry &entry) {
-    while (!queue_.try_push(entry)) {
-      std::this_thread::yield();
+    if (!queue_.try_push(entry)) {
+      queue_stats_.full_events.add();
+      std::uint64_t start = LatencyClock::now();
+      while (!queue_.try_push(entry)) {
+        std::this_thread::yield();
+      }
+      queue_stats_.spin_ticks.add(LatencyClock::now() - start);
+      queue_stats_.high_water.set_max(queue_.capacity());
     }
+    sample_high_water(1);
   }
 
   void consumer_loop() {
@@ -178,6 +245,12 @@ private:
   }
 
   void write_entry(const LogEntry &e) {
+    if constexpr (Binary) {
+      logFile.write(reinterpret_cast<const char *>(&e), sizeof(e));
+      if (e.type == LogEntryType::TRADE)
+        lastLogTick = e.tick;
+      return;
+    }
     switch (e.type) {
     case LogEntryType::TRADE:
       logFile << e.tick << " | " << e.id1 << " | " << e.id2 << " | "
@@ -202,8 +275,27 @@ private:
     return "log" + std::to_string(tm_now->tm_year) +
            std::to_string(tm_now->tm_mon) + std::to_string(tm_now->tm_mday) +
            std::to_string(tm_now->tm_hour) + std::to_string(tm_now->tm_min) +
-           std::to_string(tm_now->tm_sec) + ".log";
+           std::to_string(tm_now->tm_sec) + (Binary ? ".bin" : ".log");
   }
 };
 
+using OrderbookLogger = BasicOrderbookLogger<false>;
+using BinaryOrderbookLogger = BasicOrderbookLogger<true>;
+
+/*stand-in for books built without a logger, every call is empty and inlines
+ * away*/
+class NullLogger {
+public:
+  void set_logfile_save_location(const std::string &) {}
+  void init_Log() {}
+  void log_Trade(SimTick, OrderID, OrderID, Price, Quantity) {}
+  template <typename F> void log_Trades(std::size_t, F &&) {}
+  void log_message(const std::string &, SimTick) {}
+  void log_order_Error(OrderID) {}
+  void close_Log() {}
+  void flush_log_Dir() {}
+  std::string get_logfile_location() { return std::string(); }
+  const QueueStats &get_queue_stats() const { return QueueStats::none(); }
+};
+
 #endif
@@ -0,0 +1,117 @@
+#ifndef YINHE_SRC_COMMON_PRICEBITMAP_H
+#define YINHE_SRC_COMMON_PRICEBITMAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**************************************
+ * hierarchical occupancy bitmap
+ * one bit per price slot in [0, span), set while the slot's level holds
+ * orders. above the leaves sits a 64-ary tree of summary words: bit j of a
+ * word is set when word j one level down is non-zero, up to a single root
+ * word. the next occupied slot above or below any slot is found with one
+ * ctz/clz per level, so 1M slots take 4 words to reach from anywhere
+ *
+ * slots are offsets, the owner maps prices onto them (asks and bids can
+ * share one bitmap or have their own). single threaded, like the book
+ **************************************/
+class PriceBitmap {
+public:
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  explicit PriceBitmap(std::size_t span) : span_(span) {
+    std::size_t bits = span == 0 ? 1 : span;
+    do {
+      std::size_t words = (bits + 63) / 64;
+      levels_.emplace_back(words, 0);
+      bits = words;
+    } while (bits > 1);
+  }
+
+  std::size_t get_span() const noexcept { return span_; }
+  bool empty() const noexcept { return levels_.back()[0] == 0; }
+
+  bool test(std::size_t slot) const noexcept {
+    return (levels_[0][slot >> 6] >> (slot & 63)) & 1;
+  }
+
+  void set(std::size_t slot) noexcept {
+    for (auto &level : levels_) {
+      std::uint64_t &word = level[slot >> 6];
+      bool was_empty = word == 0;
+      word |= 1ull << (slot & 63);
+      if (!was_empty)
+        return;
+      slot >>= 6;
+    }
+  }
+
+  void clear(std::size_t slot) noexcept {
+    for (auto &level : levels_) {
+      std::uint64_t &word = level[slot >> 6];
+      word &= ~(1ull << (slot & 63));
+      if (word != 0)
+        return;
+      slot >>= 6;
+    }
+  }
+
+  void reset() noexcept {
+    for (auto &level : levels_)
+      std::fill(level.begin(), level.end(), 0);
+  }
+
+  /*lowest occupied slot >= from, npos if none*/
+  std::size_t find_next(std::size_t from) const noexcept {
+    if (from >= span_)
+      return npos;
+    std::size_t slot = from;
+    for (std::size_t depth = 0; depth < levels_.size(); ++depth) {
+      const auto &level = levels_[depth];
+      if ((slot >> 6) >= level.size())
+        return npos;
+      std::uint64_t word = level[slot >> 6] & (~0ull << (slot & 63));
+      if (word != 0) {
+        slot = (slot & ~std::size_t(63)) | __builtin_ctzll(word);
+        /*walk down taking the lowest child each time*/
+        while (depth-- > 0)
+          slot = (slot << 6) | __builtin_ctzll(levels_[depth][slot]);
+        return slot;
+      }
+      slot = (slot >> 6) + 1; /*first bit of the next word, one level up*/
+    }
+    return npos;
+  }
+
+  /*highest occupied slot <= from, npos if none*/
+  std::size_t find_prev(std::size_t from) const noexcept {
+    if (span_ == 0)
+      return npos;
+    std::size_t slot = from < span_ ? from : span_ - 1;
+    for (std::size_t depth = 0; depth < levels_.size(); ++depth) {
+      std::uint64_t word =
+          levels_[depth][slot >> 6] & (~0ull >> (63 - (slot & 63)));
+      if (word != 0) {
+        slot = (slot & ~std::size_t(63)) | (63 - __builtin_clzll(word));
+        while (depth-- > 0)
+          slot = (slot << 6) | (63 - __builtin_clzll(levels_[depth][slot]));
+        return slot;
+      }
+      if ((slot >> 6) == 0)
+        return npos;
+      slot = (slot >> 6) - 1; /*last bit of the previous word, one level up*/
+    }
+    return npos;
+  }
+
+  std::size_t find_first() const noexcept { return find_next(0); }
+  std::size_t find_last() const noexcept { return find_prev(npos); }
+
+private:
+  std::size_t span_;
+  std::vector<std::vector<std::uint64_t>> levels_; /*leaves first, root last*/
+};
+
+#endif
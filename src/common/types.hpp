@@ -8,10 +8,12 @@
  * Price: 32-bit unsigned integer
  * Quantity: 32-bit unsigned integer
  * OrderID: 64-bit unsigned integer
+ * AccountID: 32-bit unsigned integer, dense from 0
  **************************************/
 using Price = std::uint32_t;
 using Quantity = std::uint32_t;
 using OrderID = std::uint64_t;
+using AccountID = std::uint32_t;
 
 /*log ticks in millisecond*/
 using SimTick = std::uint64_t;
@@ -0,0 +1,108 @@
+#ifndef YINHE_SRC_ENGINE_AUCTION_H
+#define YINHE_SRC_ENGINE_AUCTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "depthScan.hpp"
+#include "types.hpp"
+
+/**************************************
+ * auction equilibrium
+ * the single price a crossed book uncrosses at, chosen by, in order:
+ *
+ *   1. the most executable volume, min(demand, supply)
+ *   2. the smallest imbalance, |demand - supply|
+ *   3. the price nearest the reference (the last trade), if there is one
+ *   4. the lowest price
+ *
+ * demand at p is every bid priced p or higher, supply every ask priced p or
+ * lower. only prices where a level sits can win, and only the crossed part
+ * of the book (bids down to the best ask, asks up to the best bid) can trade,
+ * so that part is copied into per-side arrays, best first, and prefix-summed
+ * into cumulative depth with the depth scan kernels. one merge pass over the
+ * two cumulative arrays, in price order, then scores every candidate
+ **************************************/
+namespace auction {
+
+struct Uncross {
+  Price price = 0;             /*0 if the book is not crossed*/
+  std::uint64_t volume = 0;    /*quantity that trades*/
+  std::uint64_t imbalance = 0; /*quantity left unmatched at price*/
+};
+
+inline bool better(const Uncross &a, const Uncross &b, Price reference) {
+  if (a.volume != b.volume)
+    return a.volume > b.volume;
+  if (a.imbalance != b.imbalance)
+    return a.imbalance < b.imbalance;
+  if (reference != 0) {
+    auto distance = [reference](Price price) {
+      return price > reference ? price - reference : reference - price;
+    };
+    if (distance(a.price) != distance(b.price))
+      return distance(a.price) < distance(b.price);
+  }
+  return a.price < b.price;
+}
+
+/*bid prices descend and ask prices ascend, cum[i] is the total of levels
+ * 0..i of the side*/
+inline Uncross equilibrium(const Price *bid_prices, const std::uint64_t *bid_cum,
+                           std::size_t bids, const Price *ask_prices,
+                           const std::uint64_t *ask_cum, std::size_t asks,
+                           Price reference) {
+  Uncross best;
+  std::size_t b = bids; /*bids [0, b) are priced at or above the candidate*/
+  std::size_t a = 0;    /*asks [0, a) are priced at or below it*/
+  while (b > 0 || a < asks) {
+    Price price = a < asks && (b == 0 || ask_prices[a] <= bid_prices[b - 1])
+                      ? ask_prices[a]
+                      : bid_prices[b - 1];
+    while (a < asks && ask_prices[a] == price)
+      ++a;
+    std::uint64_t demand = b > 0 ? bid_cum[b - 1] : 0;
+    std::uint64_t supply = a > 0 ? ask_cum[a - 1] : 0;
+    Uncross candidate{price, demand < supply ? demand : supply,
+                      demand > supply ? demand - supply : supply - demand};
+    if (candidate.volume > 0 && better(candidate, best, reference))
+      best = candidate;
+    while (b > 0 && bid_prices[b - 1] == price)
+      --b;
+  }
+  return best;
+}
+
+/*bids and asks are the book's sides, iterated best first*/
+template <typename BidMap, typename AskMap>
+Uncross equilibrium(const BidMap &bids, const AskMap &asks, Price reference) {
+  if (bids.empty() || asks.empty() ||
+      bids.begin()->first < asks.begin()->first)
+    return Uncross{};
+  Price best_bid = bids.begin()->first;
+  Price best_ask = asks.begin()->first;
+
+  std::vector<Price> bid_prices, ask_prices;
+  std::vector<std::uint64_t> bid_qty, ask_qty;
+  for (auto it = bids.begin(); it != bids.end() && it->first >= best_ask;
+       ++it) {
+    bid_prices.push_back(it->first);
+    bid_qty.push_back(it->second.get_quantity());
+  }
+  for (auto it = asks.begin(); it != asks.end() && it->first <= best_bid;
+       ++it) {
+    ask_prices.push_back(it->first);
+    ask_qty.push_back(it->second.get_quantity());
+  }
+  /*in place: out[i] only depends on qty[0..i]*/
+  depth_scan::prefix_sum(bid_qty.data(), bid_qty.data(), bid_qty.size());
+  depth_scan::prefix_sum(ask_qty.data(), ask_qty.data(), ask_qty.size());
+  return equilibrium(bid_prices.data(), bid_qty.data(), bid_prices.size(),
+                     ask_prices.data(), ask_qty.data(), ask_prices.size(),
+                     reference);
+}
+
+} // namespace auction
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef YINHE_SRC_ENGINE_BOOKSNAPSHOT_H
+#define YINHE_SRC_ENGINE_BOOKSNAPSHOT_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+/**************************************
+ * binary book snapshot
+ * resting state flattened into two arrays: levels in priority order (bids
+ * best first, then asks best first) and the orders of every level in FIFO
+ * order. restoring walks both arrays once and never goes through matching.
+ * pegged orders follow bucket by bucket (bids, then asks), then the stops
+ * waiting to trigger in release order
+ **************************************/
+struct SnapshotHeader {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint16_t flags; // SNAPSHOT_IN_AUCTION
+  std::uint64_t next_order_id;
+  SimTick last_sim_tick;
+  std::uint64_t command_seq; // journal records already applied
+  std::uint64_t bid_levels;
+  std::uint64_t ask_levels;
+  std::uint64_t order_count;
+  std::uint64_t stop_count;
+  Price last_trade_price; // 0 before the first trade
+  std::uint32_t reserved;  // written as 0
+  std::uint64_t peg_count;
+};
+
+struct SnapshotLevel {
+  Price price;
+  std::uint32_t order_count;
+};
+
+struct SnapshotOrder {
+  OrderID id;
+  Quantity init_quantity;
+  Quantity remain_quantity;  // shown tranche for icebergs
+  Quantity display_quantity; // iceberg peak, 0 for plain orders
+  Quantity hidden_quantity;  // iceberg reserve not yet shown
+  AccountID account;
+  std::uint8_t order_type;   // orderType
+  std::uint8_t stp_mode;     // StpMode
+};
+
+struct SnapshotStop {
+  OrderID id;
+  Price trigger_price;
+  Price price;
+  Quantity quantity;
+  AccountID account;
+  std::uint8_t side;       // Side
+  std::uint8_t order_type; // orderType
+  std::uint8_t stp_mode;   // StpMode
+};
+
+struct SnapshotPeg {
+  OrderID id;
+  std::int32_t offset;
+  Quantity init_quantity;
+  Quantity remain_quantity;
+  AccountID account;
+  std::uint8_t side;     // Side
+  std::uint8_t peg_type; // PegType
+  std::uint8_t stp_mode; // StpMode
+};
+
+constexpr std::uint32_t SNAPSHOT_MAGIC = 0x534E4859; // "YHNS"
+constexpr std::uint16_t SNAPSHOT_VERSION = 1;
+constexpr std::uint16_t SNAPSHOT_IN_AUCTION = 1; // taken between start and uncross
+
+struct BookSnapshot {
+  SnapshotHeader header{};
+  std::vector<SnapshotLevel> levels; // bid levels, then ask levels
+  std::vector<SnapshotOrder> orders;
+  std::vector<SnapshotPeg> pegs;
+  std::vector<SnapshotStop> stops;
+
+  /*write the snapshot to filepath, returns false on I/O failure. safe to call
+   * from any thread, the book is not touched*/
+  bool save(const std::string &filepath) const {
+    std::ofstream out(filepath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+      return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(levels.data()),
+              levels.size() * sizeof(SnapshotLevel));
+    out.write(reinterpret_cast<const char *>(orders.data()),
+              orders.size() * sizeof(SnapshotOrder));
+    out.write(reinterpret_cast<const char *>(pegs.data()),
+              pegs.size() * sizeof(SnapshotPeg));
+    out.write(reinterpret_cast<const char *>(stops.data()),
+              stops.size() * sizeof(SnapshotStop));
+    return static_cast<bool>(out);
+  }
+
+  /*read a snapshot written by save(), returns false if the file is missing,
+   * truncated or from another version. the header's counts are checked
+   * against the bytes that follow it before anything is allocated*/
+  bool load(const std::string &filepath) {
+    std::ifstream in(filepath, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+      return false;
+    std::uint64_t remaining = static_cast<std::uint64_t>(in.tellg());
+    in.seekg(0);
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || header.magic != SNAPSHOT_MAGIC ||
+        header.version != SNAPSHOT_VERSION)
+      return false;
+    remaining -= sizeof(header);
+    auto take = [&remaining](std::uint64_t count, std::size_t size) {
+      if (count > remaining / size)
+        return false;
+      remaining -= count * size;
+      return true;
+    };
+    if (!take(header.bid_levels, sizeof(SnapshotLevel)) ||
+        !take(header.ask_levels, sizeof(SnapshotLevel)) ||
+        !take(header.order_count, sizeof(SnapshotOrder)) ||
+        !take(header.peg_count, sizeof(SnapshotPeg)) ||
+        !take(header.stop_count, sizeof(SnapshotStop)))
+      return false;
+    levels.resize(header.bid_levels + header.ask_levels);
+    orders.resize(header.order_count);
+    pegs.resize(header.peg_count);
+    stops.resize(header.stop_count);
+    in.read(reinterpret_cast<char *>(levels.data()),
+            levels.size() * sizeof(SnapshotLevel));
+    in.read(reinterpret_cast<char *>(orders.data()),
+            orders.size() * sizeof(SnapshotOrder));
+    in.read(reinterpret_cast<char *>(pegs.data()),
+            pegs.size() * sizeof(SnapshotPeg));
+    in.read(reinterpret_cast<char *>(stops.data()),
+            stops.size() * sizeof(SnapshotStop));
+    return static_cast<bool>(in);
+  }
+};
+
+#endif
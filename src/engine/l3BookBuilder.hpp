@@ -0,0 +1,124 @@
+#ifndef YINHE_SRC_ENGINE_L3BOOKBUILDER_H
+#define YINHE_SRC_ENGINE_L3BOOKBUILDER_H
+
+#include <map>
+#include <unordered_map>
+
+#include "l3Feed.hpp"
+#include "order.hpp"
+#include "orderbook.hpp"
+
+/*
+ * standalone consumer of the L3 feed. rebuilds the resting book order by order
+ * from the event stream alone, so a replica never needs the engine's state
+ */
+class L3BookBuilder {
+public:
+  /*apply one event, returns false if it does not fit the current book (gap in
+   * sequence or unknown order id)*/
+  bool apply(const L3Event &event) {
+    bool in_sequence = event.seq == last_seq_ + 1;
+    if (!in_sequence)
+      ++sequence_gaps_;
+    last_seq_ = event.seq;
+
+    Side side = static_cast<Side>(event.side);
+    switch (event.type) {
+    case L3EventType::ADD: {
+      auto &level = (side == Side::BUY) ? bids_[event.price] : asks_[event.price];
+      level.push_back(Order(side, event.id, event.price, event.quantity,
+                            orderType::GOODTOCANCEL));
+      orders_[event.id] = std::prev(level.end());
+      return in_sequence;
+    }
+    case L3EventType::PARTIAL_FILL:
+    case L3EventType::REDUCE: {
+      auto it = orders_.find(event.id);
+      if (it == orders_.end())
+        return false;
+      it->second->fill(event.quantity);
+      return in_sequence;
+    }
+    case L3EventType::FILL:
+    case L3EventType::CANCEL:
+      return remove(event.id) && in_sequence;
+    case L3EventType::REJECT:
+      /*rejects at entry never rested, rejects in match() remove the order*/
+      remove(event.id);
+      return in_sequence;
+    case L3EventType::REPLENISH: {
+      if (!remove(event.id))
+        return false;
+      auto &level = (side == Side::BUY) ? bids_[event.price] : asks_[event.price];
+      level.push_back(Order(side, event.id, event.price, event.quantity,
+                            orderType::GOODTOCANCEL));
+      orders_[event.id] = std::prev(level.end());
+      return in_sequence;
+    }
+    }
+    return false;
+  }
+
+  /*drain everything currently queued in the feed, returns events applied*/
+  template <typename Feed> std::size_t drain(Feed &feed) {
+    std::size_t applied = 0;
+    L3Event event;
+    while (feed.poll(event)) {
+      apply(event);
+      ++applied;
+    }
+    return applied;
+  }
+
+  std::size_t get_size() const { return orders_.size(); }
+  std::uint64_t get_last_seq() const { return last_seq_; }
+  std::uint64_t get_sequence_gaps() const { return sequence_gaps_; }
+
+  OrderbookLevelInfos get_levelInfos() const {
+    levelInfos bidInfos, askInfos;
+    bidInfos.reserve(bids_.size());
+    askInfos.reserve(asks_.size());
+    for (const auto &[price, level_orders] : bids_)
+      bidInfos.push_back(levelInfo{price, level_quantity(level_orders)});
+    for (const auto &[price, level_orders] : asks_)
+      askInfos.push_back(levelInfo{price, level_quantity(level_orders)});
+    return OrderbookLevelInfos(bidInfos, askInfos);
+  }
+
+private:
+  std::map<Price, order_list, std::greater<Price>> bids_;
+  std::map<Price, order_list, std::less<Price>> asks_;
+  std::unordered_map<OrderID, order_list::iterator> orders_;
+  std::uint64_t last_seq_ = 0;
+  std::uint64_t sequence_gaps_ = 0;
+
+  bool remove(OrderID id) {
+    auto it = orders_.find(id);
+    if (it == orders_.end())
+      return false;
+    auto itr = it->second;
+    Price price = itr->get_order_price();
+    if (itr->get_order_side() == Side::BUY) {
+      auto map_it = bids_.find(price);
+      map_it->second.erase(itr);
+      if (map_it->second.empty())
+        bids_.erase(map_it);
+    } else {
+      auto map_it = asks_.find(price);
+      map_it->second.erase(itr);
+      if (map_it->second.empty())
+        asks_.erase(map_it);
+    }
+    orders_.erase(it);
+    return true;
+  }
+
+  static Quantity level_quantity(const order_list &level_orders) {
+    Quantity total = 0;
+    for (const auto &order : level_orders)
+      total += order.get_remaining_quantity();
+    return total;
+  }
+};
+
+#endif
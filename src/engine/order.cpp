@@ -1,13 +1,48 @@
+#include <algorithm>
+#include <stdexcept>
+
 #include "order.hpp"
 #include "types.hpp"
 
 Order::Order(Side side_, OrderID orderId_, Price price_, Quantity quantity_,
-             orderType type_)
-    : id(orderId_), price(price_), init_quantity(quantity_),
-      remain_quantity(quantity_), order_side(side_), order_type(type_) {}
+             orderType type_, Quantity display_quantity_, AccountID account_,
+             StpMode stp_mode_)
+    : id(orderId_), remain_quantity(quantity_), hidden_quantity(0),
+      account(account_), order_type(type_), stp_mode(stp_mode_),
+      peg_type(PegType::NONE), order_side(side_), price(price_),
+      init_quantity(quantity_), display_quantity(0) {
+  if (display_quantity_ != 0 && display_quantity_ < quantity_) {
+    display_quantity = display_quantity_;
+    remain_quantity = display_quantity_;
+    hidden_quantity = quantity_ - display_quantity_;
+  }
+}
+
+Order Order::pegged(Side side_, OrderID orderId_, PegType peg_,
+                    std::int32_t offset_, Quantity quantity_,
+                    AccountID account_, StpMode stp_mode_) {
+  Order order(side_, orderId_, static_cast<Price>(offset_), quantity_,
+              orderType::GOODTOCANCEL, 0, account_, stp_mode_);
+  order.peg_type = peg_;
+  return order;
+}
 
 void Order::fill(Quantity quantity) {
   if (quantity > remain_quantity)
     throw std::logic_error("Order cannot be filled");
   remain_quantity -= quantity;
 }
+
+void Order::replenish() {
+  if (!needs_replenish())
+    throw std::logic_error("Order cannot be replenished");
+  remain_quantity = std::min(display_quantity, hidden_quantity);
+  hidden_quantity -= remain_quantity;
+}
+
+void Order::restore(Quantity remain, Quantity hidden) {
+  if (std::uint64_t(remain) + hidden > init_quantity)
+    throw std::logic_error("Order cannot be restored");
+  remain_quantity = remain;
+  hidden_quantity = hidden;
+}
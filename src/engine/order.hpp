@@ -4,33 +4,84 @@
 #include <list>
 
 #include "enums.hpp"
+#include "nodePool.hpp"
 #include "types.hpp"
 
+/*
+ * an iceberg shows display_quantity at a time out of quantity. when the shown
+ * tranche is traded away the next one comes out of the hidden reserve and the
+ * order goes to the back of its level. remaining quantity is always the shown
+ * part, the reserve is only visible through get_hidden_quantity()
+ */
 class Order {
 public:
   Order(Side side_, OrderID orderId_, Price price_, Quantity quantity_,
-        orderType type_ = orderType::FILLANDKILL);
+        orderType type_ = orderType::FILLANDKILL,
+        Quantity display_quantity_ = 0, /*0 or >= quantity: all shown*/
+        AccountID account_ = 0, StpMode stp_mode_ = StpMode::NONE);
+  /*good till cancel, priced at its peg's reference plus offset_ whenever the
+   * book looks at it. the price field holds the offset*/
+  static Order pegged(Side side_, OrderID orderId_, PegType peg_,
+                      std::int32_t offset_, Quantity quantity_,
+                      AccountID account_ = 0,
+                      StpMode stp_mode_ = StpMode::NONE);
 
   Side get_order_side() const noexcept { return order_side; }
   OrderID get_order_id() const noexcept { return id; }
+  AccountID get_account() const noexcept { return account; }
+  StpMode get_stp_mode() const noexcept { return stp_mode; }
   Price get_order_price() const noexcept { return price; }
   Quantity get_init_quantity() const noexcept { return init_quantity; }
   Quantity get_remaining_quantity() const noexcept { return remain_quantity; }
-  Quantity get_filled_quantity() const noexcept { return init_quantity - remain_quantity; }
+  Quantity get_hidden_quantity() const noexcept { return hidden_quantity; }
+  Quantity get_display_quantity() const noexcept { return display_quantity; }
+  Quantity get_filled_quantity() const noexcept {
+    return init_quantity - remain_quantity - hidden_quantity;
+  }
   orderType get_order_type() const noexcept { return order_type; }
-  bool isFilled() const noexcept { return remain_quantity == 0; }
+  PegType get_peg_type() const noexcept { return peg_type; }
+  bool is_pegged() const noexcept { return peg_type != PegType::NONE; }
+  std::int32_t get_peg_offset() const noexcept {
+    return static_cast<std::int32_t>(price);
+  }
+  bool is_iceberg() const noexcept { return display_quantity != 0; }
+  /*nothing shown and nothing in reserve*/
+  bool isFilled() const noexcept {
+    return remain_quantity == 0 && hidden_quantity == 0;
+  }
+  /*shown tranche traded away, the reserve can refill it*/
+  bool needs_replenish() const noexcept {
+    return remain_quantity == 0 && hidden_quantity != 0;
+  }
 
   void fill(Quantity quantity_);
+  void replenish(); /*show the next tranche from the reserve*/
+  void restore(Quantity remain, Quantity hidden); /*snapshot restore only*/
 
 private:
+  /*hot: what every front-of-level step of the match loop reads, kept next
+   * to the list links. the id goes on the trade and is compared with the
+   * aggressor's, the account and instruction decide self-trade prevention,
+   * so both are read as often as the quantities*/
   OrderID id;
+  Quantity remain_quantity;
+  Quantity hidden_quantity; /*filled or due a refill after every trade*/
+  AccountID account;
+  orderType order_type; /*the FOK check*/
+  StpMode stp_mode;
+  PegType peg_type; /*pegs are not published*/
+  Side order_side;  /*cold, fills the word*/
+  /*cold: read when the order is added, leaves the book or is snapshotted*/
   Price price;
   Quantity init_quantity;
-  Quantity remain_quantity;
-  Side order_side;
-  orderType order_type;
+  Quantity display_quantity; /*icebergs only, read once per tranche. 0 for a
+                                plain order*/
 };
 
-using order_list = std::list<Order>;
+static_assert(sizeof(Order) == 40, "Order should stay five words");
+
+/*nodes come from the owning book's NodePool so a level's orders are laid out
+ * in arrival order, a list built without a pool allocates as usual*/
+using order_list = std::list<Order, PoolAllocator<Order>>;
 
 #endif
@@ -1,37 +1,48 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
 #include "order.hpp"
 #include "orderLog.hpp"
 #include "orderbook.hpp"
 #include "trade.hpp"
 
-/*change to false if you don't want to create log files when testing*/
+#define ORDERBOOK_TEMPLATE                                                     \
+  template <typename LoggerPolicy, typename StoragePolicy,                     \
+            template <typename> class IndexPolicy, typename StatsPolicy,       \
+            typename AllocationPolicy, typename OwnerPolicy>
+#define ORDERBOOK                                                              \
+  BasicOrderbook<LoggerPolicy, StoragePolicy, IndexPolicy, StatsPolicy,        \
+                 AllocationPolicy, OwnerPolicy>
 
 // cancel goodforday orders if its the end of the day
 /*check simulation tick*/
 /*TODO FINISH*/
 
-/*intialize orderbook with optional logfile with optional location specifier*/
-Orderbook::Orderbook() {
-  std::cout << "Initializing OrderbookLogger" << std::endl;
-  if (ENABLE_LOGGER) {
-    if (CLEAR_LOGS_ON_INIT)
-      Logger.flush_log_Dir();
-    Logger.init_Log();
-  }
-  last_sim_tick = 0;
-}
+/*no I/O and no threads, a book is only its containers until a logger,
+ * journal or feed is attached*/
+ORDERBOOK_TEMPLATE
+ORDERBOOK::BasicOrderbook() : last_sim_tick(0) {}
 
-Orderbook::Orderbook(std::string logfile_location) : Orderbook() {
-  Logger.set_logfile_save_location(logfile_location);
-}
-
-Trades Orderbook::match() {
+ORDERBOOK_TEMPLATE
+Trades ORDERBOOK::match() {
   Trades trades;
   /*reserve size in case we can match all orders for no memory problems later
    * on*/
   trades.reserve(orders_.size());
+  match(trades);
+  return trades;
+}
 
+/*appends to trades, so stops released mid-cascade share one vector*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::match(Trades &trades) {
+  ScopedLatency<StatsPolicy::enabled> timer(latency_.match);
+  if (has_pegs()) {
+    match_with_pegs(trades);
+    return;
+  }
   while (true) {
     if (bids_.empty() || asks_.empty())
       break;
@@ -43,58 +54,7 @@ Trades Orderbook::match() {
       break; /*can't match if best bid is lower than best ask for current
                 level*/
 
-    /*match in current level until empty*/
-    while (!bids.empty() && !asks.empty()) {
-      auto *bid = &bids.front();
-      auto *ask = &asks.front();
-
-      /*reject fill or kill orders that cannot be fully filled*/
-      if (bid->get_order_type() == orderType::FILLORKILL &&
-          !can_fully_fill_unchecked(Side::BUY, bid->get_order_price(),
-                                    bid->get_remaining_quantity())) {
-        OrderID bid_id = bid->get_order_id();
-        bids.pop_front();
-        orders_.erase(bid_id);
-        continue;
-      }
-      if (ask->get_order_type() == orderType::FILLORKILL &&
-          !can_fully_fill_unchecked(Side::SELL, ask->get_order_price(),
-                                    ask->get_remaining_quantity())) {
-        OrderID ask_id = ask->get_order_id();
-        asks.pop_front();
-        orders_.erase(ask_id);
-        continue;
-      }
-
-      /*we can trade at most the minimum quantity between the two orders*/
-      Quantity trade_quantity = std::min(bid->get_remaining_quantity(),
-                                         ask->get_remaining_quantity());
-      bid->fill(trade_quantity);
-      ask->fill(trade_quantity);
-
-      /*capture IDs before potential destruction*/
-      OrderID bid_id = bid->get_order_id();
-      OrderID ask_id = ask->get_order_id();
-
-      if (bid->isFilled()) {
-        bids.pop_front();
-        orders_.erase(bid_id);
-      }
-      if (ask->isFilled()) {
-        asks.pop_front();
-        orders_.erase(ask_id);
-      }
-
-      /*trade is settled at ask price if the bid price is higher than ask for
-       * simplicity*/
-      /*push the new trade to the back of the trades vector*/
-      trades.push_back(Trade(tradeInfo{bid_id, ask_price, trade_quantity},
-                             tradeInfo{ask_id, ask_price, trade_quantity}));
-
-      if (ENABLE_LOGGER)
-        Logger.log_Trade(last_sim_tick, bid_id, ask_id, ask_price,
-                         trade_quantity);
-    }
+    cross_levels(bids, bid_price, asks, ask_price, trades);
     if (bids.empty()) /*erase current price level if there are no more orders at
                          the level*/
       bids_.erase(bid_price);
@@ -108,47 +68,662 @@ Trades Orderbook::match() {
   if (!asks_.empty()) {
     ;
   }
+}
 
-  return trades;
+/*match in current level until empty. pegged orders are not on the L3 feed,
+ * so only limit orders publish their fills*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::cross_levels(level_type &bids, Price bid_price,
+                             level_type &asks, Price ask_price,
+                             Trades &trades) {
+  while (!bids.empty() && !asks.empty()) {
+    auto *bid = &bids.front();
+    auto *ask = &asks.front();
+
+    /*reject fill or kill orders that cannot be fully filled*/
+    if (bid->get_order_type() == orderType::FILLORKILL &&
+        !fok_covered(*bid)) {
+      OrderID bid_id = bid->get_order_id();
+      if constexpr (StatsPolicy::enabled)
+        stats_.fok_rejects.add();
+      publish_l3(L3EventType::REJECT, bid_id, Side::BUY, bid_price,
+                 bid->get_remaining_quantity());
+      close_exposure(*bid, bid->get_remaining_quantity());
+      unindex_order(bid_id);
+      bids.pop_front();
+      continue;
+    }
+    if (ask->get_order_type() == orderType::FILLORKILL &&
+        !fok_covered(*ask)) {
+      OrderID ask_id = ask->get_order_id();
+      if constexpr (StatsPolicy::enabled)
+        stats_.fok_rejects.add();
+      publish_l3(L3EventType::REJECT, ask_id, Side::SELL, ask_price,
+                 ask->get_remaining_quantity());
+      close_exposure(*ask, ask->get_remaining_quantity());
+      unindex_order(ask_id);
+      asks.pop_front();
+      continue;
+    }
+
+    /*the instruction that applies is one of the two fronts', so on flow
+     * where neither carries one the accounts are never compared. the modes
+     * sit next to the accounts, on a line the step has already loaded*/
+    if ((bid->get_stp_mode() != StpMode::NONE ||
+         ask->get_stp_mode() != StpMode::NONE) &&
+        bid->get_account() == ask->get_account() &&
+        prevent_self_trade(bids, bid_price, asks, ask_price))
+      continue;
+
+    if constexpr (AllocationPolicy::pro_rata) {
+      if (bid->get_order_id() == aggressor_id_ &&
+          allocate_pro_rata(asks, ask_price, Side::SELL, bids, bid_price,
+                            ask_price, trades))
+        continue;
+      if (ask->get_order_id() == aggressor_id_ &&
+          allocate_pro_rata(bids, bid_price, Side::BUY, asks, ask_price,
+                            ask_price, trades))
+        continue;
+    }
+
+    /*we can trade at most the minimum quantity between the two orders*/
+    Quantity trade_quantity = std::min(bid->get_remaining_quantity(),
+                                       ask->get_remaining_quantity());
+    /*trade is settled at ask price if the bid price is higher than ask for
+     * simplicity*/
+    trade_fronts(bids, bid_price, asks, ask_price, trade_quantity, ask_price,
+                 trades);
+  }
 }
 
-bool Orderbook::can_fully_fill(Side side, Price price, Quantity quantity) {
-  if (!can_match(side, price))
+/*fill both front orders, retire or refill them, and record the trade*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::trade_fronts(level_type &bids, Price bid_price,
+                             level_type &asks, Price ask_price,
+                             Quantity trade_quantity, Price price,
+                             Trades &trades) {
+  auto *bid = &bids.front();
+  auto *ask = &asks.front();
+  bids.fill(*bid, trade_quantity);
+  asks.fill(*ask, trade_quantity);
+  close_exposure(*bid, trade_quantity);
+  close_exposure(*ask, trade_quantity);
+
+  /*capture IDs before potential destruction*/
+  OrderID bid_id = bid->get_order_id();
+  OrderID ask_id = ask->get_order_id();
+
+  if (!bid->is_pegged())
+    publish_l3(bid->isFilled() ? L3EventType::FILL : L3EventType::PARTIAL_FILL,
+               bid_id, Side::BUY, price, trade_quantity);
+  if (!ask->is_pegged())
+    publish_l3(ask->isFilled() ? L3EventType::FILL : L3EventType::PARTIAL_FILL,
+               ask_id, Side::SELL, price, trade_quantity);
+
+  if (bid->isFilled()) {
+    unindex_order(bid_id);
+    bids.pop_front();
+  } else if (bid->needs_replenish()) {
+    replenish_front(bids, Side::BUY, bid_price);
+  }
+  if (ask->isFilled()) {
+    unindex_order(ask_id);
+    asks.pop_front();
+  } else if (ask->needs_replenish()) {
+    replenish_front(asks, Side::SELL, ask_price);
+  }
+
+  record_trade(bid_id, ask_id, price, trade_quantity, trades);
+}
+
+/*the aggressor's instruction decides. without one in the pair (pegs
+ * crossing after a BBO move) the later order counts as the aggressor.
+ * auction uncrosses never get here and trade regardless*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::prevent_self_trade(level_type &bids, Price bid_price,
+                                   level_type &asks, Price ask_price) {
+  const Order &bid = bids.front();
+  const Order &ask = asks.front();
+  bool aggressor_front = bid.get_order_id() == aggressor_id_ ||
+                         ask.get_order_id() == aggressor_id_;
+  bool bid_aggresses = aggressor_front
+                           ? bid.get_order_id() == aggressor_id_
+                           : bid.get_order_id() > ask.get_order_id();
+  StpMode mode = aggressor_front ? aggressor_stp_
+                 : bid_aggresses ? bid.get_stp_mode()
+                                 : ask.get_stp_mode();
+  if (mode == StpMode::NONE)
     return false;
-  return can_fully_fill_unchecked(side, price, quantity);
+  if constexpr (StatsPolicy::enabled)
+    stats_.self_trades_prevented.add();
+
+  bool cancel_bid = false;
+  bool cancel_ask = false;
+  switch (mode) {
+  case StpMode::CANCEL_RESTING:
+    (bid_aggresses ? cancel_ask : cancel_bid) = true;
+    break;
+  case StpMode::CANCEL_AGGRESSOR:
+    (bid_aggresses ? cancel_bid : cancel_ask) = true;
+    break;
+  case StpMode::CANCEL_BOTH:
+    cancel_bid = cancel_ask = true;
+    break;
+  case StpMode::DECREMENT: {
+    Quantity quantity =
+        std::min(bid.get_remaining_quantity(), ask.get_remaining_quantity());
+    decrement_front(bids, Side::BUY, bid_price, quantity);
+    decrement_front(asks, Side::SELL, ask_price, quantity);
+    return true;
+  }
+  case StpMode::NONE:
+    break;
+  }
+  if (cancel_bid)
+    cancel_front(bids, Side::BUY, bid_price);
+  if (cancel_ask)
+    cancel_front(asks, Side::SELL, ask_price);
+  return true;
 }
 
-bool Orderbook::can_fully_fill_unchecked(Side side, Price price,
-                                         Quantity quantity) {
-  if (side == Side::BUY) {
-    for (auto it = asks_.begin(); it != asks_.end(); ++it) {
-      auto &[ask_price, asks] = *it;
-      if (ask_price > price)
+/*the whole order goes, iceberg reserve included*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::cancel_front(level_type &level, Side side, Price price) {
+  Order &order = level.front();
+  OrderID id = order.get_order_id();
+  close_exposure(order,
+                 order.get_remaining_quantity() + order.get_hidden_quantity());
+  if (!order.is_pegged())
+    publish_l3(L3EventType::CANCEL, id, side, price,
+               order.get_remaining_quantity());
+  unindex_order(id);
+  level.pop_front();
+}
+
+/*an order cut to nothing is cancelled, an iceberg cut through its tranche
+ * shows the next one*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::decrement_front(level_type &level, Side side, Price price,
+                                Quantity quantity) {
+  Order &order = level.front();
+  if (quantity == order.get_remaining_quantity() &&
+      order.get_hidden_quantity() == 0) {
+    cancel_front(level, side, price);
+    return;
+  }
+  level.fill(order, quantity);
+  close_exposure(order, quantity);
+  if (!order.is_pegged())
+    publish_l3(L3EventType::REDUCE, order.get_order_id(), side, price,
+               quantity);
+  if (order.needs_replenish())
+    replenish_front(level, side, price);
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::record_trade(OrderID bid_id, OrderID ask_id, Price price,
+                             Quantity quantity, Trades &trades) {
+  /*push the new trade to the back of the trades vector*/
+  trades.push_back(Trade(tradeInfo{bid_id, price, quantity},
+                         tradeInfo{ask_id, price, quantity}));
+  last_trade_price_ = price;
+  if constexpr (StatsPolicy::enabled) {
+    stats_.trades.add();
+    stats_.traded_quantity.add(quantity);
+  }
+
+  if (LoggerPolicy::enabled && logger_ != nullptr && !replaying_ &&
+      !batching_)
+    logger_->log_Trade(last_sim_tick, bid_id, ask_id, price, quantity);
+}
+
+/*share the aggressor's whole remaining quantity out over the passive level
+ * in one go. quantities are read into a reused buffer and each order's
+ * share, floor(q * quantity / total), is worked out in the same pass over
+ * them. the lots lost to rounding are fewer than the orders sharing, so one
+ * more pass in time priority hands them out a lot each. orders keep their
+ * place in the level, except icebergs whose tranche runs out, which refill
+ * at the back like in time priority. returns false, leaving the level to the
+ * FIFO loop, when the aggressor takes the whole level anyway*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::allocate_pro_rata(level_type &passive, Price passive_price,
+                                  Side passive_side,
+                                  level_type &aggressor_level,
+                                  Price aggressor_price, Price price,
+                                  Trades &trades) {
+  Order &aggressor = aggressor_level.front();
+  std::uint64_t quantity = aggressor.get_remaining_quantity();
+  std::uint64_t total = passive.get_quantity();
+  if (passive.size() < 2 || quantity >= total)
+    return false;
+
+  /*self-trade prevention works front by front, leave such a level to the
+   * FIFO loop*/
+  if (aggressor.get_stp_mode() != StpMode::NONE)
+    for (const auto &order : passive)
+      if (order.get_account() == aggressor.get_account())
         return false;
-      for (auto &order : asks) {
-        Quantity available = order.get_remaining_quantity();
-        if (available >= quantity)
-          return true;
-        quantity -= available;
+
+  allocation_ids_.clear();
+  allocation_.clear();
+  std::uint64_t shared = quantity;
+  std::size_t first = 0;
+  auto it = passive.begin();
+  if constexpr (AllocationPolicy::top_order_first) {
+    std::uint64_t top = std::min<std::uint64_t>(
+        it->get_remaining_quantity(), quantity);
+    allocation_ids_.push_back(it->get_order_id());
+    allocation_.push_back(top);
+    shared -= top;
+    total -= it->get_remaining_quantity();
+    first = 1;
+    ++it;
+  }
+  std::uint64_t allocated = 0;
+  for (; it != passive.end(); ++it) {
+    std::uint64_t share =
+        shared == 0 ? 0 : it->get_remaining_quantity() * shared / total;
+    allocation_ids_.push_back(it->get_order_id());
+    allocation_.push_back(share);
+    allocated += share;
+  }
+  /*every share is below its order's quantity, so each can take one more*/
+  for (std::size_t i = first; allocated < shared; ++i, ++allocated)
+    ++allocation_[i];
+
+  OrderID aggressor_id = aggressor.get_order_id();
+  Side aggressor_side =
+      passive_side == Side::BUY ? Side::SELL : Side::BUY;
+  for (std::size_t i = 0; i < allocation_.size(); ++i) {
+    if (allocation_[i] == 0)
+      continue;
+    Quantity fill = static_cast<Quantity>(allocation_[i]);
+    OrderID id = allocation_ids_[i];
+    auto &itr = orders_.find(id)->itr;
+    passive.fill(*itr, fill);
+    aggressor_level.fill(aggressor, fill);
+    close_exposure(*itr, fill);
+    close_exposure(aggressor, fill);
+    if (!itr->is_pegged())
+      publish_l3(itr->isFilled() ? L3EventType::FILL
+                                 : L3EventType::PARTIAL_FILL,
+                 id, passive_side, price, fill);
+    if (!aggressor.is_pegged())
+      publish_l3(aggressor.isFilled() ? L3EventType::FILL
+                                      : L3EventType::PARTIAL_FILL,
+                 aggressor_id, aggressor_side, price, fill);
+    if (itr->isFilled()) {
+      auto filled = itr; /*itr lives in the entry unindexing drops*/
+      unindex_order(id);
+      passive.erase(filled);
+    } else if (itr->needs_replenish()) {
+      itr = passive.requeue(itr); /*in place, as replenish_front()*/
+      if constexpr (StatsPolicy::enabled)
+        stats_.iceberg_refills.add();
+      if (!itr->is_pegged())
+        publish_l3(L3EventType::REPLENISH, id, passive_side, passive_price,
+                   itr->get_remaining_quantity());
+    }
+    if (passive_side == Side::BUY)
+      record_trade(id, aggressor_id, price, fill, trades);
+    else
+      record_trade(aggressor_id, id, price, fill, trades);
+  }
+  if (aggressor.isFilled()) {
+    unindex_order(aggressor_id);
+    aggressor_level.pop_front();
+  } else {
+    replenish_front(aggressor_level, aggressor_side, aggressor_price);
+  }
+  if (passive.needs_compaction())
+    passive.compact([this](OrderID id, typename level_type::handle moved) {
+      orders_.find(id)->itr = moved;
+    });
+  return true;
+}
+
+/*match() while pegged orders rest. each round the best bid and ask are
+ * picked from the best price level and the best bucket of each peg kind. the
+ * buckets are priced from the references once, they hold still for the
+ * whole match*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::match_with_pegs(Trades &trades) {
+  Price best_bid, best_ask;
+  peg_references(best_bid, best_ask);
+  while (true) {
+    BestLevel bid = best_level(Side::BUY, best_bid, best_ask);
+    BestLevel ask = best_level(Side::SELL, best_bid, best_ask);
+    if (bid.level == nullptr || ask.level == nullptr || bid.price < ask.price)
+      break;
+    cross_levels(*bid.level, bid.price, *ask.level, ask.price, trades);
+    drop_if_empty(Side::BUY, bid);
+    drop_if_empty(Side::SELL, ask);
+  }
+}
+
+ORDERBOOK_TEMPLATE
+Price ORDERBOOK::best_limit_price(Side side) const {
+  if (side == Side::BUY)
+    return bids_.empty() ? 0 : bids_.begin()->first;
+  return asks_.empty() ? 0 : asks_.begin()->first;
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::peg_references(Price &best_bid, Price &best_ask) const {
+  if (peg_refs_frozen_) {
+    best_bid = peg_bid_ref_;
+    best_ask = peg_ask_ref_;
+  } else {
+    best_bid = best_limit_price(Side::BUY);
+    best_ask = best_limit_price(Side::SELL);
+  }
+}
+
+ORDERBOOK_TEMPLATE
+Price ORDERBOOK::peg_price(Side side, PegType peg, std::int32_t offset,
+                           Price best_bid, Price best_ask) {
+  std::int64_t reference;
+  if (peg == PegType::PRIMARY) {
+    reference = side == Side::BUY ? best_bid : best_ask;
+    if (reference == 0)
+      return 0;
+  } else {
+    if (best_bid == 0 || best_ask == 0)
+      return 0;
+    std::int64_t sum = std::int64_t(best_bid) + best_ask;
+    reference = side == Side::BUY ? sum / 2 : (sum + 1) / 2;
+  }
+  std::int64_t pegged = reference + offset;
+  if (pegged <= 0 || pegged > std::numeric_limits<Price>::max())
+    return 0;
+  return static_cast<Price>(pegged);
+}
+
+/*at the same price the limit level goes first, then primary pegs, then
+ * midpoint pegs. a bucket priced off the range is skipped for the next one*/
+ORDERBOOK_TEMPLATE
+typename ORDERBOOK::BestLevel ORDERBOOK::best_level(Side side, Price best_bid,
+                                                    Price best_ask) {
+  BestLevel best;
+  auto consider = [&](level_type &level, Price price, PegType peg,
+                      std::int32_t offset) {
+    if (best.level == nullptr ||
+        (side == Side::BUY ? price > best.price : price < best.price))
+      best = BestLevel{&level, price, peg, offset};
+  };
+  auto consider_pegs = [&](auto &pegs) {
+    for (PegType peg : {PegType::PRIMARY, PegType::MIDPOINT}) {
+      bool has_reference =
+          peg == PegType::PRIMARY
+              ? (side == Side::BUY ? best_bid : best_ask) != 0
+              : best_bid != 0 && best_ask != 0;
+      if (!has_reference)
+        continue;
+      for (auto &[offset, bucket] : pegs.buckets(peg)) {
+        Price price = peg_price(side, peg, offset, best_bid, best_ask);
+        if (price != 0) {
+          consider(bucket, price, peg, offset);
+          break;
+        }
       }
     }
+  };
+  if (side == Side::BUY) {
+    if (!bids_.empty())
+      consider(bids_.begin()->second, bids_.begin()->first, PegType::NONE, 0);
+    consider_pegs(peg_bids_);
+  } else {
+    if (!asks_.empty())
+      consider(asks_.begin()->second, asks_.begin()->first, PegType::NONE, 0);
+    consider_pegs(peg_asks_);
+  }
+  return best;
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::drop_if_empty(Side side, const BestLevel &best) {
+  if (!best.level->empty())
+    return;
+  if (best.peg == PegType::NONE) {
+    if (side == Side::BUY)
+      bids_.erase(best.price);
+    else
+      asks_.erase(best.price);
+  } else if (side == Side::BUY) {
+    peg_bids_.buckets(best.peg).erase(best.offset);
   } else {
-    for (auto it = bids_.begin(); it != bids_.end(); ++it) {
-      auto &[bid_price, bids] = *it;
-      if (bid_price < price)
+    peg_asks_.buckets(best.peg).erase(best.offset);
+  }
+}
+
+/*an iceberg's shown tranche is gone: refill it from the reserve and send it
+ * to the back of its level. the order keeps its node (or slot) and its ID
+ * index entry, only a moved ring slot has to be repointed*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::replenish_front(level_type &level, Side side, Price price) {
+  auto moved = level.requeue_front();
+  if constexpr (!level_type::kRequeueKeepsHandle)
+    orders_.find(moved->get_order_id())->itr = moved;
+  if constexpr (StatsPolicy::enabled)
+    stats_.iceberg_refills.add();
+  publish_l3(L3EventType::REPLENISH, moved->get_order_id(), side, price,
+             moved->get_remaining_quantity());
+}
+
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::can_fully_fill(Side side, Price price, Quantity quantity) {
+  /*a pegged order can be the best price without a level behind it*/
+  if (!has_pegs() && !can_match(side, price))
+    return false;
+  return can_fully_fill_unchecked(side, price, quantity);
+}
+
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::can_fully_fill_unchecked(Side side, Price price,
+                                         Quantity quantity) {
+  /*match() refills icebergs from their reserve, so it counts here*/
+  return depth_to_cover(side, price, quantity, true).quantity >= quantity;
+}
+
+/*self-trade prevention cancels or decrements same-account liquidity instead
+ * of trading it, so an armed FOK is checked against what it trades before
+ * its instruction stops it*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::fok_covered(const Order &order) const {
+  std::uint64_t target = order.get_remaining_quantity();
+  Side side = order.get_order_side();
+  Price price = order.get_order_price();
+  if (order.get_stp_mode() == StpMode::NONE)
+    return depth_to_cover(side, price, target, true).quantity >= target;
+  return stp_depth(side, price, order.get_account(), order.get_stp_mode(),
+                   target) >= target;
+}
+
+/*the quantity an order of side at price, carrying mode, trades in priority
+ * order, counted up to target. under CANCEL_RESTING the account's own orders
+ * are cancelled and walked past. under the other modes the order is
+ * cancelled or decremented at the first of them, and decremented quantity is
+ * not filled, so nothing behind it counts. an iceberg's reserve refills at
+ * the back of its level, it only counts in a level walked all the way
+ * through. walks orders, only armed FOKs pay for it*/
+ORDERBOOK_TEMPLATE
+std::uint64_t ORDERBOOK::stp_depth(Side side, Price price, AccountID account,
+                                   StpMode mode, std::uint64_t target) const {
+  bool walk_past = mode == StpMode::CANCEL_RESTING;
+  std::uint64_t depth = 0;
+  /*false once the walk stops*/
+  auto add_level = [&](const level_type &level) {
+    std::uint64_t shown = 0;
+    std::uint64_t total = 0;
+    for (const Order &resting : level) {
+      if (resting.get_account() == account) {
+        if (walk_past)
+          continue;
+        depth += shown;
         return false;
-      for (auto &order : bids) {
-        Quantity available = order.get_remaining_quantity();
-        if (available >= quantity)
-          return true;
-        quantity -= available;
       }
+      shown += resting.get_remaining_quantity();
+      total += resting.get_remaining_quantity() + resting.get_hidden_quantity();
+    }
+    depth += total;
+    return depth < target;
+  };
+  /*at one price the level goes first, then primary and midpoint buckets,
+   * as best_level() picks them*/
+  auto walk = [&](const auto &side_map, const auto &pegs, Side resting) {
+    const auto &within = side_map.key_comp();
+    std::vector<std::pair<Price, const level_type *>> pegged;
+    if (!pegs.empty()) {
+      Price best_bid, best_ask;
+      peg_references(best_bid, best_ask);
+      for (PegType peg : {PegType::PRIMARY, PegType::MIDPOINT})
+        for (const auto &[offset, bucket] : pegs.buckets(peg)) {
+          Price pegged_price =
+              peg_price(resting, peg, offset, best_bid, best_ask);
+          if (pegged_price != 0 && !within(price, pegged_price))
+            pegged.emplace_back(pegged_price, &bucket);
+        }
+      std::stable_sort(pegged.begin(), pegged.end(),
+                       [&within](const auto &a, const auto &b) {
+                         return within(a.first, b.first);
+                       });
+    }
+    auto it = side_map.begin();
+    std::size_t next_peg = 0;
+    while (true) {
+      bool has_level = it != side_map.end() && !within(price, it->first);
+      bool has_peg = next_peg < pegged.size();
+      if (!has_level && !has_peg)
+        return;
+      const level_type *level;
+      if (has_level && (!has_peg || !within(pegged[next_peg].first, it->first)))
+        level = &(it++)->second;
+      else
+        level = pegged[next_peg++].second;
+      if (!add_level(*level))
+        return;
+    }
+  };
+  if (side == Side::BUY)
+    walk(asks_, peg_asks_, Side::SELL);
+  else
+    walk(bids_, peg_bids_, Side::BUY);
+  return depth;
+}
+
+/*most FOKs are covered by the best level or the few behind it, so the head
+ * of the book is summed one level at a time. only past it are level totals
+ * copied into a contiguous batch for the SIMD depth scan kernel, batches
+ * growing from 8 to 64 levels so a limit far through the book never gathers
+ * many levels beyond the one that covers the target*/
+ORDERBOOK_TEMPLATE
+template <typename SideMap>
+depth_scan::DepthCover ORDERBOOK::scan_depth(const SideMap &side_map,
+                                             Price price, std::uint64_t target,
+                                             bool with_reserve) const {
+  constexpr std::size_t HEAD = 4;
+  constexpr std::size_t BATCH = 64;
+  std::uint64_t batch[BATCH];
+  depth_scan::DepthCover result;
+  auto it = side_map.begin();
+  const auto &within = side_map.key_comp();
+  for (std::size_t i = 0; i < HEAD && result.quantity < target; ++i, ++it) {
+    if (it == side_map.end() || within(price, it->first))
+      return result;
+    result.quantity += level_depth(it->second, with_reserve);
+    ++result.levels;
+  }
+  std::size_t limit = 8;
+  while (it != side_map.end() && result.quantity < target) {
+    std::size_t n = 0;
+    for (; n < limit && it != side_map.end() && !within(price, it->first);
+         ++it)
+      batch[n++] = level_depth(it->second, with_reserve);
+    if (n == 0)
+      break;
+    depth_scan::DepthCover part =
+        depth_scan::cover(batch, n, target - result.quantity);
+    result.levels += part.levels;
+    result.quantity += part.quantity;
+    if (n < limit)
+      break;
+    if (limit < BATCH)
+      limit *= 2;
+  }
+  return result;
+}
+
+/*with pegged orders resting, every bucket is priced and merged into the
+ * walk over the levels, a bucket and a level at one price counting as one
+ * level. there are few buckets next to the levels, so this stays scalar*/
+ORDERBOOK_TEMPLATE
+template <typename SideMap, typename PegMap>
+depth_scan::DepthCover
+ORDERBOOK::scan_depth_with_pegs(Side side, const SideMap &side_map,
+                                const PegMap &pegs, Price price,
+                                std::uint64_t target, bool with_reserve) const {
+  const auto &within = side_map.key_comp();
+  Price best_bid, best_ask;
+  peg_references(best_bid, best_ask);
+  std::vector<std::pair<Price, std::uint64_t>> pegged;
+  for (PegType peg : {PegType::PRIMARY, PegType::MIDPOINT})
+    for (const auto &[offset, bucket] : pegs.buckets(peg)) {
+      Price pegged_price = peg_price(side, peg, offset, best_bid, best_ask);
+      if (pegged_price != 0 && !within(price, pegged_price))
+        pegged.emplace_back(pegged_price, bucket.get_quantity());
     }
+  std::sort(pegged.begin(), pegged.end(),
+            [&within](const auto &a, const auto &b) {
+              return within(a.first, b.first);
+            });
+
+  depth_scan::DepthCover result;
+  auto it = side_map.begin();
+  std::size_t next_peg = 0;
+  while (result.quantity < target) {
+    bool has_level = it != side_map.end() && !within(price, it->first);
+    bool has_peg = next_peg < pegged.size();
+    if (!has_level && !has_peg)
+      break;
+    /*the better of the next level and the next bucket*/
+    Price level_price;
+    if (has_level && (!has_peg || !within(pegged[next_peg].first, it->first)))
+      level_price = it->first;
+    else
+      level_price = pegged[next_peg].first;
+    if (has_level && it->first == level_price)
+      result.quantity += level_depth((it++)->second, with_reserve);
+    while (next_peg < pegged.size() && pegged[next_peg].first == level_price)
+      result.quantity += pegged[next_peg++].second;
+    ++result.levels;
   }
-  return false;
+  return result;
 }
 
-bool Orderbook::can_match(Side side, Price price) {
+ORDERBOOK_TEMPLATE
+depth_scan::DepthCover ORDERBOOK::get_depth_to_cover(Side side, Price price,
+                                                     Quantity quantity) const {
+  return depth_to_cover(side, price, quantity, false);
+}
+
+/*with_reserve counts icebergs' hidden quantity as well as the shown*/
+ORDERBOOK_TEMPLATE
+depth_scan::DepthCover ORDERBOOK::depth_to_cover(Side side, Price price,
+                                                 Quantity quantity,
+                                                 bool with_reserve) const {
+  if (side == Side::BUY)
+    return peg_asks_.empty()
+               ? scan_depth(asks_, price, quantity, with_reserve)
+               : scan_depth_with_pegs(Side::SELL, asks_, peg_asks_, price,
+                                      quantity, with_reserve);
+  return peg_bids_.empty()
+             ? scan_depth(bids_, price, quantity, with_reserve)
+             : scan_depth_with_pegs(Side::BUY, bids_, peg_bids_, price,
+                                    quantity, with_reserve);
+}
+
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::can_match(Side side, Price price) {
   if (side == Side::BUY) {
     /*check in sell orders*/
     /*if best sell is higher than the bid price, then we can't match*/
@@ -165,92 +740,1220 @@ bool Orderbook::can_match(Side side, Price price) {
   }
 }
 
-OrderID Orderbook::gen_order_id() { return ++next_order_id_; }
+ORDERBOOK_TEMPLATE
+OrderID ORDERBOOK::gen_order_id() { return ++next_order_id_; }
+
+/*one lookup whether or not the level exists, new levels allocate their nodes
+ * from the book's pool*/
+ORDERBOOK_TEMPLATE
+template <typename SideMap>
+typename ORDERBOOK::level_type &ORDERBOOK::level_at(SideMap &side_map,
+                                                   Price price) {
+  return side_map.try_emplace(price, &node_pool_).first->second;
+}
+
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::add_order_ptr(Order add_order_) {
+  Trades trades;
+  submit_order(std::move(add_order_), trades);
+  return trades;
+}
+
+/*trades may already hold earlier commands' trades, only the new ones fire
+ * stops*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::submit_order(Order add_order_, Trades &trades) {
+  ScopedLatency<StatsPolicy::enabled> timer(latency_.add_order);
+  std::size_t first = trades.size();
+  enter_order(std::move(add_order_), trades);
+  if (trades.size() != first && !stops_.empty())
+    release_stops(trades, first);
+  refresh_depth_stats();
+}
 
-[[nodiscard]] Trades Orderbook::add_order_ptr(Order add_order_) {
-  /*reject FOK orders that cannot be fully filled before inserting*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::enter_order(Order add_order_, Trades &trades) {
+  if constexpr (StatsPolicy::enabled)
+    stats_.orders_added[add_order_.get_order_type()].add();
+  /*reject FOK orders that cannot be fully filled before inserting, nothing
+   * fills before the uncross during an auction*/
   if (add_order_.get_order_type() == orderType::FILLORKILL &&
-      !can_fully_fill(add_order_.get_order_side(), add_order_.get_order_price(),
-                      add_order_.get_remaining_quantity())) {
-    return Trades{};
+      (in_auction_ ||
+       (!has_pegs() && !can_match(add_order_.get_order_side(),
+                                  add_order_.get_order_price())) ||
+       !fok_covered(add_order_))) {
+    if constexpr (StatsPolicy::enabled)
+      stats_.fok_rejects.add();
+    publish_l3(L3EventType::REJECT, add_order_.get_order_id(),
+               add_order_.get_order_side(), add_order_.get_order_price(),
+               add_order_.get_remaining_quantity());
+    return;
   }
 
-  Side side = add_order_.get_order_side();
-  Price price = add_order_.get_order_price();
+  if (!in_auction_ && (has_pegs() || add_order_.is_pegged())) {
+    peg_bid_ref_ = best_limit_price(Side::BUY);
+    peg_ask_ref_ = best_limit_price(Side::SELL);
+    peg_refs_frozen_ = true;
+  }
+  open_exposure(add_order_);
   OrderID id = add_order_.get_order_id();
-  auto &v = (side == Side::BUY) ? bids_[price] : asks_[price];
-  v.push_back(std::move(add_order_));
-  auto it = std::prev(v.end());
-  orders_.insert({id, orderEntry{it}});
+  StpMode stp = add_order_.get_stp_mode();
+  bool kill_rest = add_order_.get_order_type() == orderType::FILLORKILL;
+  if (add_order_.is_pegged()) {
+    rest_pegged(std::move(add_order_));
+  } else {
+    Side side = add_order_.get_order_side();
+    Price price = add_order_.get_order_price();
+    auto &v = (side == Side::BUY) ? level_at(bids_, price)
+                                   : level_at(asks_, price);
+    auto it = v.push_back(std::move(add_order_));
+    index_order(id, it->get_account(), it);
+    publish_l3(L3EventType::ADD, id, side, price,
+               it->get_remaining_quantity());
+  }
+
+  if (in_auction_)
+    return; /*accumulates until uncross()*/
+  aggressor_id_ = id;
+  aggressor_stp_ = stp;
+  if (trades.empty())
+    trades = match();
+  else
+    match(trades);
+  peg_refs_frozen_ = false;
+  aggressor_id_ = 0;
+  aggressor_stp_ = StpMode::NONE;
+  /*a FOK never rests, whatever self-trade prevention left of it goes*/
+  if (kill_rest && orders_.find(id) != nullptr)
+    cancel_resting(id);
+}
 
-  /*return matched orders*/
-  return match();
+/*joins the back of its bucket, no price is worked out until something looks*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::rest_pegged(Order pegged_order) {
+  PegType peg = pegged_order.get_peg_type();
+  std::int32_t offset = pegged_order.get_peg_offset();
+  OrderID id = pegged_order.get_order_id();
+  auto &bucket = pegged_order.get_order_side() == Side::BUY
+                     ? peg_bids_.bucket_at(peg, offset, &node_pool_)
+                     : peg_asks_.bucket_at(peg, offset, &node_pool_);
+  AccountID owner = pegged_order.get_account();
+  index_order(id, owner, bucket.push_back(std::move(pegged_order)));
 }
 
+/*stops crossed by trades are entered one at a time. a released stop can
+ * trade and cross further stops, which queue behind the ones already
+ * released, so a cascade runs breadth first in a fixed order and without
+ * recursion. trades gets every trade of the cascade appended*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::release_stops(Trades &trades, std::size_t first) {
+  std::size_t scanned = first;
+  std::size_t next = 0;
+  released_.clear();
+  while (true) {
+    if (scanned < trades.size()) {
+      /*the stops fired by a batch of trades are those its price range
+       * crossed*/
+      Price high = 0;
+      Price low = std::numeric_limits<Price>::max();
+      for (; scanned < trades.size(); ++scanned) {
+        Price price = trades[scanned].get_ask_info().price_;
+        high = std::max(high, price);
+        low = std::min(low, price);
+      }
+      std::size_t fired = stops_.release(high, low, released_);
+      if constexpr (StatsPolicy::enabled)
+        stats_.stops_triggered.add(fired);
+    }
+    if (next == released_.size())
+      break;
+    enter_order(triggered(released_[next++]), trades);
+  }
+  released_.clear();
+}
+
+/*stop-limits enter at their own price. trades print at the ask price, so a
+ * stop-market priced through the book would print there: it enters at the
+ * best opposite price when it fires instead (the last trade price if that
+ * side is empty) and rests there if the level runs out*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Order ORDERBOOK::triggered(const Order &stop) const {
+  if (stop.get_order_type() != orderType::MARKET)
+    return stop;
+  Side side = stop.get_order_side();
+  Price price = last_trade_price_;
+  if (side == Side::BUY && !asks_.empty())
+    price = asks_.begin()->first;
+  else if (side == Side::SELL && !bids_.empty())
+    price = bids_.begin()->first;
+  return Order(side, stop.get_order_id(), price, stop.get_remaining_quantity(),
+               stop.get_order_type(), 0, stop.get_account(),
+               stop.get_stp_mode());
+}
+
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::add_stop_order(Side side, Price trigger_price,
+                                               Price price, Quantity quantity,
+                                               orderType type,
+                                               AccountID account,
+                                               StpMode stp) {
+  const auto ID = gen_order_id();
+  /*a MARKET stop's price is not where it enters, see triggered()*/
+  if (!passes_risk(ID, account, side,
+                   type == orderType::MARKET ? 0 : price, quantity))
+    return Trades{};
+  journal_command(CommandType::ADD_STOP, ID, side, price, quantity, type,
+                  trigger_price, account, stp);
+  Trades trades;
+  add_stop_ptr(trigger_price,
+               Order(side, ID, price, quantity, type, 0, account, stp), trades);
+  return trades;
+}
+
+/*a stop whose trigger the last trade already reached goes straight in*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::add_stop_ptr(Price trigger_price, Order stop_order,
+                             Trades &trades) {
+  bool reached = last_trade_price_ != 0 &&
+                 (stop_order.get_order_side() == Side::BUY
+                      ? last_trade_price_ >= trigger_price
+                      : last_trade_price_ <= trigger_price);
+  if (!reached) {
+    stops_.add(trigger_price, stop_order);
+    return;
+  }
+  if constexpr (StatsPolicy::enabled)
+    stats_.stops_triggered.add();
+  submit_order(triggered(stop_order), trades);
+}
+
+ORDERBOOK_TEMPLATE
 [[nodiscard]] Trades
-Orderbook::add_order(Side side, Price price, Quantity quantity,
-                     orderType type = orderType::FILLANDKILL) {
+ORDERBOOK::add_order(Side side, Price price, Quantity quantity,
+                     orderType type, AccountID account, StpMode stp) {
   const auto ID = gen_order_id();
-  return add_order_ptr(Order(side, ID, price, quantity, type));
+  if (!passes_risk(ID, account, side, price, quantity))
+    return Trades{};
+  journal_command(CommandType::ADD, ID, side, price, quantity, type, 0,
+                  account, stp);
+  return add_order_ptr(
+      Order(side, ID, price, quantity, type, 0, account, stp));
+}
+
+/*good till cancel, trades with its full quantity on entry like any order and
+ * rests showing display_quantity at a time*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::add_iceberg_order(Side side, Price price,
+                                                  Quantity quantity,
+                                                  Quantity display_quantity,
+                                                  AccountID account,
+                                                  StpMode stp) {
+  const auto ID = gen_order_id();
+  if (!passes_risk(ID, account, side, price, quantity))
+    return Trades{};
+  journal_command(CommandType::ADD, ID, side, price, quantity,
+                  orderType::GOODTOCANCEL, display_quantity, account, stp);
+  return add_order_ptr(Order(side, ID, price, quantity,
+                             orderType::GOODTOCANCEL, display_quantity,
+                             account, stp));
+}
+
+/*a BBO move that lets resting pegs cross (a cancel, say) trades on the next
+ * match(), the pegs are priced again from scratch every time*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::add_pegged_order(Side side, PegType peg,
+                                                 std::int32_t offset,
+                                                 Quantity quantity,
+                                                 AccountID account,
+                                                 StpMode stp) {
+  if (peg == PegType::NONE)
+    return Trades{};
+  const auto ID = gen_order_id();
+  if (!passes_risk(ID, account, side, 0, quantity))
+    return Trades{};
+  journal_command(CommandType::ADD_PEG, ID, side, static_cast<Price>(offset),
+                  quantity, orderType::GOODTOCANCEL,
+                  static_cast<std::uint32_t>(peg), account, stp);
+  return add_order_ptr(
+      Order::pegged(side, ID, peg, offset, quantity, account, stp));
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::start_auction() {
+  journal_command(CommandType::AUCTION_START, 0, Side::BUY, 0, 0,
+                  orderType::GOODTOCANCEL);
+  in_auction_ = true;
+}
+
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::uncross() {
+  journal_command(CommandType::UNCROSS, 0, Side::BUY, 0, 0,
+                  orderType::GOODTOCANCEL);
+  Trades trades;
+  uncross_book(trades);
+  return trades;
+}
+
+/*pegs and hidden iceberg reserve take no part in the price*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] auction::Uncross ORDERBOOK::get_indicative_uncross() const {
+  return auction::equilibrium(bids_, asks_, last_trade_price_);
+}
+
+/*every fill prints at the equilibrium price. walking both sides best first
+ * takes exactly the volume the price was chosen for from levels priced at or
+ * through it. afterwards the book matches continuously again: iceberg
+ * reserve the price left out, and pegs priced off the new BBO, may still
+ * cross and trade, and the auction's trades fire stops*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::uncross_book(Trades &trades) {
+  in_auction_ = false;
+  std::size_t first = trades.size();
+  auction::Uncross result = get_indicative_uncross();
+  std::uint64_t remaining = result.volume;
+  while (remaining > 0) {
+    auto &[bid_price, bids] = *bids_.begin();
+    auto &[ask_price, asks] = *asks_.begin();
+    std::uint64_t quantity = std::min<std::uint64_t>(
+        {bids.front().get_remaining_quantity(),
+         asks.front().get_remaining_quantity(), remaining});
+    trade_fronts(bids, bid_price, asks, ask_price,
+                 static_cast<Quantity>(quantity), result.price, trades);
+    remaining -= quantity;
+    if (bids.empty())
+      bids_.erase(bid_price);
+    if (asks.empty())
+      asks_.erase(ask_price);
+  }
+  if constexpr (StatsPolicy::enabled)
+    stats_.auction_uncrosses.add();
+  match(trades);
+  if (trades.size() != first && !stops_.empty())
+    release_stops(trades, first);
+  refresh_depth_stats();
+}
+
+/*cancel the resting order and re-add it under the same ID with the new price
+ * and quantity, returns trades if the new price crosses*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::modify_order(OrderID modify_order_id,
+                                             Price price, Quantity quantity) {
+  order_entry *entry = orders_.find(modify_order_id);
+  if (entry == nullptr)
+    return Trades{};
+  /*a refused modify leaves the order as it was*/
+  if (!passes_modify_risk(modify_order_id, *entry->itr, price, quantity))
+    return Trades{};
+  journal_command(CommandType::MODIFY, modify_order_id,
+                  entry->itr->get_order_side(), price, quantity,
+                  entry->itr->get_order_type());
+  Trades trades;
+  replace_order(modify_order_id, price, quantity, trades);
+  return trades;
+}
+
+/*checked net of the exposure of the order being replaced*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::passes_modify_risk(OrderID id, const Order &order, Price price,
+                                   Quantity quantity) {
+  std::uint64_t open =
+      std::uint64_t(order.get_remaining_quantity()) + order.get_hidden_quantity();
+  return passes_risk(id, order.get_account(), order.get_order_side(),
+                     order.is_pegged() ? 0 : price, quantity, open,
+                     open * risk_price(order));
+}
+
+/*cancel/replace without journaling, shared by modify_order() and
+ * apply_command(). false if the order is not resting*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::replace_order(OrderID modify_order_id, Price price,
+                              Quantity quantity, Trades &trades) {
+  order_entry *entry = orders_.find(modify_order_id);
+  if (entry == nullptr)
+    return false;
+  Side side = entry->itr->get_order_side();
+  orderType type = entry->itr->get_order_type();
+  Quantity display = entry->itr->get_display_quantity(); /*stays an iceberg*/
+  PegType peg = entry->itr->get_peg_type(); /*stays pegged*/
+  AccountID account = entry->itr->get_account();
+  StpMode stp = entry->itr->get_stp_mode();
+  if constexpr (StatsPolicy::enabled)
+    stats_.modifies.add();
+  remove_order(modify_order_id);
+  if (peg != PegType::NONE)
+    submit_order(Order::pegged(side, modify_order_id, peg,
+                               static_cast<std::int32_t>(price), quantity,
+                               account, stp),
+                 trades);
+  else
+    submit_order(Order(side, modify_order_id, price, quantity, type, display,
+                       account, stp),
+                 trades);
+  return true;
 }
 
 /*cancel order, return 0 on successful deletion and -1 on unsuccessful
  * deletion*/
-int Orderbook::cancel_order(OrderID cancel_order_id) {
-  auto it = orders_.find(cancel_order_id);
-  if (it == orders_.end())
-    return -1;
+ORDERBOOK_TEMPLATE
+int ORDERBOOK::cancel_order(OrderID cancel_order_id) {
+  journal_command(CommandType::CANCEL, cancel_order_id, Side::BUY, 0, 0,
+                  orderType::GOODTOCANCEL);
+  return remove_order(cancel_order_id);
+}
 
-  const auto &itr = it->second.itr;
+/*unlink a resting order from its level and the ID index without journaling,
+ * shared by cancel_order() and modify_order()*/
+ORDERBOOK_TEMPLATE
+int ORDERBOOK::remove_order(OrderID cancel_order_id) {
+  ScopedLatency<StatsPolicy::enabled> timer(latency_.cancel_order);
+  order_entry *entry = orders_.find(cancel_order_id);
+  if (entry == nullptr) {
+    /*a stop that has not fired was never published, it just goes*/
+    bool was_stop = !stops_.empty() && stops_.cancel(cancel_order_id);
+    if constexpr (StatsPolicy::enabled) {
+      if (was_stop)
+        stats_.cancels.add();
+      else
+        stats_.cancel_misses.add();
+    }
+    return was_stop ? 0 : -1;
+  }
+
+  cancel_resting(cancel_order_id);
+  if constexpr (StatsPolicy::enabled)
+    stats_.cancels.add();
+  refresh_depth_stats();
+  return 0;
+}
+
+/*the order leaves the ID index first, its handle is copied out of the entry*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::cancel_resting(OrderID id) {
+  auto itr = orders_.find(id)->itr;
   Price price = itr->get_order_price();
   Side side = itr->get_order_side();
+  close_exposure(*itr, itr->get_remaining_quantity() + itr->get_hidden_quantity());
+  unindex_order(id);
+  if (itr->is_pegged()) {
+    auto on_move = [this](OrderID id, typename level_type::handle moved) {
+      orders_.find(id)->itr = moved;
+    };
+    PegType peg = itr->get_peg_type();
+    std::int32_t offset = itr->get_peg_offset();
+    if (side == Side::BUY)
+      peg_bids_.unlink(peg, offset, itr, on_move);
+    else
+      peg_asks_.unlink(peg, offset, itr, on_move);
+  } else {
+    publish_l3(L3EventType::CANCEL, id, side, price,
+               itr->get_remaining_quantity());
+    if (side == Side::BUY)
+      unlink_order(bids_, price, itr);
+    else
+      unlink_order(asks_, price, itr);
+  }
+}
 
-  if (side == Side::BUY) {
-    auto map_it = bids_.find(price);
-    auto &level = map_it->second;
-    level.erase(itr);
-    if (level.empty())
-      bids_.erase(map_it);
+/*cancel everything the owner has in the book, e.g. when its session drops*/
+ORDERBOOK_TEMPLATE
+std::size_t ORDERBOOK::cancel_all_for_owner(AccountID owner) {
+  journal_command(CommandType::CANCEL_OWNER, 0, Side::BUY, 0, 0,
+                  orderType::GOODTOCANCEL, 0, owner);
+  return remove_owner_orders(owner);
+}
+
+/*with owner lists only the owner's own orders are visited, each unlinked from
+ * its level in place. without them the whole index is scanned for them.
+ * pending stops are few, they are always scanned*/
+ORDERBOOK_TEMPLATE
+std::size_t ORDERBOOK::remove_owner_orders(AccountID owner) {
+  std::size_t removed = 0;
+  if constexpr (OwnerPolicy::enabled) {
+    auto head = owner_heads_.find(owner);
+    OrderID id = head == owner_heads_.end() ? 0 : head->second;
+    while (id != 0) {
+      OrderID next = orders_.find(id)->owner_next;
+      cancel_resting(id);
+      id = next;
+      ++removed;
+    }
   } else {
-    auto map_it = asks_.find(price);
+    std::vector<OrderID> ids;
+    orders_.for_each([&ids, owner](OrderID id, const order_entry &entry) {
+      if (entry.itr->get_account() == owner)
+        ids.push_back(id);
+    });
+    for (OrderID id : ids)
+      cancel_resting(id);
+    removed = ids.size();
+  }
+  if (!stops_.empty()) {
+    std::vector<OrderID> ids;
+    stops_.for_each([&ids, owner](Price, const Order &order) {
+      if (order.get_account() == owner)
+        ids.push_back(order.get_order_id());
+    });
+    for (OrderID id : ids)
+      stops_.cancel(id);
+    removed += ids.size();
+  }
+  if constexpr (StatsPolicy::enabled)
+    stats_.cancels.add(removed);
+  refresh_depth_stats();
+  return removed;
+}
+
+/*newest first: the order becomes its owner's head*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::index_order(OrderID id, AccountID owner,
+                            typename level_type::handle itr) {
+  if constexpr (OwnerPolicy::enabled) {
+    OrderID &head = owner_heads_[owner];
+    orders_.insert(id, order_entry{itr, 0, head});
+    if (head != 0)
+      orders_.find(head)->owner_prev = id;
+    head = id;
+  } else {
+    (void)owner;
+    orders_.insert(id, order_entry{itr});
+  }
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::unindex_order(OrderID id) {
+  if constexpr (OwnerPolicy::enabled) {
+    order_entry *entry = orders_.find(id);
+    OrderID prev = entry->owner_prev;
+    OrderID next = entry->owner_next;
+    if (prev != 0)
+      orders_.find(prev)->owner_next = next;
+    else if (next != 0)
+      owner_heads_[entry->itr->get_account()] = next;
+    else
+      owner_heads_.erase(entry->itr->get_account());
+    if (next != 0)
+      orders_.find(next)->owner_prev = prev;
+  }
+  orders_.erase(id);
+}
+
+/*drop the level once it is empty, otherwise give it the chance to repack.
+ * compaction moves orders, so their index entries follow*/
+ORDERBOOK_TEMPLATE
+template <typename SideMap>
+void ORDERBOOK::unlink_order(SideMap &side_map, Price price,
+                             typename level_type::handle itr) {
+  auto map_it = side_map.find(price);
+  auto &level = map_it->second;
+  level.erase(itr);
+  if (level.empty()) {
+    side_map.erase(map_it);
+  } else if (level.needs_compaction()) {
+    level.compact([this](OrderID id, typename level_type::handle moved) {
+      orders_.find(id)->itr = moved;
+    });
+  }
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::attach_l3_feed(L3Feed *feed) { l3_feed_ = feed; }
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::attach_logger(logger_type *logger) { logger_ = logger; }
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::attach_risk(PreTradeRisk *risk) {
+  if (risk != risk_)
+    move_exposure(risk_, risk);
+  risk_ = risk;
+}
+
+/*runs before the command is journaled, so a refused order never reaches the
+ * journal and replay needs no risk object. the band is around the last
+ * trade*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::passes_risk(OrderID id, AccountID account, Side side,
+                            Price price, Quantity quantity,
+                            std::uint64_t replaced_quantity,
+                            std::uint64_t replaced_notional) {
+  if (risk_ == nullptr ||
+      risk_->check(account, price, quantity, last_trade_price_,
+                   replaced_quantity, replaced_notional) == RiskReject::NONE)
+    return true;
+  if constexpr (StatsPolicy::enabled)
+    stats_.risk_rejects.add();
+  publish_l3(L3EventType::REJECT, id, side, price, quantity);
+  return false;
+}
+
+/*the whole order, reserve included, counts from when it enters the book*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::open_exposure(const Order &order) {
+  if (risk_ != nullptr)
+    risk_->open(order.get_account(), risk_price(order),
+                order.get_remaining_quantity() + order.get_hidden_quantity());
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::close_exposure(const Order &order, Quantity quantity) {
+  if (risk_ != nullptr)
+    risk_->close(order.get_account(), risk_price(order), quantity);
+}
+
+/*every resting order's open quantity leaves one risk object and enters the
+ * other, either can be null. stops hold no exposure until they fire*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::move_exposure(PreTradeRisk *from, PreTradeRisk *to) {
+  if (from == nullptr && to == nullptr)
+    return;
+  orders_.for_each([from, to](OrderID, const order_entry &entry) {
+    const Order &order = *entry.itr;
+    Quantity open =
+        order.get_remaining_quantity() + order.get_hidden_quantity();
+    if (from != nullptr)
+      from->close(order.get_account(), risk_price(order), open);
+    if (to != nullptr)
+      to->open(order.get_account(), risk_price(order), open);
+  });
+}
+
+/*depth gauges are cheap to read off the containers, refresh them once per
+ * command instead of tracking every level change*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::refresh_depth_stats() {
+  if constexpr (StatsPolicy::enabled) {
+    stats_.resting_orders.set(orders_.size());
+    stats_.bid_levels.set(bids_.size());
+    stats_.ask_levels.set(asks_.size());
+  }
+}
+
+ORDERBOOK_TEMPLATE
+[[nodiscard]] EngineStatsSnapshot ORDERBOOK::snapshot_stats() const {
+  if constexpr (StatsPolicy::enabled)
+    return EngineStatsSnapshot::take(
+        stats_,
+        logger_ != nullptr ? logger_->get_queue_stats() : QueueStats::none(),
+        LatencyClock::ns_per_tick());
+  else
+    return EngineStatsSnapshot{};
+}
+
+/*stamp the next sequence number and hand the record to the feed, no-op when
+ * nothing is attached. a dropped record keeps its number, so the gap tells
+ * the consumer it has to rebuild*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::publish_l3(L3EventType type, OrderID id, Side side,
+                           Price price, Quantity quantity) {
+  if (l3_feed_ == nullptr)
+    return;
+  L3Event event{};
+  event.seq = ++l3_seq_;
+  event.id = id;
+  event.price = price;
+  event.quantity = quantity;
+  event.type = type;
+  event.side = static_cast<std::uint8_t>(side);
+  if (!l3_feed_->publish(event)) {
+    if constexpr (StatsPolicy::enabled)
+      stats_.l3_overflows.add();
+  }
+}
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::attach_journal(CommandJournal *journal) { journal_ = journal; }
+
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::journal_command(CommandType type, OrderID id, Side side,
+                                Price price, Quantity quantity,
+                                orderType order_type, std::uint32_t extra,
+                                AccountID account, StpMode stp) {
+  if (replaying_)
+    return;
+  ++command_seq_;
+  if (journal_ == nullptr)
+    return;
+  /*zeroed whole, the union's unused bytes and the padding go to disk as 0*/
+  JournalRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.tick = last_sim_tick;
+  record.id = id;
+  record.price = price;
+  record.quantity = quantity;
+  record.type = type;
+  record.side = static_cast<std::uint8_t>(side);
+  record.order_type = static_cast<std::uint8_t>(order_type);
+  record.account = account;
+  record.stp_mode = static_cast<std::uint8_t>(stp);
+  if (type == CommandType::ADD_STOP)
+    record.trigger_price = extra;
+  else if (type == CommandType::ADD_PEG)
+    record.peg_type = static_cast<std::uint8_t>(extra);
+  else
+    record.display_quantity = extra;
+  journal_->append(record);
+}
+
+/*IDs come from the record instead of gen_order_id() so a replayed book is
+ * identical to the one that wrote the record. a record failing
+ * valid_command() still takes its place in the sequence but does nothing*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] Trades ORDERBOOK::apply_command(const JournalRecord &record) {
+  ++command_seq_;
+  last_sim_tick = record.tick;
+  Trades trades;
+  if (valid_command(record))
+    (void)execute(record, trades);
+  return trades;
+}
+
+/*the command's effect on the book, trades are appended. false if it found
+ * nothing to act on: an add under an ID in use, a cancel or modify of an
+ * order that is not there*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::execute(const JournalRecord &record, Trades &trades) {
+  if ((record.type == CommandType::ADD || record.type == CommandType::ADD_STOP ||
+       record.type == CommandType::ADD_PEG) &&
+      !id_available(record.id))
+    return false;
+  switch (record.type) {
+  case CommandType::ADD:
+    if (record.id > next_order_id_)
+      next_order_id_ = record.id;
+    submit_order(Order(static_cast<Side>(record.side), record.id, record.price,
+                       record.quantity,
+                       static_cast<orderType>(record.order_type),
+                       record.display_quantity, record.account,
+                       static_cast<StpMode>(record.stp_mode)),
+                 trades);
+    break;
+  case CommandType::ADD_STOP:
+    if (record.id > next_order_id_)
+      next_order_id_ = record.id;
+    add_stop_ptr(record.trigger_price,
+                 Order(static_cast<Side>(record.side), record.id, record.price,
+                       record.quantity,
+                       static_cast<orderType>(record.order_type), 0,
+                       record.account, static_cast<StpMode>(record.stp_mode)),
+                 trades);
+    break;
+  case CommandType::ADD_PEG:
+    if (record.id > next_order_id_)
+      next_order_id_ = record.id;
+    submit_order(Order::pegged(static_cast<Side>(record.side), record.id,
+                               static_cast<PegType>(record.peg_type),
+                               static_cast<std::int32_t>(record.price),
+                               record.quantity, record.account,
+                               static_cast<StpMode>(record.stp_mode)),
+                 trades);
+    break;
+  case CommandType::CANCEL:
+    return remove_order(record.id) == 0;
+  case CommandType::CANCEL_OWNER:
+    remove_owner_orders(record.account);
+    break;
+  case CommandType::AUCTION_START:
+    in_auction_ = true;
+    break;
+  case CommandType::UNCROSS:
+    uncross_book(trades);
+    break;
+  case CommandType::MODIFY:
+    return replace_order(record.id, record.price, record.quantity, trades);
+  }
+  return true;
+}
+
+/*commands run one after another exactly as through the single-call API,
+ * what a batch saves is around them: every trade goes into the sink's one
+ * buffer, the logger gets the whole batch in one publish, and the memory
+ * upcoming commands will touch is fetched while earlier ones run.
+ *
+ * a cancel is a chain of dependent misses: index slot, order, level. with
+ * distance d the chain is pipelined over the batch, one link per stage:
+ *
+ *   i + 2d     prefetch the index slot (an add: its level)
+ *   i + d      read the slot, prefetch the order
+ *   i + d / 2  read the order, prefetch its level (ladder storage only)
+ *
+ * so by the time command i runs its misses have been in flight for several
+ * commands, overlapping each other instead of one after another. the later
+ * stages read the index, which only pays off when the index slot could be
+ * prefetched: with a hash index only adds are prefetched*/
+ORDERBOOK_TEMPLATE
+std::size_t ORDERBOOK::apply_batch(const JournalRecord *commands,
+                                   std::size_t count, TradeSink &sink) {
+  sink.clear();
+  sink.ends.reserve(count);
+  batching_ = true;
+  std::size_t applied = 0;
+  constexpr bool follow_index = IndexPolicy<order_entry>::prefetchable;
+  const std::size_t d = prefetch_distance_;
+  const std::size_t half = d > 1 ? d / 2 : d;
+  if (d != 0) {
+    for (std::size_t i = 0; i < std::min(2 * d, count); ++i)
+      prefetch_command(commands[i]);
+    if constexpr (follow_index)
+      for (std::size_t i = 0; i < std::min(d, count); ++i)
+        prefetch_order(commands[i]);
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    if (d != 0) {
+      if (i + 2 * d < count)
+        prefetch_command(commands[i + 2 * d]);
+      if constexpr (follow_index) {
+        if (i + d < count)
+          prefetch_order(commands[i + d]);
+        if constexpr (StoragePolicy::direct_levels)
+          if (i + half < count)
+            prefetch_order_level(commands[i + half]);
+      }
+    }
+    if (submit_command(commands[i], sink.trades))
+      ++applied;
+    sink.ends.push_back(sink.trades.size());
+  }
+  batching_ = false;
+
+  if (LoggerPolicy::enabled && logger_ != nullptr && !sink.trades.empty()) {
+    std::size_t command = 0;
+    logger_->log_Trades(sink.trades.size(), [&](LogEntry &entry,
+                                                std::size_t i) {
+      while (sink.ends[command] <= i)
+        ++command;
+      const Trade &trade = sink.trades[i];
+      entry.tick = commands[command].tick;
+      entry.id1 = trade.get_bid_info().orderID_;
+      entry.id2 = trade.get_ask_info().orderID_;
+      entry.price = trade.get_ask_info().price_;
+      entry.quantity = trade.get_ask_info().quantity_;
+    });
+  }
+  return applied;
+}
+
+/*what the matching add_*, cancel_* or modify_order() call would do: an add
+ * with ID 0 is given the book's next ID, checked against risk and journaled
+ * before it runs. false if the command was refused or found nothing to act
+ * on*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::submit_command(JournalRecord command, Trades &trades) {
+  last_sim_tick = command.tick;
+  if (!valid_command(command))
+    return false;
+  Side side = static_cast<Side>(command.side);
+  std::uint32_t extra = 0;
+  switch (command.type) {
+  case CommandType::ADD:
+  case CommandType::ADD_STOP:
+  case CommandType::ADD_PEG:
+    if (command.id == 0)
+      command.id = gen_order_id();
+    else if (!id_available(command.id))
+      return false;
+    if (!passes_risk(command.id, command.account, side,
+                     command.type == CommandType::ADD_PEG ||
+                             (command.type == CommandType::ADD_STOP &&
+                              static_cast<orderType>(command.order_type) ==
+                                  orderType::MARKET)
+                         ? 0
+                         : command.price,
+                     command.quantity))
+      return false;
+    extra = command.type == CommandType::ADD ? command.display_quantity
+            : command.type == CommandType::ADD_STOP
+                ? command.trigger_price
+                : command.peg_type;
+    break;
+  case CommandType::MODIFY: {
+    order_entry *entry = orders_.find(command.id);
+    if (entry == nullptr ||
+        !passes_modify_risk(command.id, *entry->itr, command.price,
+                            command.quantity))
+      return false;
+    side = entry->itr->get_order_side();
+    command.order_type =
+        static_cast<std::uint8_t>(entry->itr->get_order_type());
+    break;
+  }
+  default:
+    break;
+  }
+  journal_command(command.type, command.id, side, command.price,
+                  command.quantity,
+                  static_cast<orderType>(command.order_type), extra,
+                  command.account, static_cast<StpMode>(command.stp_mode));
+  return execute(command, trades);
+}
+
+/*a record's enum bytes are cast straight back, an out of range one would
+ * index past the per-type stats or reach a switch with no case for it. a
+ * peg needs one of the two kinds and has no order type of its own. only
+ * the adds read these fields*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::valid_command(const JournalRecord &record) {
+  switch (record.type) {
+  case CommandType::ADD:
+  case CommandType::ADD_STOP:
+  case CommandType::ADD_PEG:
+    break;
+  case CommandType::CANCEL:
+  case CommandType::MODIFY:
+  case CommandType::AUCTION_START:
+  case CommandType::UNCROSS:
+  case CommandType::CANCEL_OWNER:
+    return true;
+  default:
+    return false;
+  }
+  if (record.side > Side::SELL ||
+      record.stp_mode > static_cast<std::uint8_t>(StpMode::DECREMENT))
+    return false;
+  if (record.type != CommandType::ADD_PEG)
+    return record.order_type <= orderType::LIMIT;
+  return record.peg_type == static_cast<std::uint8_t>(PegType::PRIMARY) ||
+         record.peg_type == static_cast<std::uint8_t>(PegType::MIDPOINT);
+}
+
+/*an ID from outside the book must not collide with a resting or pending
+ * order, the index would keep the old entry and lose the new order*/
+ORDERBOOK_TEMPLATE
+bool ORDERBOOK::id_available(OrderID id) {
+  return id != 0 && orders_.accepts(id) && orders_.find(id) == nullptr &&
+         !stops_.contains(id);
+}
+
+/*first stage: an add's level is known from its price, a cancel or modify
+ * needs its index entry first. hints only, nothing is looked up*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::prefetch_command(const JournalRecord &command) const {
+  switch (command.type) {
+  case CommandType::ADD:
+    if (static_cast<Side>(command.side) == Side::BUY)
+      prefetch_level(bids_, command.price);
+    else
+      prefetch_level(asks_, command.price);
+    break;
+  case CommandType::CANCEL:
+  case CommandType::MODIFY:
+    orders_.prefetch(command.id);
+    break;
+  default:
+    break;
+  }
+}
+
+/*second stage: the index slot has arrived, the order it points to is next*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::prefetch_order(const JournalRecord &command) {
+  if (command.type != CommandType::CANCEL &&
+      command.type != CommandType::MODIFY)
+    return;
+  if (const order_entry *entry = orders_.find(command.id))
+    level_type::prefetch(entry->itr);
+}
+
+/*last stage: the order has arrived, its level is next. pegs live in
+ * buckets, not levels*/
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::prefetch_order_level(const JournalRecord &command) {
+  if (command.type != CommandType::CANCEL &&
+      command.type != CommandType::MODIFY)
+    return;
+  const order_entry *entry = orders_.find(command.id);
+  if (entry == nullptr || entry->itr->is_pegged())
+    return;
+  if (entry->itr->get_order_side() == Side::BUY)
+    prefetch_level(bids_, entry->itr->get_order_price());
+  else
+    prefetch_level(asks_, entry->itr->get_order_price());
+}
+
+/*replay recorded commands into this book as fast as possible*/
+ORDERBOOK_TEMPLATE
+std::size_t ORDERBOOK::replay_journal(const std::vector<JournalRecord> &records,
+                                     std::size_t first_record) {
+  if (first_record >= records.size())
+    return 0;
+  /*a corrupt record is found before any is applied, not halfway through*/
+  if (!std::all_of(records.begin() + first_record, records.end(),
+                   valid_command))
+    return 0;
+  replaying_ = true;
+  for (std::size_t i = first_record; i < records.size(); ++i)
+    (void)apply_command(records[i]);
+  replaying_ = false;
+  return records.size() - first_record;
+}
+
+ORDERBOOK_TEMPLATE
+int ORDERBOOK::recover_from_journal(const std::string &journal_location) {
+  std::vector<JournalRecord> records;
+  if (!CommandJournal::load(journal_location, records))
+    return -1;
+  if (command_seq_ < records.size() &&
+      replay_journal(records, command_seq_) == 0)
+    return -1;
+  return 0;
+}
+
+/*single pass over both sides into flat arrays, no I/O. the pause is one
+ * sequential copy of the resting orders, writing the result to disk with
+ * BookSnapshot::save() can happen on another thread afterwards. records are
+ * zeroed before they are filled, so their padding goes to disk as 0*/
+ORDERBOOK_TEMPLATE
+[[nodiscard]] BookSnapshot ORDERBOOK::take_snapshot() const {
+  BookSnapshot snapshot;
+  auto &header = snapshot.header;
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.next_order_id = next_order_id_;
+  header.last_sim_tick = last_sim_tick;
+  header.command_seq = command_seq_;
+  header.bid_levels = bids_.size();
+  header.ask_levels = asks_.size();
+  header.stop_count = stops_.size();
+  header.last_trade_price = last_trade_price_;
+  header.flags = in_auction_ ? SNAPSHOT_IN_AUCTION : 0;
+
+  auto zeroed = [](auto &records) -> auto & {
+    auto &record = records.emplace_back();
+    std::memset(&record, 0, sizeof(record));
+    return record;
+  };
+  snapshot.levels.reserve(bids_.size() + asks_.size());
+  snapshot.orders.reserve(orders_.size());
+  auto copy_side = [&snapshot, &zeroed](const auto &side_map) {
+    for (const auto &[price, level_orders] : side_map) {
+      SnapshotLevel &level = zeroed(snapshot.levels);
+      level.price = price;
+      level.order_count = static_cast<std::uint32_t>(level_orders.size());
+      for (const auto &order : level_orders) {
+        SnapshotOrder &entry = zeroed(snapshot.orders);
+        entry.id = order.get_order_id();
+        entry.init_quantity = order.get_init_quantity();
+        entry.remain_quantity = order.get_remaining_quantity();
+        entry.display_quantity = order.get_display_quantity();
+        entry.hidden_quantity = order.get_hidden_quantity();
+        entry.account = order.get_account();
+        entry.order_type = static_cast<std::uint8_t>(order.get_order_type());
+        entry.stp_mode = static_cast<std::uint8_t>(order.get_stp_mode());
+      }
+    }
+  };
+  copy_side(bids_);
+  copy_side(asks_);
+  auto copy_peg = [&snapshot, &zeroed](const Order &order) {
+    SnapshotPeg &entry = zeroed(snapshot.pegs);
+    entry.id = order.get_order_id();
+    entry.offset = order.get_peg_offset();
+    entry.init_quantity = order.get_init_quantity();
+    entry.remain_quantity = order.get_remaining_quantity();
+    entry.account = order.get_account();
+    entry.side = static_cast<std::uint8_t>(order.get_order_side());
+    entry.peg_type = static_cast<std::uint8_t>(order.get_peg_type());
+    entry.stp_mode = static_cast<std::uint8_t>(order.get_stp_mode());
+  };
+  peg_bids_.for_each(copy_peg);
+  peg_asks_.for_each(copy_peg);
+  header.order_count = snapshot.orders.size();
+  header.peg_count = snapshot.pegs.size();
+  snapshot.stops.reserve(stops_.size());
+  stops_.for_each([&snapshot, &zeroed](Price trigger_price, const Order &order) {
+    SnapshotStop &entry = zeroed(snapshot.stops);
+    entry.id = order.get_order_id();
+    entry.trigger_price = trigger_price;
+    entry.price = order.get_order_price();
+    entry.quantity = order.get_remaining_quantity();
+    entry.account = order.get_account();
+    entry.side = static_cast<std::uint8_t>(order.get_order_side());
+    entry.order_type = static_cast<std::uint8_t>(order.get_order_type());
+    entry.stp_mode = static_cast<std::uint8_t>(order.get_stp_mode());
+  });
+  return snapshot;
+}
+
+/*bulk load: levels arrive already sorted so every map insert is hinted at the
+ * end, and orders are appended straight to their level without matching*/
+ORDERBOOK_TEMPLATE
+template <typename SideMap>
+void ORDERBOOK::restore_side(SideMap &side_map, Side side,
+                             const BookSnapshot &snapshot,
+                             std::size_t first_level, std::size_t level_count,
+                             std::size_t &next_order) {
+  for (std::size_t i = first_level; i < first_level + level_count; ++i) {
+    const auto &snapshot_level = snapshot.levels[i];
+    auto map_it =
+        side_map.emplace_hint(side_map.end(), snapshot_level.price,
+                              level_type(&node_pool_));
     auto &level = map_it->second;
-    level.erase(itr);
-    if (level.empty())
-      asks_.erase(map_it);
+    for (std::uint32_t k = 0; k < snapshot_level.order_count; ++k) {
+      const auto &snapshot_order = snapshot.orders[next_order++];
+      Order order(side, snapshot_order.id, snapshot_level.price,
+                  snapshot_order.init_quantity,
+                  static_cast<orderType>(snapshot_order.order_type),
+                  snapshot_order.display_quantity, snapshot_order.account,
+                  static_cast<StpMode>(snapshot_order.stp_mode));
+      /*before push_back, so the level total starts from the shown quantity*/
+      order.restore(snapshot_order.remain_quantity,
+                    snapshot_order.hidden_quantity);
+      auto it = level.push_back(order);
+      index_order(snapshot_order.id, snapshot_order.account, it);
+    }
   }
+}
 
-  orders_.erase(cancel_order_id);
+ORDERBOOK_TEMPLATE
+int ORDERBOOK::restore_snapshot(const BookSnapshot &snapshot) {
+  const auto &header = snapshot.header;
+  if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+      snapshot.levels.size() != header.bid_levels + header.ask_levels ||
+      snapshot.orders.size() != header.order_count ||
+      snapshot.pegs.size() != header.peg_count ||
+      snapshot.stops.size() != header.stop_count ||
+      header.bid_levels > snapshot.levels.size())
+    return -1;
+  /*levels strictly in priority order and never empty, the sides apart
+   * unless the book was taken mid-auction*/
+  auto in_priority = [&snapshot](std::size_t first, std::size_t count,
+                                 auto better) {
+    for (std::size_t i = first; i < first + count; ++i)
+      if (snapshot.levels[i].order_count == 0 ||
+          (i > first &&
+           !better(snapshot.levels[i - 1].price, snapshot.levels[i].price)))
+        return false;
+    return true;
+  };
+  if (!in_priority(0, header.bid_levels, std::greater<Price>()) ||
+      !in_priority(header.bid_levels, header.ask_levels, std::less<Price>()))
+    return -1;
+  if ((header.flags & SNAPSHOT_IN_AUCTION) == 0 && header.bid_levels != 0 &&
+      header.ask_levels != 0 &&
+      snapshot.levels[0].price >= snapshot.levels[header.bid_levels].price)
+    return -1;
+  /*the index keeps the first entry under an ID, a second order would rest
+   * where nothing can find it*/
+  std::vector<OrderID> ids;
+  ids.reserve(snapshot.orders.size() + snapshot.pegs.size() +
+              snapshot.stops.size());
+  for (const auto &snapshot_order : snapshot.orders)
+    ids.push_back(snapshot_order.id);
+  for (const auto &peg : snapshot.pegs)
+    ids.push_back(peg.id);
+  for (const auto &stop : snapshot.stops)
+    ids.push_back(stop.id);
+  std::sort(ids.begin(), ids.end());
+  if ((!ids.empty() && ids.front() == 0) ||
+      std::adjacent_find(ids.begin(), ids.end()) != ids.end())
+    return -1;
+  /*the index must take every ID the way a live add would, and the next ID
+   * handed out must be past all of them or it lands on a restored order*/
+  OrderID highest = 0;
+  for (OrderID id : ids) {
+    if (!IndexPolicy<order_entry>::accepts_after(highest, id))
+      return -1;
+    highest = id;
+  }
+  if (header.next_order_id < highest)
+    return -1;
+  std::uint64_t counted = 0;
+  for (const auto &snapshot_level : snapshot.levels)
+    counted += snapshot_level.order_count;
+  if (counted != header.order_count)
+    return -1;
+  /*enum bytes are cast straight back, so out of range values are refused,
+   * and nothing rests or waits with no quantity left*/
+  auto valid_side = [](std::uint8_t side) { return side <= Side::SELL; };
+  auto valid_type = [](std::uint8_t type) { return type <= orderType::LIMIT; };
+  auto valid_stp = [](std::uint8_t stp) {
+    return stp <= static_cast<std::uint8_t>(StpMode::DECREMENT);
+  };
+  for (const auto &snapshot_order : snapshot.orders)
+    if (snapshot_order.remain_quantity == 0 ||
+        std::uint64_t(snapshot_order.remain_quantity) +
+                snapshot_order.hidden_quantity >
+            snapshot_order.init_quantity ||
+        !valid_type(snapshot_order.order_type) ||
+        !valid_stp(snapshot_order.stp_mode))
+      return -1;
+  for (const auto &peg : snapshot.pegs)
+    if (peg.remain_quantity == 0 || peg.remain_quantity > peg.init_quantity ||
+        (peg.peg_type != static_cast<std::uint8_t>(PegType::PRIMARY) &&
+         peg.peg_type != static_cast<std::uint8_t>(PegType::MIDPOINT)) ||
+        !valid_side(peg.side) || !valid_stp(peg.stp_mode))
+      return -1;
+  for (const auto &stop : snapshot.stops)
+    if (stop.quantity == 0 || !valid_side(stop.side) ||
+        !valid_type(stop.order_type) || !valid_stp(stop.stp_mode))
+      return -1;
+
+  /*the replaced orders' exposure goes, the restored ones' comes back below*/
+  move_exposure(risk_, nullptr);
+  bids_.clear();
+  asks_.clear();
+  peg_bids_.clear();
+  peg_asks_.clear();
+  orders_.clear();
+  orders_.reserve(header.order_count + header.peg_count);
+  if constexpr (OwnerPolicy::enabled)
+    owner_heads_.clear();
+  stops_.clear();
+  for (const auto &stop : snapshot.stops)
+    stops_.add(stop.trigger_price,
+               Order(static_cast<Side>(stop.side), stop.id, stop.price,
+                     stop.quantity, static_cast<orderType>(stop.order_type), 0,
+                     stop.account, static_cast<StpMode>(stop.stp_mode)));
+  last_trade_price_ = header.last_trade_price;
+  in_auction_ = (header.flags & SNAPSHOT_IN_AUCTION) != 0;
+
+  std::size_t next_order = 0;
+  restore_side(bids_, Side::BUY, snapshot, 0, header.bid_levels, next_order);
+  restore_side(asks_, Side::SELL, snapshot, header.bid_levels,
+               header.ask_levels, next_order);
+  /*buckets come back in the order they were written, FIFO within each*/
+  for (const auto &peg : snapshot.pegs) {
+    Order order = Order::pegged(static_cast<Side>(peg.side), peg.id,
+                                static_cast<PegType>(peg.peg_type), peg.offset,
+                                peg.init_quantity, peg.account,
+                                static_cast<StpMode>(peg.stp_mode));
+    order.restore(peg.remain_quantity, 0);
+    rest_pegged(order);
+  }
+  move_exposure(nullptr, risk_);
+
+  next_order_id_ = header.next_order_id;
+  last_sim_tick = header.last_sim_tick;
+  command_seq_ = header.command_seq;
   return 0;
 }
 
 /*delete all orders*/
-void Orderbook::flush_orderbook() {
-  Logger.log_message("Flushing orderbook", last_sim_tick);
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::flush_orderbook() {
+  if (LoggerPolicy::enabled && logger_ != nullptr)
+    logger_->log_message("Flushing orderbook", last_sim_tick);
   std::vector<OrderID> ids;
-  ids.reserve(orders_.size());
-  for (const auto &[id, _] : orders_) {
-    ids.push_back(id);
-  }
+  ids.reserve(orders_.size() + stops_.size());
+  orders_.for_each(
+      [&ids](OrderID id, const order_entry &) { ids.push_back(id); });
+  stops_.for_each(
+      [&ids](Price, const Order &order) { ids.push_back(order.get_order_id()); });
   for (auto id : ids) {
     cancel_order(id);
   }
 }
 
-std::size_t Orderbook::get_size() { return orders_.size(); }
+ORDERBOOK_TEMPLATE
+std::size_t ORDERBOOK::get_size() { return orders_.size(); }
 
-/*accumulate total quantity of price level from specified side of the
- * orderbook*/
-Quantity Orderbook::get_level_quantity(const order_list &orderbook_side) {
-  Quantity side_total_quantity = 0;
-  for (const auto &order : orderbook_side) {
-    side_total_quantity +=
-        order.get_remaining_quantity(); /*sum the quantity from every order on
-                                           the price level*/
-  }
-  return side_total_quantity;
+/*levels keep their own running total*/
+ORDERBOOK_TEMPLATE
+Quantity ORDERBOOK::get_level_quantity(const level_type &orderbook_side) {
+  return static_cast<Quantity>(orderbook_side.get_quantity());
 }
 
-[[nodiscard]] OrderbookLevelInfos Orderbook::get_levelInfos() {
+ORDERBOOK_TEMPLATE
+[[nodiscard]] OrderbookLevelInfos ORDERBOOK::get_levelInfos() {
   levelInfos bidInfos, askInfos;
   bidInfos.reserve(orders_.size());
   askInfos.reserve(orders_.size());
@@ -267,7 +1970,8 @@ Quantity Orderbook::get_level_quantity(const order_list &orderbook_side) {
 }
 
 /*print levels of the orderbook*/
-void Orderbook::print_levels() {
+ORDERBOOK_TEMPLATE
+void ORDERBOOK::print_levels() {
   OrderbookLevelInfos orderbook_level_infos = get_levelInfos();
 
   const levelInfos &bids = orderbook_level_infos.get_bids();
@@ -285,4 +1989,23 @@ void Orderbook::print_levels() {
                 << " | Quantity: " << level.quantity << std::endl;
     }
   }
-}
\ No newline at end of file
+}
+
+/*configurations available to callers, add a line here for a new combination*/
+template class BasicOrderbook<TextLogging, MapListStorage, HashIndex,
+                              FullStats>;
+template class BasicOrderbook<BinaryLogging, MapListStorage, HashIndex,
+                              FullStats>;
+template class BasicOrderbook<NoLogging, MapListStorage, HashIndex, FullStats>;
+template class BasicOrderbook<NoLogging, MapListStorage, DenseIndex, NoStats>;
+template class BasicOrderbook<TextLogging, MapRingStorage, HashIndex, FullStats>;
+template class BasicOrderbook<NoLogging, MapRingStorage, DenseIndex, NoStats>;
+template class BasicOrderbook<TextLogging, LadderStorage<>, HashIndex,
+                              FullStats>;
+template class BasicOrderbook<NoLogging, LadderStorage<>, DenseIndex, NoStats>;
+template class BasicOrderbook<NoLogging, MapListStorage, HashIndex, FullStats,
+                              ProRataAllocation>;
+template class BasicOrderbook<NoLogging, MapListStorage, HashIndex, FullStats,
+                              TopOrderProRataAllocation>;
+template class BasicOrderbook<NoLogging, MapListStorage, HashIndex, FullStats,
+                              FifoAllocation, OwnerLists>;
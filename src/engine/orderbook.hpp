@@ -1,19 +1,24 @@
 #ifndef YINHE_SRC_ENGINE_ORDERBOOK_H
 #define YINHE_SRC_ENGINE_ORDERBOOK_H
 
+#include "auction.hpp"
+#include "bookSnapshot.hpp"
+#include "commandJournal.hpp"
+#include "depthScan.hpp"
+#include "engineStats.hpp"
+#include "l3Feed.hpp"
+#include "latencyHistogram.hpp"
 #include "levelInfo.hpp"
 #include "order.hpp"
 #include "orderLog.hpp"
+#include "orderbookPolicies.hpp"
+#include "pegBook.hpp"
+#include "preTradeRisk.hpp"
 #include "tradeUtils/trade.hpp"
-#include <map>
+#include "triggerBook.hpp"
+#include <functional>
 #include <string>
-
-constexpr bool ENABLE_LOGGER = true;
-constexpr bool CLEAR_LOGS_ON_INIT = true;
-
-struct orderEntry {
-  order_list::iterator itr;
-};
+#include <vector>
 
 using levelInfos = std::vector<levelInfo>;
 
@@ -29,51 +34,390 @@ private:
   levelInfos asks_;
 };
 
-class Orderbook {
+/*configured by policy, see orderbookPolicies.hpp. member definitions live in
+ * orderbook.cpp and are explicitly instantiated for the configurations
+ * declared at the bottom of this file*/
+template <typename LoggerPolicy, typename StoragePolicy,
+          template <typename> class IndexPolicy, typename StatsPolicy,
+          typename AllocationPolicy = FifoAllocation,
+          typename OwnerPolicy = NoOwnerLists>
+class BasicOrderbook {
 public:
-  Orderbook();
-  Orderbook(std::string logfile_location);
+  using latency_type = typename StatsPolicy::latency_type;
+  using logger_type = typename LoggerPolicy::logger_type;
+  using level_type = typename StoragePolicy::level_type;
+  using order_entry = orderEntry<level_type, OwnerPolicy::enabled>;
+
+  BasicOrderbook();
   [[nodiscard]] std::size_t get_size();
   void print_levels();                       /*print levels of the orderbook*/
   int cancel_order(OrderID cancel_order_id); /*returns 0 on successful deletion,
-                                                -1 if not found*/
+                                                -1 if not found. pending stops
+                                                cancel too*/
+  std::size_t cancel_all_for_owner(
+      AccountID owner); /*cancel every resting order and stop of the owner
+                           (its account), one journal record. returns how
+                           many went. without OwnerLists this scans every
+                           resting order*/
   [[nodiscard]] Order get_order(OrderID get_order_id);
   [[nodiscard]] Trades
-  add_order(Side side, Price price, Quantity quantity,
-            orderType type); /*generates order and calls
-                                                    internal add_order_ptr*/
+  add_order(Side side, Price price, Quantity quantity, orderType type,
+            AccountID account = 0,
+            StpMode stp = StpMode::NONE); /*generates order and calls
+                                             internal add_order_ptr*/
+  [[nodiscard]] Trades
+  add_iceberg_order(Side side, Price price, Quantity quantity,
+                    Quantity display_quantity, AccountID account = 0,
+                    StpMode stp = StpMode::NONE); /*rests showing at most
+                                               display_quantity, refilled
+                                               from the rest as it trades*/
+  [[nodiscard]] Trades
+  add_stop_order(Side side, Price trigger_price, Price price,
+                 Quantity quantity, orderType type, AccountID account = 0,
+                 StpMode stp = StpMode::NONE); /*held until a trade prints at or through
+                                     trigger_price, then added as a type
+                                     order at price. a MARKET stop ignores
+                                     price and takes the best opposite
+                                     price when it fires*/
+  [[nodiscard]] std::size_t get_stop_count() const { return stops_.size(); }
+  [[nodiscard]] Trades
+  add_pegged_order(Side side, PegType peg, std::int32_t offset,
+                   Quantity quantity, AccountID account = 0,
+                   StpMode stp = StpMode::NONE); /*good till cancel at the peg's
+                                          reference plus offset, repriced as
+                                          the BBO moves. not shown in the
+                                          levels or the L3 feed*/
+  void start_auction(); /*orders rest without matching until uncross(), FOK
+                          orders are rejected*/
+  [[nodiscard]] Trades uncross(); /*trade the crossed part of the book at its
+                                     equilibrium price and go back to
+                                     continuous matching*/
+  [[nodiscard]] bool in_auction() const { return in_auction_; }
+  [[nodiscard]] auction::Uncross
+  get_indicative_uncross() const; /*price and volume uncross() would trade
+                                     at now*/
+  [[nodiscard]] Trades
+  modify_order(OrderID modify_order_id, Price price,
+               Quantity quantity); /*cancel/replace keeping the order ID, the
+                                      order loses time priority. price is the
+                                      new offset for a pegged order*/
+  void attach_l3_feed(L3Feed *feed); /*publish order-level events to feed,
+                                        nullptr to stop publishing. events
+                                        that find it full are dropped*/
+  void attach_journal(CommandJournal *journal); /*record every input command,
+                                                   nullptr to stop recording*/
+  void attach_logger(logger_type *logger); /*log trades to an already opened
+                                              logger, nullptr to stop
+                                              logging*/
+  void attach_risk(PreTradeRisk *risk); /*check new orders and modifies
+                                           against risk and keep its exposure,
+                                           nullptr to stop checking. orders
+                                           already resting move their
+                                           exposure to the new risk object*/
+  void set_sim_tick(SimTick tick) { last_sim_tick = tick; }
+  const latency_type &get_latency() const { return latency_; }
+  [[nodiscard]] EngineStatsSnapshot
+  snapshot_stats() const; /*safe to call from a monitoring thread*/
+  [[nodiscard]] Trades
+  apply_command(const JournalRecord &record); /*apply one recorded command
+                                                 under its recorded ID and
+                                                 tick, never journaled. one
+                                                 with an out of range enum
+                                                 byte does nothing*/
+  std::size_t apply_batch(
+      const JournalRecord *commands, std::size_t count,
+      TradeSink &sink); /*run count commands as through the single-call API,
+                           an ADD with ID 0 takes the book's next ID. the
+                           sink is cleared and gets every trade, in command
+                           order. returns commands applied, not counting
+                           those refused for a bad enum byte, by risk or for
+                           a live ID, or cancelling or modifying an unknown
+                           ID*/
+  void set_prefetch_distance(std::size_t distance) {
+    prefetch_distance_ = distance;
+  } /*how many commands ahead apply_batch() starts fetching, 0 for none.
+       defaults to 8 with DenseIndex and LadderStorage, 0 otherwise*/
+  std::size_t replay_journal(const std::vector<JournalRecord> &records,
+                             std::size_t first_record =
+                                 0); /*apply recorded commands with logging
+                                        disabled, returns commands applied.
+                                        nothing is applied if any record
+                                        has an out of range enum byte*/
+  int recover_from_journal(
+      const std::string &journal_location); /*replays the records this book
+                                               has not applied yet, returns 0
+                                               on success, -1 if the journal
+                                               can't be read or holds a
+                                               corrupt record*/
+  [[nodiscard]] depth_scan::DepthCover
+  get_depth_to_cover(Side side, Price price,
+                     Quantity quantity) const; /*levels and shown quantity
+                                                  an order of side needs to
+                                                  fill quantity at price or
+                                                  better*/
+  [[nodiscard]] BookSnapshot
+  take_snapshot() const; /*copy resting state, call between commands*/
+  int restore_snapshot(
+      const BookSnapshot &snapshot); /*replace the book with the snapshot,
+                                        returns 0 on success, -1 if the
+                                        snapshot is inconsistent*/
 
 private:
+  /*declared before the sides so it outlives every level using it*/
+  NodePool node_pool_;
+
   /*store bids and asks as a map of prices to a list of orderpointers*/
   /*bids is sorted in decending order, asks sorted in ascending order*/
-  std::map<Price, order_list, std::greater<Price>> bids_;
-  std::map<Price, order_list, std::less<Price>> asks_;
+  typename StoragePolicy::template side_type<std::greater<Price>> bids_;
+  typename StoragePolicy::template side_type<std::less<Price>> asks_;
+
+  /*stops waiting for their trigger, released after every match() that
+   * traded*/
+  TriggerBook stops_{&node_pool_};
+  Price last_trade_price_ = 0;   /*0 before the first trade*/
+  std::vector<Order> released_; /*stops fired and not yet entered*/
+
+  /*pegged orders by kind and offset, priced from bids_ and asks_ whenever
+   * match() or a depth query looks at them*/
+  PegSide<level_type, std::greater<std::int32_t>> peg_bids_;
+  PegSide<level_type, std::less<std::int32_t>> peg_asks_;
+  /*the BBO pegs are priced from while a command matches: the book as the
+   * command found it, so an aggressor never moves the pegs it trades with*/
+  Price peg_bid_ref_ = 0;
+  Price peg_ask_ref_ = 0;
+  bool peg_refs_frozen_ = false;
+  bool in_auction_ = false;
+  /*the order being entered: a pro-rata level shares its fills and its
+   * self-trade instruction applies*/
+  OrderID aggressor_id_ = 0;
+  StpMode aggressor_stp_ = StpMode::NONE; /*its instruction, read once*/
+  std::vector<OrderID> allocation_ids_; /*scratch for allocate_pro_rata()*/
+  std::vector<std::uint64_t> allocation_;
 
   /*map OrderIDs to list of orderpointers for ease of search based on ID*/
   /*we don't worry about order since we only search based on ID*/
-  std::unordered_map<OrderID, orderEntry> orders_;
+  IndexPolicy<order_entry> orders_;
+  typename OwnerPolicy::heads_type owner_heads_; /*owner -> newest order*/
+  void index_order(OrderID id, AccountID owner,
+                   typename level_type::handle itr);
+  void unindex_order(OrderID id); /*before the order leaves its level*/
 
-  OrderbookLogger Logger;
+  logger_type *logger_ = nullptr;
   SimTick last_sim_tick;
+  latency_type latency_;
+  typename StatsPolicy::counters_type stats_;
+  void refresh_depth_stats();
+
+  CommandJournal *journal_ = nullptr;
+  bool replaying_ = false; /*suppresses logger and journal during recovery*/
+  bool batching_ = false;  /*trades are logged once the batch is done*/
+  /*only a prefetchable index with ladder levels makes every stage a real
+   * hint, there distance 8 measures a few percent faster, elsewhere
+   * look-ahead does not pay for itself*/
+  static constexpr std::size_t default_prefetch_distance =
+      IndexPolicy<order_entry>::prefetchable && StoragePolicy::direct_levels
+          ? 8
+          : 0;
+  std::size_t prefetch_distance_ = default_prefetch_distance;
+  std::uint64_t command_seq_ = 0; /*commands journaled or replayed so far*/
+  int remove_order(OrderID cancel_order_id);
+  void cancel_resting(OrderID id); /*unlink, publish and forget one resting
+                                      order*/
+  std::size_t remove_owner_orders(AccountID owner);
+  bool replace_order(OrderID modify_order_id, Price price, Quantity quantity,
+                     Trades &trades);
+  bool execute(const JournalRecord &record, Trades &trades);
+  bool submit_command(JournalRecord command, Trades &trades);
+  static bool valid_command(
+      const JournalRecord &record); /*type and enum fields in range*/
+  bool id_available(OrderID id); /*a recorded or caller's ID can be added*/
+  void prefetch_command(const JournalRecord &command) const;
+  void prefetch_order(const JournalRecord &command);
+  void prefetch_order_level(const JournalRecord &command);
+  void journal_command(CommandType type, OrderID id, Side side, Price price,
+                       Quantity quantity, orderType order_type,
+                       std::uint32_t extra = 0, AccountID account = 0,
+                       StpMode stp = StpMode::NONE); /*extra is the iceberg peak
+                                                  for ADD, trigger for
+                                                  ADD_STOP, peg kind for
+                                                  ADD_PEG*/
+
+  PreTradeRisk *risk_ = nullptr;
+  bool passes_risk(OrderID id, AccountID account, Side side, Price price,
+                   Quantity quantity, std::uint64_t replaced_quantity = 0,
+                   std::uint64_t replaced_notional = 0);
+  bool passes_modify_risk(OrderID id, const Order &order, Price price,
+                          Quantity quantity);
+  static Price risk_price(const Order &order) {
+    return order.is_pegged() ? 0 : order.get_order_price();
+  }
+  void open_exposure(const Order &order);
+  void close_exposure(const Order &order, Quantity quantity);
+  void move_exposure(PreTradeRisk *from, PreTradeRisk *to);
+
+  L3Feed *l3_feed_ = nullptr;
+  std::uint64_t l3_seq_ = 0;
+  void publish_l3(L3EventType type, OrderID id, Side side, Price price,
+                  Quantity quantity);
 
   Trades
   match(); /*matches bids and asks and returns vector of resulting trades*/
+  void match(Trades &trades);
+
+  /*a side's best level to trade against this round, either a price level or
+   * a peg bucket*/
+  struct BestLevel {
+    level_type *level = nullptr;
+    Price price = 0;
+    PegType peg = PegType::NONE;
+    std::int32_t offset = 0;
+  };
+  bool has_pegs() const noexcept {
+    return !peg_bids_.empty() || !peg_asks_.empty();
+  }
+  void match_with_pegs(Trades &trades);
+  BestLevel best_level(Side side, Price best_bid, Price best_ask);
+  void drop_if_empty(Side side, const BestLevel &best);
+  void cross_levels(level_type &bids, Price bid_price, level_type &asks,
+                    Price ask_price,
+                    Trades &trades); /*trade two crossed levels until one
+                                        empties*/
+  void trade_fronts(level_type &bids, Price bid_price, level_type &asks,
+                    Price ask_price, Quantity trade_quantity, Price price,
+                    Trades &trades); /*trade the two front orders at price*/
+  bool allocate_pro_rata(level_type &passive, Price passive_price,
+                         Side passive_side, level_type &aggressor_level,
+                         Price aggressor_price, Price price, Trades &trades);
+  void record_trade(OrderID bid_id, OrderID ask_id, Price price,
+                    Quantity quantity, Trades &trades);
+  bool prevent_self_trade(level_type &bids, Price bid_price, level_type &asks,
+                          Price ask_price); /*false if the fronts trade*/
+  void cancel_front(level_type &level, Side side, Price price);
+  void decrement_front(level_type &level, Side side, Price price,
+                       Quantity quantity);
+  void uncross_book(Trades &trades);
+  Price best_limit_price(Side side) const; /*0 if the side is empty*/
+  void peg_references(Price &best_bid, Price &best_ask) const;
+  static Price peg_price(Side side, PegType peg, std::int32_t offset,
+                         Price best_bid,
+                         Price best_ask); /*0 while the reference is missing
+                                             or the result is off the price
+                                             range*/
+  void rest_pegged(Order pegged_order);
   [[nodiscard]] Trades
-  add_order_ptr(Order add_order);         /*adds order to orderbook*/
+  add_order_ptr(Order add_order); /*adds order to orderbook, then fires the
+                                     stops its trades crossed*/
+  void submit_order(Order add_order,
+                    Trades &trades); /*add_order_ptr(), appending to trades*/
+  void enter_order(Order add_order,
+                   Trades &trades); /*rest and match one order, trades are
+                                       appended*/
+  void add_stop_ptr(Price trigger_price, Order stop_order, Trades &trades);
+  void release_stops(Trades &trades,
+                     std::size_t first = 0); /*fire the stops crossed by
+                                                trades from first on*/
+  [[nodiscard]] Order triggered(const Order &stop) const;
+  void replenish_front(level_type &level, Side side,
+                       Price price); /*refill an iceberg's tranche*/
   bool can_match(Side side, Price price); /*check if order can be matched, used
                                              internally for can_fully_fill()*/
   bool can_fully_fill(Side side, Price price,
                       Quantity quantity); /*check if an order can be fully
                                              filled, for fill or kill orders*/
   bool can_fully_fill_unchecked(Side side, Price price, Quantity quantity);
-  Quantity get_level_quantity(const order_list &level_orders);
+  bool fok_covered(const Order &order) const; /*can_fully_fill_unchecked()
+                                                 without the liquidity
+                                                 self-trade prevention
+                                                 takes away*/
+  std::uint64_t stp_depth(Side side, Price price, AccountID account,
+                          StpMode mode, std::uint64_t target) const;
+  depth_scan::DepthCover depth_to_cover(Side side, Price price,
+                                        Quantity quantity,
+                                        bool with_reserve) const;
+  static std::uint64_t level_depth(const level_type &level,
+                                   bool with_reserve) {
+    return with_reserve ? level.get_total_quantity() : level.get_quantity();
+  }
+  template <typename SideMap>
+  depth_scan::DepthCover scan_depth(const SideMap &side_map, Price price,
+                                    std::uint64_t target,
+                                    bool with_reserve) const;
+  template <typename SideMap, typename PegMap>
+  depth_scan::DepthCover
+  scan_depth_with_pegs(Side side, const SideMap &side_map, const PegMap &pegs,
+                       Price price, std::uint64_t target,
+                       bool with_reserve) const;
+  Quantity get_level_quantity(const level_type &level_orders);
+  template <typename SideMap>
+  level_type &level_at(SideMap &side_map,
+                       Price price); /*find or create a pooled level*/
+  template <typename SideMap>
+  void unlink_order(SideMap &side_map, Price price,
+                    typename level_type::handle itr);
   [[nodiscard]] OrderbookLevelInfos get_levelInfos();
   OrderID gen_order_id();
   uint64_t next_order_id_ = 0;
   void flush_orderbook();
+  template <typename SideMap>
+  void restore_side(SideMap &side_map, Side side, const BookSnapshot &snapshot,
+                    std::size_t first_level, std::size_t level_count,
+                    std::size_t &next_order);
 
   friend class OrderbookTest;
   friend class OrderbookBench;
 };
 
+/*text log, hashed IDs, full stats: the engine's historical behaviour*/
+using Orderbook =
+    BasicOrderbook<TextLogging, MapListStorage, HashIndex, FullStats>;
+using BinaryLogOrderbook =
+    BasicOrderbook<BinaryLogging, MapListStorage, HashIndex, FullStats>;
+using UnloggedOrderbook =
+    BasicOrderbook<NoLogging, MapListStorage, HashIndex, FullStats>;
+/*nothing but matching, IDs must come from the book's own add_order()*/
+using LeanOrderbook =
+    BasicOrderbook<NoLogging, MapListStorage, DenseIndex, NoStats>;
+/*levels stored as chunked rings instead of linked lists*/
+using RingOrderbook =
+    BasicOrderbook<TextLogging, MapRingStorage, HashIndex, FullStats>;
+using LeanRingOrderbook =
+    BasicOrderbook<NoLogging, MapRingStorage, DenseIndex, NoStats>;
+/*ring levels in a dense ladder around the best price*/
+using LadderOrderbook =
+    BasicOrderbook<TextLogging, LadderStorage<>, HashIndex, FullStats>;
+using LeanLadderOrderbook =
+    BasicOrderbook<NoLogging, LadderStorage<>, DenseIndex, NoStats>;
+/*products that share fills pro-rata instead of in time priority*/
+using ProRataOrderbook = BasicOrderbook<NoLogging, MapListStorage, HashIndex,
+                                        FullStats, ProRataAllocation>;
+using TopOrderProRataOrderbook =
+    BasicOrderbook<NoLogging, MapListStorage, HashIndex, FullStats,
+                   TopOrderProRataAllocation>;
+/*sessions that cancel everything on disconnect*/
+using SessionOrderbook = BasicOrderbook<NoLogging, MapListStorage, HashIndex,
+                                        FullStats, FifoAllocation, OwnerLists>;
+
+extern template class BasicOrderbook<TextLogging, MapListStorage, HashIndex,
+                                     FullStats>;
+extern template class BasicOrderbook<BinaryLogging, MapListStorage,
+                                     HashIndex, FullStats>;
+extern template class BasicOrderbook<NoLogging, MapListStorage, HashIndex,
+                                     FullStats>;
+extern template class BasicOrderbook<NoLogging, MapListStorage, DenseIndex,
+                                     NoStats>;
+extern template class BasicOrderbook<TextLogging, MapRingStorage, HashIndex,
+                                     FullStats>;
+extern template class BasicOrderbook<NoLogging, MapRingStorage, DenseIndex,
+                                     NoStats>;
+extern template class BasicOrderbook<TextLogging, LadderStorage<>, HashIndex,
+                                     FullStats>;
+extern template class BasicOrderbook<NoLogging, LadderStorage<>, DenseIndex,
+                                     NoStats>;
+extern template class BasicOrderbook<NoLogging, MapListStorage, HashIndex,
+                                     FullStats, ProRataAllocation>;
+extern template class BasicOrderbook<NoLogging, MapListStorage, HashIndex,
+                                     FullStats, TopOrderProRataAllocation>;
+extern template class BasicOrderbook<NoLogging, MapListStorage, HashIndex,
+                                     FullStats, FifoAllocation, OwnerLists>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,258 @@
+#ifndef YINHE_SRC_ENGINE_ORDERBOOKPOLICIES_H
+#define YINHE_SRC_ENGINE_ORDERBOOKPOLICIES_H
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "engineStats.hpp"
+#include "latencyHistogram.hpp"
+#include "order.hpp"
+#include "orderLog.hpp"
+#include "priceLadder.hpp"
+#include "priceLevel.hpp"
+#include "types.hpp"
+
+/*
+ * compile-time configuration of BasicOrderbook. each book picks one policy of
+ * every kind, a disabled feature leaves no member, branch or call behind
+ *
+ *   logger:  NoLogging, TextLogging, BinaryLogging
+ *   storage: MapListStorage, MapRingStorage, LadderStorage<Level, Window>
+ *   index:   HashIndex, DenseIndex
+ *   stats:   FullStats, NoStats
+ *   allocation: FifoAllocation, ProRataAllocation, TopOrderProRataAllocation
+ *   owners:  NoOwnerLists, OwnerLists
+ */
+
+/*where a resting order lives inside its level*/
+template <typename Level, bool OwnerLinks = false> struct orderEntry {
+  typename Level::handle itr;
+};
+
+/*with owner lists, also its neighbours in its owner's list, 0 for none*/
+template <typename Level> struct orderEntry<Level, true> {
+  typename Level::handle itr;
+  OrderID owner_prev = 0;
+  OrderID owner_next = 0;
+};
+
+/* ==================== logger policies ==================== */
+
+/*the book never owns or opens its logger, it only logs to one attached with
+ * attach_logger()*/
+struct NoLogging {
+  using logger_type = NullLogger;
+  static constexpr bool enabled = false;
+};
+
+struct TextLogging {
+  using logger_type = OrderbookLogger;
+  static constexpr bool enabled = true;
+};
+
+struct BinaryLogging {
+  using logger_type = BinaryOrderbookLogger;
+  static constexpr bool enabled = true;
+};
+
+/* ==================== storage policies ==================== */
+
+/*one side of the book: price -> FIFO of resting orders, best price first.
+ * the level container is one of priceLevel.hpp*/
+struct MapListStorage {
+  using level_type = ListLevel;
+  template <typename Compare>
+  using side_type = std::map<Price, level_type, Compare>;
+  static constexpr bool direct_levels = false; /*see prefetch_level()*/
+};
+
+struct MapRingStorage {
+  using level_type = RingLevel;
+  template <typename Compare>
+  using side_type = std::map<Price, level_type, Compare>;
+  static constexpr bool direct_levels = false;
+};
+
+/*array slots for the Window ticks next to the best price, a std::map for
+ * everything further out (stub quotes). see priceLadder.hpp*/
+template <typename Level = RingLevel, std::size_t Window = 2048>
+struct LadderStorage {
+  using level_type = Level;
+  template <typename Compare>
+  using side_type = HybridLadder<level_type, Compare, Window>;
+  static constexpr bool direct_levels = true;
+};
+
+/*hint that price's level is about to be used. only ladder slots are found
+ * by arithmetic, a std::map level is only reached by the lookup itself*/
+template <typename SideMap> inline void prefetch_level(const SideMap &, Price) {}
+template <typename Level, typename Compare, std::size_t Window>
+inline void prefetch_level(const HybridLadder<Level, Compare, Window> &side,
+                           Price price) {
+  side.prefetch(price);
+}
+
+/* ==================== index policies ==================== */
+
+/*OrderID -> resting order. find() returns nullptr for unknown IDs*/
+template <typename Entry> class HashIndex {
+public:
+  Entry *find(OrderID id) {
+    auto it = map_.find(id);
+    return it == map_.end() ? nullptr : &it->second;
+  }
+  void insert(OrderID id, Entry entry) { map_.emplace(id, entry); }
+  void erase(OrderID id) { map_.erase(id); }
+  std::size_t size() const { return map_.size(); }
+  void clear() { map_.clear(); }
+  void reserve(std::size_t count) { map_.reserve(count); }
+  bool accepts(OrderID) const { return true; }
+  static bool accepts_after(OrderID, OrderID) { return true; }
+  /*the bucket an ID hashes to is not reachable without the loads a hint
+   * would hide, and a look-ahead find() would pay them twice*/
+  static constexpr bool prefetchable = false;
+  void prefetch(OrderID) const {}
+  template <typename F> void for_each(F &&f) const {
+    for (const auto &[id, entry] : map_)
+      f(id, entry);
+  }
+
+private:
+  std::unordered_map<OrderID, Entry> map_;
+};
+
+/*IDs from gen_order_id() are dense and increasing, so the ID is the slot: a
+ * bounds check instead of a hash and probe. memory follows the highest ID
+ * seen, only use it when IDs come from the book itself. an ID from outside
+ * more than max_gap past the highest slot is refused*/
+template <typename Entry> class DenseIndex {
+public:
+  Entry *find(OrderID id) {
+    return id < slots_.size() && slots_[id].live ? &slots_[id].entry : nullptr;
+  }
+  void insert(OrderID id, Entry entry) {
+    if (id >= slots_.size())
+      slots_.resize(id + 1);
+    if (!slots_[id].live) {
+      slots_[id] = Slot{entry, true};
+      ++size_;
+    }
+  }
+  void erase(OrderID id) {
+    if (id < slots_.size() && slots_[id].live) {
+      slots_[id].live = false;
+      --size_;
+    }
+  }
+  std::size_t size() const { return size_; }
+  void clear() {
+    slots_.clear();
+    size_ = 0;
+  }
+  void reserve(std::size_t count) { slots_.reserve(count + 1); }
+  static constexpr OrderID max_gap = OrderID(1) << 20;
+  bool accepts(OrderID id) const { return id < slots_.size() + max_gap; }
+  /*accepts() of an index already holding IDs up to highest, so a batch of
+   * IDs can be checked in ascending order before any is inserted*/
+  static bool accepts_after(OrderID highest, OrderID id) {
+    return id <= highest + max_gap;
+  }
+  static constexpr bool prefetchable = true;
+  void prefetch(OrderID id) const {
+    if (id < slots_.size())
+      __builtin_prefetch(&slots_[id]);
+  }
+  template <typename F> void for_each(F &&f) const {
+    for (std::size_t id = 0; id < slots_.size(); ++id)
+      if (slots_[id].live)
+        f(static_cast<OrderID>(id), slots_[id].entry);
+  }
+
+private:
+  struct Slot {
+    Entry entry;
+    bool live = false;
+  };
+  std::vector<Slot> slots_;
+  std::size_t size_ = 0;
+};
+
+/* ==================== stats policies ==================== */
+
+/*per-book latency, written by the matching thread, readable from any thread
+ * through LatencyHistogram::snapshot()*/
+struct OrderbookLatency {
+  LatencyHistogram add_order; /*includes the match() it triggers*/
+  LatencyHistogram cancel_order;
+  LatencyHistogram match;
+};
+
+/*same shape as OrderbookLatency so the timers compile unchanged, and
+ * ScopedLatency<false> ignores what it is given*/
+struct NoLatency {
+  struct Disabled {};
+  static inline Disabled add_order, cancel_order, match;
+};
+
+struct NoCounters {};
+
+struct FullStats {
+  using latency_type = OrderbookLatency;
+  using counters_type = EngineStats;
+  static constexpr bool enabled = true;
+};
+
+struct NoStats {
+  using latency_type = NoLatency;
+  using counters_type = NoCounters;
+  static constexpr bool enabled = false;
+};
+
+/* ==================== allocation policies ==================== */
+
+/*how an incoming order's quantity is shared out among the orders of a level
+ * it trades against. pro-rata only changes anything when the level holds
+ * more than the incoming order can take, otherwise every order fills
+ * completely whatever the policy. auctions always uncross in time priority*/
+struct FifoAllocation {
+  static constexpr bool pro_rata = false;
+  static constexpr bool top_order_first = false;
+};
+
+/*each order gets its share of the quantity, rounded down, and the lots left
+ * over go one each to the orders in time priority*/
+struct ProRataAllocation {
+  static constexpr bool pro_rata = true;
+  static constexpr bool top_order_first = false;
+};
+
+/*the order at the front of the level fills first, the rest is shared
+ * pro-rata among the others*/
+struct TopOrderProRataAllocation {
+  static constexpr bool pro_rata = true;
+  static constexpr bool top_order_first = true;
+};
+
+/* ==================== owner policies ==================== */
+
+struct NoOwnerHeads {};
+
+/*cancel_all_for_owner() scans the whole ID index*/
+struct NoOwnerLists {
+  using heads_type = NoOwnerHeads;
+  static constexpr bool enabled = false;
+};
+
+/*every resting order is linked into its owner's list through its ID index
+ * entry, heads hashed by owner. cancel_all_for_owner() walks exactly the
+ * owner's orders, at the price of relinking a neighbour or two whenever an
+ * order rests or leaves the book. accounts need not be dense: an owner has a
+ * head only while it has orders resting*/
+struct OwnerLists {
+  using heads_type = std::unordered_map<AccountID, OrderID>;
+  static constexpr bool enabled = true;
+};
+
+#endif
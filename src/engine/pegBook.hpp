@@ -0,0 +1,83 @@
+#ifndef YINHE_SRC_ENGINE_PEGBOOK_H
+#define YINHE_SRC_ENGINE_PEGBOOK_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+
+#include "enums.hpp"
+#include "nodePool.hpp"
+#include "types.hpp"
+
+/*
+ * pegged orders of one side of the book. a pegged order has no price of its
+ * own, only an offset from a reference the book works out when it looks:
+ *
+ *   - PRIMARY: the best limit price on the order's own side
+ *   - MIDPOINT: halfway between the best limit bid and ask, rounded down for
+ *     buys and up for sells
+ *
+ * orders are bucketed by peg kind and offset, one FIFO level per bucket.
+ * every order in a bucket shares the same effective price, so a BBO move
+ * reprices whole buckets at once without touching a single order, and the
+ * best bucket of each kind is always begin(). Compare orders the offsets in
+ * priority order (std::greater for bids, std::less for asks)
+ *
+ * buckets hold orders in the book's own level type, so fills, iceberg
+ * refills and compaction work on them exactly as on a price level
+ */
+template <typename Level, typename Compare> class PegSide {
+public:
+  using bucket_map = std::map<std::int32_t, Level, Compare>;
+
+  bool empty() const noexcept { return primary_.empty() && midpoint_.empty(); }
+
+  bucket_map &buckets(PegType peg) {
+    return peg == PegType::PRIMARY ? primary_ : midpoint_;
+  }
+  const bucket_map &buckets(PegType peg) const {
+    return peg == PegType::PRIMARY ? primary_ : midpoint_;
+  }
+
+  /*find or create the bucket, new buckets allocate from pool*/
+  Level &bucket_at(PegType peg, std::int32_t offset, NodePool *pool) {
+    return buckets(peg).try_emplace(offset, pool).first->second;
+  }
+
+  /*drop the bucket once it is empty, otherwise give it the chance to
+   * repack. on_move(id, handle) is called for every order compaction moves*/
+  template <typename OnMove>
+  void unlink(PegType peg, std::int32_t offset, typename Level::handle itr,
+              OnMove &&on_move) {
+    auto &peg_buckets = buckets(peg);
+    auto map_it = peg_buckets.find(offset);
+    auto &bucket = map_it->second;
+    bucket.erase(itr);
+    if (bucket.empty())
+      peg_buckets.erase(map_it);
+    else if (bucket.needs_compaction())
+      bucket.compact(on_move);
+  }
+
+  void clear() {
+    primary_.clear();
+    midpoint_.clear();
+  }
+
+  /*f(order) for every resting pegged order, primary buckets first, each in
+   * priority order*/
+  template <typename F> void for_each(F &&f) const {
+    for (const auto &[offset, bucket] : primary_)
+      for (const auto &order : bucket)
+        f(order);
+    for (const auto &[offset, bucket] : midpoint_)
+      for (const auto &order : bucket)
+        f(order);
+  }
+
+private:
+  bucket_map primary_;
+  bucket_map midpoint_;
+};
+
+#endif
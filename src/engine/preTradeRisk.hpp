@@ -0,0 +1,130 @@
+#ifndef YINHE_SRC_ENGINE_PRETRADERISK_H
+#define YINHE_SRC_ENGINE_PRETRADERISK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "types.hpp"
+
+/**************************************
+ * pre-trade risk
+ * per-account limits checked before an order reaches the book:
+ *
+ *   - the order's own quantity
+ *   - the account's open quantity and notional once the order is added
+ *   - the order's price, within a band of ticks around a reference price
+ *
+ * accounts are dense IDs indexing flat arrays, so a check is a few loads
+ * from one slot of each. exposure is kept incrementally: an order adds its
+ * whole quantity (iceberg reserve included) when it enters the book, every
+ * fill and cancel takes its part back out. notional is counted at the
+ * order's own limit price, not the trade price, so what comes out always
+ * matches what went in. pegged orders have no limit price and count towards
+ * open quantity only. stops count from the moment they fire
+ *
+ * not thread safe: one risk object can be shared by several books only if
+ * they run on the same thread
+ **************************************/
+enum class RiskReject : std::uint8_t {
+  NONE,
+  UNKNOWN_ACCOUNT, // outside the accounts the risk object was built for
+  ORDER_QUANTITY,
+  OPEN_QUANTITY,
+  OPEN_NOTIONAL,
+  PRICE_BAND
+};
+constexpr int NUM_RISK_REJECTS = 6;
+
+struct RiskLimits {
+  Quantity max_order_quantity = std::numeric_limits<Quantity>::max();
+  std::uint64_t max_open_quantity = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t max_open_notional = std::numeric_limits<std::uint64_t>::max();
+  Price price_band = 0; /*ticks either side of the reference, 0: no band*/
+};
+
+class PreTradeRisk {
+public:
+  /*accounts 0..accounts-1, every one unlimited until set_limits()*/
+  explicit PreTradeRisk(std::size_t accounts)
+      : limits_(accounts), open_quantity_(accounts, 0),
+        open_notional_(accounts, 0) {}
+
+  std::size_t get_account_count() const noexcept { return limits_.size(); }
+  void set_limits(AccountID account, const RiskLimits &limits) {
+    limits_[account] = limits;
+  }
+  const RiskLimits &get_limits(AccountID account) const {
+    return limits_[account];
+  }
+  std::uint64_t get_open_quantity(AccountID account) const {
+    return open_quantity_[account];
+  }
+  std::uint64_t get_open_notional(AccountID account) const {
+    return open_notional_[account];
+  }
+  std::uint64_t get_rejects(RiskReject reason) const {
+    return rejects_[static_cast<int>(reason)];
+  }
+
+  /*price 0 is an order without a limit price (pegged, or a MARKET stop),
+   * never banded. reference 0 (nothing traded yet) disables the band.
+   * replaced_quantity and replaced_notional are the exposure of an order
+   * this one replaces*/
+  RiskReject check(AccountID account, Price price, Quantity quantity,
+                   Price reference, std::uint64_t replaced_quantity = 0,
+                   std::uint64_t replaced_notional = 0) {
+    RiskReject reason = evaluate(account, price, quantity, reference,
+                                 replaced_quantity, replaced_notional);
+    if (reason != RiskReject::NONE)
+      ++rejects_[static_cast<int>(reason)];
+    return reason;
+  }
+
+  /*accounts outside the ones the object was built for are not tracked:
+   * their orders only reach a book that restored or rested them unchecked*/
+  void open(AccountID account, Price price, Quantity quantity) {
+    if (account >= open_quantity_.size())
+      return;
+    open_quantity_[account] += quantity;
+    open_notional_[account] += std::uint64_t(price) * quantity;
+  }
+  /*a fill or a cancel*/
+  void close(AccountID account, Price price, Quantity quantity) {
+    if (account >= open_quantity_.size())
+      return;
+    open_quantity_[account] -= quantity;
+    open_notional_[account] -= std::uint64_t(price) * quantity;
+  }
+
+private:
+  std::vector<RiskLimits> limits_;
+  std::vector<std::uint64_t> open_quantity_;
+  std::vector<std::uint64_t> open_notional_;
+  std::uint64_t rejects_[NUM_RISK_REJECTS] = {};
+
+  RiskReject evaluate(AccountID account, Price price, Quantity quantity,
+                      Price reference, std::uint64_t replaced_quantity,
+                      std::uint64_t replaced_notional) const {
+    if (account >= limits_.size())
+      return RiskReject::UNKNOWN_ACCOUNT;
+    const RiskLimits &limits = limits_[account];
+    if (quantity > limits.max_order_quantity)
+      return RiskReject::ORDER_QUANTITY;
+    if (open_quantity_[account] - replaced_quantity + quantity >
+        limits.max_open_quantity)
+      return RiskReject::OPEN_QUANTITY;
+    if (open_notional_[account] - replaced_notional +
+            std::uint64_t(price) * quantity >
+        limits.max_open_notional)
+      return RiskReject::OPEN_NOTIONAL;
+    if (limits.price_band != 0 && reference != 0 && price != 0 &&
+        (price > reference ? price - reference : reference - price) >
+            limits.price_band)
+      return RiskReject::PRICE_BAND;
+    return RiskReject::NONE;
+  }
+};
+
+#endif
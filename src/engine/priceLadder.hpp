@@ -0,0 +1,339 @@
+#ifndef YINHE_SRC_ENGINE_PRICELADDER_H
+#define YINHE_SRC_ENGINE_PRICELADDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "priceBitmap.hpp"
+#include "types.hpp"
+
+/*
+ * one side of the book as a dense ladder of Window ticks next to the best
+ * price, with every price outside it in an ordered overflow map
+ *
+ * a level inside the window is an array slot found by subtraction, and the
+ * next occupied slot comes from a PriceBitmap. the window is placed so the
+ * best price sits a quarter of the way in (room for the market to improve
+ * without a move) and is recentred when:
+ *
+ *   - a price better than the window arrives
+ *   - the best price drifts past the middle, or the window runs empty
+ *
+ * recentring moves the levels that leave the window into the overflow map
+ * and pulls in the ones it now covers. levels are moved, never copied, so
+ * handles into them stay valid. stub quotes far from the market stay in the
+ * overflow map and never stretch the array
+ *
+ * invariant: nothing in the overflow map is better than the window, so
+ * iteration is the window's slots in priority order, then the overflow map.
+ * exposes the subset of std::map the book uses, Compare picks the side
+ * (std::less for asks, std::greater for bids)
+ */
+template <typename Level, typename Compare, std::size_t Window>
+class HybridLadder {
+  static_assert(Window >= 64 && (Window & (Window - 1)) == 0,
+                "window is a power of two of at least 64 ticks");
+  static constexpr bool kAscending = std::is_same_v<Compare, std::less<Price>>;
+  static_assert(kAscending || std::is_same_v<Compare, std::greater<Price>>,
+                "Compare is std::less<Price> or std::greater<Price>");
+  static constexpr std::size_t npos = PriceBitmap::npos;
+
+public:
+  using key_type = Price;
+  using mapped_type = Level;
+  using value_type = std::pair<const Price, Level>;
+  using key_compare = Compare;
+  using overflow_type = std::map<Price, Level, Compare>;
+
+  template <bool Const> class basic_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = HybridLadder::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const value_type *, value_type *>;
+    using reference =
+        std::conditional_t<Const, const value_type &, value_type &>;
+
+    basic_iterator() = default;
+    template <bool C = Const, typename = std::enable_if_t<C>>
+    basic_iterator(const basic_iterator<false> &other)
+        : ladder_(other.ladder_), rank_(other.rank_), it_(other.it_) {}
+
+    reference operator*() const {
+      return rank_ != npos ? ladder_->slot(rank_) : *it_;
+    }
+    pointer operator->() const { return &**this; }
+    basic_iterator &operator++() {
+      if (rank_ != npos) {
+        rank_ = ladder_->occupied_.find_next(rank_ + 1);
+        if (rank_ == npos)
+          it_ = ladder_->overflow_.begin();
+      } else {
+        ++it_;
+      }
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator copy = *this;
+      ++*this;
+      return copy;
+    }
+    bool operator==(const basic_iterator &other) const {
+      return rank_ == other.rank_ && (rank_ != npos || it_ == other.it_);
+    }
+    bool operator!=(const basic_iterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    using ladder_ptr =
+        std::conditional_t<Const, const HybridLadder *, HybridLadder *>;
+    using map_iterator = std::conditional_t<
+        Const, typename overflow_type::const_iterator,
+        typename overflow_type::iterator>;
+
+    basic_iterator(ladder_ptr ladder, std::size_t rank, map_iterator it)
+        : ladder_(ladder), rank_(rank), it_(it) {}
+
+    ladder_ptr ladder_ = nullptr;
+    std::size_t rank_ = npos; /*slot in the window, npos in the overflow map*/
+    map_iterator it_{};
+    friend class HybridLadder;
+    friend class basic_iterator<!Const>;
+  };
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  HybridLadder() : occupied_(Window) {}
+  ~HybridLadder() { destroy_window(); }
+  HybridLadder(const HybridLadder &) = delete;
+  HybridLadder &operator=(const HybridLadder &) = delete;
+
+  bool empty() const noexcept { return window_size_ == 0 && overflow_.empty(); }
+  std::size_t size() const noexcept { return window_size_ + overflow_.size(); }
+  key_compare key_comp() const { return Compare(); }
+
+  iterator begin() {
+    return iterator(this, occupied_.find_first(), overflow_.begin());
+  }
+  iterator end() { return iterator(this, npos, overflow_.end()); }
+  const_iterator begin() const {
+    return const_iterator(this, occupied_.find_first(), overflow_.begin());
+  }
+  const_iterator end() const {
+    return const_iterator(this, npos, overflow_.end());
+  }
+
+  iterator find(Price price) {
+    if (in_window(price)) {
+      std::size_t rank = rank_of(price);
+      return occupied_.test(rank) ? iterator(this, rank, overflow_.end())
+                                  : end();
+    }
+    return iterator(this, npos, overflow_.find(price));
+  }
+
+  /*hint that price's slot is about to be used, nothing for a price outside
+   * the window: a map node is only reached by the lookup itself*/
+  void prefetch(Price price) const {
+    if (slots_ && in_window(price))
+      __builtin_prefetch(&slots_[rank_of(price)]);
+  }
+
+  /*construct the level from args if the price has none*/
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Price price, Args &&...args) {
+    if (!anchored_ || better(price, front_price()))
+      recentre(price);
+    if (!in_window(price)) {
+      ++overflow_inserts_;
+      auto [it, inserted] =
+          overflow_.try_emplace(price, std::forward<Args>(args)...);
+      return {iterator(this, npos, it), inserted};
+    }
+    std::size_t rank = rank_of(price);
+    if (occupied_.test(rank))
+      return {iterator(this, rank, overflow_.end()), false};
+    construct_slot(rank, price, Level(std::forward<Args>(args)...));
+    return {iterator(this, rank, overflow_.end()), true};
+  }
+
+  /*the hint is ignored, a slot is found by subtraction*/
+  template <typename... Args>
+  iterator emplace_hint(const_iterator, Price price, Args &&...args) {
+    return try_emplace(price, std::forward<Args>(args)...).first;
+  }
+
+  void erase(iterator pos) {
+    if (pos.rank_ != npos)
+      destroy_slot(pos.rank_);
+    else
+      overflow_.erase(pos.it_);
+    follow_best();
+  }
+
+  std::size_t erase(Price price) {
+    iterator pos = find(price);
+    if (pos == end())
+      return 0;
+    erase(pos);
+    return 1;
+  }
+
+  void clear() {
+    destroy_window();
+    overflow_.clear();
+    anchored_ = false;
+  }
+
+  /*for tests and benchmarks*/
+  std::size_t get_window_levels() const noexcept { return window_size_; }
+  std::size_t get_overflow_levels() const noexcept { return overflow_.size(); }
+  std::uint64_t get_recentre_count() const noexcept { return recentres_; }
+  std::uint64_t get_overflow_inserts() const noexcept {
+    return overflow_inserts_;
+  }
+  Price get_window_front() const noexcept { return front_price(); }
+
+private:
+  union Slot {
+    value_type value;
+    Slot() {}
+    ~Slot() {}
+  };
+
+  std::unique_ptr<Slot[]> slots_; /*allocated on the first level*/
+  PriceBitmap occupied_;          /*by rank, rank 0 is the window front*/
+  overflow_type overflow_;
+  std::size_t window_size_ = 0;
+  Price lo_ = 0; /*lowest price in the window, whichever the side*/
+  bool anchored_ = false;
+  std::uint64_t recentres_ = 0;
+  std::uint64_t overflow_inserts_ = 0;
+
+  static bool better(Price a, Price b) { return Compare()(a, b); }
+
+  value_type &slot(std::size_t rank) { return slots_[rank].value; }
+  const value_type &slot(std::size_t rank) const { return slots_[rank].value; }
+
+  bool in_window(Price price) const {
+    return anchored_ && price >= lo_ && price - lo_ < Window;
+  }
+  /*rank counts from the best end of the window*/
+  std::size_t rank_of(Price price) const {
+    return kAscending ? price - lo_ : lo_ + (Window - 1) - price;
+  }
+  Price front_price() const {
+    return kAscending ? lo_ : static_cast<Price>(lo_ + (Window - 1));
+  }
+
+  void construct_slot(std::size_t rank, Price price, Level &&level) {
+    new (&slots_[rank].value) value_type(price, std::move(level));
+    occupied_.set(rank);
+    ++window_size_;
+  }
+
+  void destroy_slot(std::size_t rank) {
+    slots_[rank].value.~value_type();
+    occupied_.clear(rank);
+    --window_size_;
+  }
+
+  void destroy_window() {
+    for (std::size_t rank = occupied_.find_first(); rank != npos;
+         rank = occupied_.find_next(rank + 1))
+      slots_[rank].value.~value_type();
+    occupied_.reset();
+    window_size_ = 0;
+  }
+
+  /*after an erase: keep the best price in the front half of the window*/
+  void follow_best() {
+    std::size_t best = occupied_.find_first();
+    if (best != npos && best <= Window / 2)
+      return;
+    if (best != npos)
+      recentre(slot(best).first);
+    else if (!overflow_.empty())
+      recentre(overflow_.begin()->first);
+    else
+      anchored_ = false;
+  }
+
+  /*place the window so best sits Window / 4 ticks from its front*/
+  void recentre(Price best) {
+    constexpr std::uint64_t kMaxLo =
+        std::numeric_limits<Price>::max() - (Window - 1);
+    std::uint64_t lo;
+    if (kAscending)
+      lo = best > Window / 4 ? best - Window / 4 : 0;
+    else
+      lo = std::uint64_t(best) + Window / 4 + 1 > Window
+               ? std::uint64_t(best) + Window / 4 + 1 - Window
+               : 0;
+    if (lo > kMaxLo)
+      lo = kMaxLo;
+    if (!slots_)
+      slots_.reset(new Slot[Window]);
+    if (!anchored_) {
+      lo_ = static_cast<Price>(lo);
+      anchored_ = true;
+      return;
+    }
+    if (lo == lo_)
+      return;
+    ++recentres_;
+    Price old_lo = lo_;
+    auto new_rank = [&](Price price) -> std::size_t {
+      if (price < lo || price - lo >= Window)
+        return npos;
+      return kAscending ? price - lo : lo + (Window - 1) - price;
+    };
+
+    /*levels keep their relative order, so walking in the direction the
+     * ranks move never lands on a slot that is still to be moved*/
+    bool ranks_fall = kAscending ? lo > old_lo : lo < old_lo;
+    std::size_t rank = ranks_fall ? occupied_.find_first()
+                                  : occupied_.find_last();
+    while (rank != npos) {
+      std::size_t next = ranks_fall ? occupied_.find_next(rank + 1)
+                                    : (rank == 0 ? npos
+                                                 : occupied_.find_prev(rank - 1));
+      value_type &entry = slots_[rank].value;
+      Price price = entry.first;
+      std::size_t target = new_rank(price);
+      if (target == npos)
+        overflow_.emplace(price, std::move(entry.second));
+      else
+        new (&slots_[target].value) value_type(price, std::move(entry.second));
+      entry.~value_type();
+      occupied_.clear(rank);
+      if (target != npos)
+        occupied_.set(target);
+      else
+        --window_size_;
+      rank = next;
+    }
+    lo_ = static_cast<Price>(lo);
+
+    /*pull in the overflow levels the window now covers*/
+    auto first = overflow_.lower_bound(front_price());
+    auto last = first;
+    while (last != overflow_.end() && in_window(last->first)) {
+      construct_slot(rank_of(last->first), last->first,
+                     std::move(last->second));
+      ++last;
+    }
+    overflow_.erase(first, last);
+  }
+};
+
+#endif
@@ -0,0 +1,357 @@
+#ifndef YINHE_SRC_ENGINE_PRICELEVEL_H
+#define YINHE_SRC_ENGINE_PRICELEVEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <utility>
+
+#include "nodePool.hpp"
+#include "order.hpp"
+
+/*
+ * FIFO of the orders resting at one price. the engine only needs:
+ *
+ *   handle push_back(Order)   append, the handle stays valid until erase()
+ *   Order &front(), void pop_front()
+ *   void erase(handle)        O(1) removal from anywhere in the level
+ *   void fill(Order &, qty)   fill a resting order of this level
+ *   handle requeue(handle)    refill an iceberg and move it to the back,
+ *                             kRequeueKeepsHandle says if its handle
+ *                             survives
+ *   handle requeue_front()    requeue() of the front order
+ *   get_quantity()            shown quantity of the whole level
+ *   get_total_quantity()      shown plus iceberg reserve, what matching
+ *                             can fill at this price
+ *   empty(), size(), begin()/end() over the live orders in time priority
+ *   needs_compaction(), compact(on_move(OrderID, handle))
+ *   static prefetch(handle)   hint the memory erase(handle) will touch,
+ *                             without reading any of it
+ *
+ * handles dereference to the Order (h->get_order_id()) so the ID index can
+ * hold them directly. resting orders are only filled through fill(), which
+ * keeps the level totals exact for depth scans
+ */
+
+/*std::list of pool-allocated nodes*/
+class ListLevel {
+public:
+  using handle = order_list::iterator;
+  using const_iterator = order_list::const_iterator;
+
+  explicit ListLevel(NodePool *pool = nullptr)
+      : orders_(order_list::allocator_type(pool)) {}
+
+  bool empty() const noexcept { return orders_.empty(); }
+  std::size_t size() const noexcept { return orders_.size(); }
+  std::uint64_t get_quantity() const noexcept { return quantity_; }
+  std::uint64_t get_total_quantity() const noexcept {
+    return quantity_ + reserve_;
+  }
+  Order &front() { return orders_.front(); }
+  void pop_front() {
+    quantity_ -= orders_.front().get_remaining_quantity();
+    reserve_ -= orders_.front().get_hidden_quantity();
+    orders_.pop_front();
+  }
+  handle push_back(Order order) {
+    quantity_ += order.get_remaining_quantity();
+    reserve_ += order.get_hidden_quantity();
+    orders_.push_back(std::move(order));
+    return std::prev(orders_.end());
+  }
+  void erase(handle h) {
+    quantity_ -= h->get_remaining_quantity();
+    reserve_ -= h->get_hidden_quantity();
+    orders_.erase(h);
+  }
+  /*the neighbours erase() relinks are only known once the node is read*/
+  static void prefetch(handle h) { __builtin_prefetch(&*h); }
+  void fill(Order &order, Quantity quantity) {
+    order.fill(quantity);
+    quantity_ -= quantity;
+  }
+
+  /*relinks the node, nothing is allocated and the handle stays valid*/
+  static constexpr bool kRequeueKeepsHandle = true;
+  handle requeue(handle h) {
+    orders_.splice(orders_.end(), orders_, h);
+    h->replenish();
+    quantity_ += h->get_remaining_quantity();
+    reserve_ -= h->get_remaining_quantity();
+    return h;
+  }
+  handle requeue_front() { return requeue(orders_.begin()); }
+
+  /*nodes never move, there is nothing to compact*/
+  bool needs_compaction() const noexcept { return false; }
+  template <typename F> void compact(F &&) {}
+
+  const_iterator begin() const { return orders_.begin(); }
+  const_iterator end() const { return orders_.end(); }
+
+private:
+  order_list orders_;
+  std::uint64_t quantity_ = 0;
+  std::uint64_t reserve_ = 0; /*icebergs' hidden quantity*/
+};
+
+/*
+ * chunked ring: orders are stored by value in fixed chunks of kChunkSlots,
+ * appended at the tail chunk and consumed from the head chunk, so match()
+ * and depth scans walk contiguous memory
+ *
+ * erase() anywhere is a tombstone: the slot's bit is cleared in the chunk's
+ * live mask and nothing moves, so handles held by the ID index stay valid.
+ * a chunk whose last live order goes is unlinked and returned to the pool.
+ * when tombstones outnumber live orders the level can be compacted, which
+ * moves orders and reports every new handle through on_move
+ */
+class RingLevel {
+public:
+  static constexpr unsigned kChunkSlots = 32;
+
+  struct Chunk {
+    Chunk *prev = nullptr;
+    Chunk *next = nullptr;
+    std::uint32_t live_mask = 0; /*bit i set: slot i holds a resting order*/
+    std::uint32_t end = 0;       /*next unused slot*/
+    union Slot {
+      Order order;
+      Slot() {}
+    } slots[kChunkSlots];
+  };
+
+  class handle {
+  public:
+    handle() = default;
+    Order &operator*() const { return chunk_->slots[slot_].order; }
+    Order *operator->() const { return &chunk_->slots[slot_].order; }
+    bool operator==(const handle &other) const {
+      return chunk_ == other.chunk_ && slot_ == other.slot_;
+    }
+    bool operator!=(const handle &other) const { return !(*this == other); }
+
+  private:
+    handle(Chunk *chunk, unsigned slot) : chunk_(chunk), slot_(slot) {}
+    Chunk *chunk_ = nullptr;
+    unsigned slot_ = 0;
+    friend class RingLevel;
+  };
+
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Order;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Order *;
+    using reference = const Order &;
+
+    const_iterator() = default;
+    reference operator*() const { return chunk_->slots[slot_].order; }
+    pointer operator->() const { return &chunk_->slots[slot_].order; }
+    const_iterator &operator++() {
+      slot_ = next_live(chunk_, slot_ + 1);
+      while (slot_ == kChunkSlots) {
+        chunk_ = chunk_->next;
+        if (chunk_ == nullptr) {
+          slot_ = 0;
+          break;
+        }
+        slot_ = next_live(chunk_, 0);
+      }
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator copy = *this;
+      ++*this;
+      return copy;
+    }
+    bool operator==(const const_iterator &other) const {
+      return chunk_ == other.chunk_ && slot_ == other.slot_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    const_iterator(const Chunk *chunk, unsigned slot)
+        : chunk_(chunk), slot_(slot) {}
+    const Chunk *chunk_ = nullptr;
+    unsigned slot_ = 0;
+    friend class RingLevel;
+  };
+
+  explicit RingLevel(NodePool *pool = nullptr) : pool_(pool) {}
+  ~RingLevel() {
+    while (head_ != nullptr) {
+      Chunk *next = head_->next;
+      free_chunk(head_);
+      head_ = next;
+    }
+  }
+  RingLevel(const RingLevel &) = delete;
+  RingLevel &operator=(const RingLevel &) = delete;
+  RingLevel(RingLevel &&other) noexcept
+      : pool_(other.pool_), head_(other.head_), tail_(other.tail_),
+        size_(other.size_), chunks_(other.chunks_),
+        quantity_(other.quantity_), reserve_(other.reserve_) {
+    other.head_ = other.tail_ = nullptr;
+    other.size_ = other.chunks_ = 0;
+    other.quantity_ = other.reserve_ = 0;
+  }
+  RingLevel &operator=(RingLevel &&other) noexcept {
+    std::swap(pool_, other.pool_);
+    std::swap(head_, other.head_);
+    std::swap(tail_, other.tail_);
+    std::swap(size_, other.size_);
+    std::swap(chunks_, other.chunks_);
+    std::swap(quantity_, other.quantity_);
+    std::swap(reserve_, other.reserve_);
+    return *this;
+  }
+
+  bool empty() const noexcept { return size_ == 0; }
+  std::size_t size() const noexcept { return size_; }
+  std::size_t get_chunk_count() const noexcept { return chunks_; }
+  std::uint64_t get_quantity() const noexcept { return quantity_; }
+  std::uint64_t get_total_quantity() const noexcept {
+    return quantity_ + reserve_;
+  }
+
+  /*the head chunk always holds at least one live order when not empty*/
+  Order &front() {
+    return head_->slots[__builtin_ctz(head_->live_mask)].order;
+  }
+  void pop_front() { kill(head_, __builtin_ctz(head_->live_mask)); }
+
+  handle push_back(Order order) {
+    if (tail_ == nullptr || tail_->end == kChunkSlots)
+      append_chunk();
+    unsigned slot = tail_->end++;
+    new (&tail_->slots[slot].order) Order(std::move(order));
+    tail_->live_mask |= 1u << slot;
+    ++size_;
+    quantity_ += tail_->slots[slot].order.get_remaining_quantity();
+    reserve_ += tail_->slots[slot].order.get_hidden_quantity();
+    return handle(tail_, slot);
+  }
+
+  void erase(handle h) { kill(h.chunk_, h.slot_); }
+  /*the slot and its chunk's live mask*/
+  static void prefetch(handle h) {
+    __builtin_prefetch(h.chunk_);
+    __builtin_prefetch(&h.chunk_->slots[h.slot_]);
+  }
+  void fill(Order &order, Quantity quantity) {
+    order.fill(quantity);
+    quantity_ -= quantity;
+  }
+
+  /*the order is copied into the tail slot, its old slot becomes a tombstone*/
+  static constexpr bool kRequeueKeepsHandle = false;
+  handle requeue(handle h) {
+    Order order = *h;
+    order.replenish();
+    kill(h.chunk_, h.slot_);
+    return push_back(order);
+  }
+  handle requeue_front() {
+    return requeue(handle(head_, __builtin_ctz(head_->live_mask)));
+  }
+
+  /*more than half of the allocated slots are tombstones*/
+  bool needs_compaction() const noexcept {
+    return chunks_ > 2 && chunks_ * kChunkSlots > 2 * size_ + kChunkSlots;
+  }
+
+  /*repack the live orders into as few chunks as possible, in priority
+   * order. on_move(id, handle) is called for every order that moved*/
+  template <typename F> void compact(F &&on_move) {
+    Chunk *old = head_;
+    head_ = tail_ = nullptr;
+    size_ = chunks_ = 0;
+    quantity_ = reserve_ = 0;
+    while (old != nullptr) {
+      for (unsigned slot = next_live(old, 0); slot < kChunkSlots;
+           slot = next_live(old, slot + 1)) {
+        handle moved = push_back(old->slots[slot].order);
+        on_move(moved->get_order_id(), moved);
+      }
+      Chunk *next = old->next;
+      free_chunk(old);
+      old = next;
+    }
+  }
+
+  const_iterator begin() const {
+    return head_ == nullptr ? end()
+                            : const_iterator(head_, next_live(head_, 0));
+  }
+  const_iterator end() const { return const_iterator(); }
+
+private:
+  NodePool *pool_ = nullptr;
+  Chunk *head_ = nullptr;
+  Chunk *tail_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t chunks_ = 0;
+  std::uint64_t quantity_ = 0;
+  std::uint64_t reserve_ = 0; /*icebergs' hidden quantity*/
+
+  /*first live slot at or after from, kChunkSlots if none*/
+  static unsigned next_live(const Chunk *chunk, unsigned from) {
+    if (from >= kChunkSlots)
+      return kChunkSlots;
+    std::uint32_t mask = chunk->live_mask >> from;
+    return mask == 0 ? kChunkSlots : from + __builtin_ctz(mask);
+  }
+
+  void kill(Chunk *chunk, unsigned slot) {
+    chunk->live_mask &= ~(1u << slot);
+    --size_;
+    quantity_ -= chunk->slots[slot].order.get_remaining_quantity();
+    reserve_ -= chunk->slots[slot].order.get_hidden_quantity();
+    if (chunk->live_mask == 0)
+      unlink_chunk(chunk);
+  }
+
+  void append_chunk() {
+    void *memory = pool_ != nullptr && pool_->accepts(sizeof(Chunk),
+                                                      alignof(Chunk))
+                       ? pool_->allocate(sizeof(Chunk), alignof(Chunk))
+                       : ::operator new(sizeof(Chunk));
+    Chunk *chunk = new (memory) Chunk();
+    chunk->prev = tail_;
+    if (tail_ != nullptr)
+      tail_->next = chunk;
+    else
+      head_ = chunk;
+    tail_ = chunk;
+    ++chunks_;
+  }
+
+  void unlink_chunk(Chunk *chunk) {
+    if (chunk->prev != nullptr)
+      chunk->prev->next = chunk->next;
+    else
+      head_ = chunk->next;
+    if (chunk->next != nullptr)
+      chunk->next->prev = chunk->prev;
+    else
+      tail_ = chunk->prev;
+    --chunks_;
+    free_chunk(chunk);
+  }
+
+  void free_chunk(Chunk *chunk) {
+    chunk->~Chunk();
+    if (pool_ != nullptr && pool_->accepts(sizeof(Chunk), alignof(Chunk)))
+      pool_->deallocate(chunk, sizeof(Chunk), alignof(Chunk));
+    else
+      ::operator delete(chunk);
+  }
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef YINHE_SRC_ENGINE_TRADEUTILS_TRADE_H
 #define YINHE_SRC_ENGINE_TRADEUTILS_TRADE_H
 
+#include <vector>
+
 #include "order.hpp"
 
 //store side of trade
@@ -29,4 +31,20 @@ private:
 };
 
 using Trades = std::vector<Trade>;
+
+//trades of a command batch: one buffer for the whole batch in command order,
+//and where each command's trades end. reused batch after batch, so it stops
+//allocating once it has grown to the largest batch
+struct TradeSink {
+    Trades trades;
+    std::vector<std::size_t> ends; //command i made trades [ends[i-1], ends[i])
+
+    void clear() noexcept {
+        trades.clear();
+        ends.clear();
+    }
+    std::size_t first_trade(std::size_t command) const noexcept {
+        return command == 0 ? 0 : ends[command - 1];
+    }
+};
 #endif
\ No newline at end of file
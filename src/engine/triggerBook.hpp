@@ -0,0 +1,126 @@
+#ifndef YINHE_SRC_ENGINE_TRIGGERBOOK_H
+#define YINHE_SRC_ENGINE_TRIGGERBOOK_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "nodePool.hpp"
+#include "order.hpp"
+#include "priceLevel.hpp"
+#include "types.hpp"
+
+/*
+ * stop and stop-limit orders waiting for the market to reach their trigger
+ * price. they are held apart from the book: invisible to matching, depth and
+ * the L3 feed until they fire
+ *
+ * a buy stop fires once a trade prints at or above its trigger, a sell stop at
+ * or below. each side maps trigger price to a FIFO of stops, ordered so the
+ * triggers the market reaches first come first (ascending for buys,
+ * descending for sells). the stops a trade crossed are then a range scan from
+ * begin() that ends at the first trigger it did not reach, however many stops
+ * are waiting further away
+ *
+ * released orders come out buys first, nearest trigger first, then in
+ * arrival order, so a cascade fires in the same order on every replay
+ */
+class TriggerBook {
+public:
+  explicit TriggerBook(NodePool *pool = nullptr) : pool_(pool) {}
+
+  bool empty() const noexcept { return index_.empty(); }
+  std::size_t size() const noexcept { return index_.size(); }
+  bool contains(OrderID id) const { return index_.count(id) != 0; }
+
+  void add(Price trigger_price, Order order) {
+    OrderID id = order.get_order_id();
+    if (order.get_order_side() == Side::BUY) {
+      auto &level = level_at(buy_stops_, trigger_price);
+      index_.emplace(id, Entry{trigger_price, level.push_back(order)});
+    } else {
+      auto &level = level_at(sell_stops_, trigger_price);
+      index_.emplace(id, Entry{trigger_price, level.push_back(order)});
+    }
+  }
+
+  /*returns false if no stop with that ID is waiting*/
+  bool cancel(OrderID id) {
+    auto it = index_.find(id);
+    if (it == index_.end())
+      return false;
+    const Entry &entry = it->second;
+    if (entry.itr->get_order_side() == Side::BUY)
+      unlink(buy_stops_, entry);
+    else
+      unlink(sell_stops_, entry);
+    index_.erase(it);
+    return true;
+  }
+
+  /*move every buy stop triggered at or below high and every sell stop
+   * triggered at or above low to the back of out, returns how many*/
+  std::size_t release(Price high, Price low, std::vector<Order> &out) {
+    std::size_t before = out.size();
+    release_side(buy_stops_, high, out);
+    release_side(sell_stops_, low, out);
+    return out.size() - before;
+  }
+
+  void clear() {
+    buy_stops_.clear();
+    sell_stops_.clear();
+    index_.clear();
+  }
+
+  /*f(trigger_price, order) for every waiting stop in release order*/
+  template <typename F> void for_each(F &&f) const {
+    for (const auto &[trigger_price, level] : buy_stops_)
+      for (const auto &order : level)
+        f(trigger_price, order);
+    for (const auto &[trigger_price, level] : sell_stops_)
+      for (const auto &order : level)
+        f(trigger_price, order);
+  }
+
+private:
+  struct Entry {
+    Price trigger_price;
+    ListLevel::handle itr;
+  };
+
+  NodePool *pool_;
+  std::map<Price, ListLevel, std::less<Price>> buy_stops_;
+  std::map<Price, ListLevel, std::greater<Price>> sell_stops_;
+  std::unordered_map<OrderID, Entry> index_;
+
+  template <typename SideMap>
+  ListLevel &level_at(SideMap &side_map, Price trigger_price) {
+    return side_map.try_emplace(trigger_price, pool_).first->second;
+  }
+
+  template <typename SideMap>
+  void unlink(SideMap &side_map, const Entry &entry) {
+    auto map_it = side_map.find(entry.trigger_price);
+    map_it->second.erase(entry.itr);
+    if (map_it->second.empty())
+      side_map.erase(map_it);
+  }
+
+  /*key_comp() orders triggers in the direction the price has to move, so
+   * everything up to the first trigger not yet reached has fired*/
+  template <typename SideMap>
+  void release_side(SideMap &side_map, Price reached, std::vector<Order> &out) {
+    auto last = side_map.upper_bound(reached);
+    for (auto it = side_map.begin(); it != last; ++it)
+      for (const auto &order : it->second) {
+        out.push_back(order);
+        index_.erase(order.get_order_id());
+      }
+    side_map.erase(side_map.begin(), last);
+  }
+};
+
+#endif
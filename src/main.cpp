@@ -3,7 +3,11 @@
 #include "engine/orderbook.hpp"
 
 int main() {
+  OrderbookLogger logger;
+  logger.flush_log_Dir();
+  logger.init_Log();
   Orderbook orderbook;
+  orderbook.attach_logger(&logger);
 
   std::cout << "\n=== 1. Add asks (sell orders) ===" << std::endl;
   (void)orderbook.add_order(Side::SELL, 100, 50, orderType::LIMIT);
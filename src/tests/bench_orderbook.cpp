@@ -2,11 +2,13 @@
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <filesystem>
 #include <iomanip>
 #include <iostream>
 #include <vector>
 
 #include "order.hpp"
+#include "orderFlowGenerator.hpp"
 #include "orderbook.hpp"
 
 static constexpr int MONTE_CARLO_RUNS = 10;
@@ -14,11 +16,10 @@ static constexpr int MONTE_CARLO_RUNS = 10;
 struct RunStats {
   double throughput;
   double avg_ns;
-  int64_t p50;
-  int64_t p95;
-  int64_t p99;
-  int64_t min_val;
-  int64_t max_val;
+  double p50;
+  double p95;
+  double p99;
+  double max_val;
 };
 
 struct MatchRunStats {
@@ -34,32 +35,39 @@ public:
                            Quantity qty,
                            orderType type = orderType::GOODTOCANCEL) {
     auto &level = (side == Side::BUY) ? ob.bids_[price] : ob.asks_[price];
-    level.push_back(Order(side, id, price, qty, type));
-    auto it = std::prev(level.end());
-    ob.orders_.insert({id, orderEntry{it}});
+    auto it = level.push_back(Order(side, id, price, qty, type));
+    ob.orders_.insert(id, {it});
   }
 
   static Trades call_match(Orderbook &ob) { return ob.match(); }
 
-  static void flush_logs(Orderbook &ob) { ob.Logger.flush_log_Dir(); }
-
-  static RunStats compute_stats(std::vector<int64_t> &latencies) {
-    std::sort(latencies.begin(), latencies.end());
-    size_t n = latencies.size();
-    int64_t sum = 0;
-    for (auto v : latencies)
-      sum += v;
+  /*every timed book logs trades like a production book, the file is removed
+   * once the run is over*/
+  struct RunLogger {
+    OrderbookLogger logger;
+    explicit RunLogger(Orderbook &ob) {
+      logger.init_Log();
+      ob.attach_logger(&logger);
+    }
+    ~RunLogger() {
+      logger.close_Log();
+      std::filesystem::remove(logger.get_logfile_location());
+    }
+  };
 
+  /*latency comes from the engine's own histograms, throughput from the wall
+   * time of the whole loop*/
+  static RunStats compute_stats(const LatencyHistogramSnapshot &latency,
+                                double wall_ns) {
     RunStats s{};
-    s.avg_ns = static_cast<double>(sum) / static_cast<double>(n);
-    s.p50 = latencies[n * 50 / 100];
-    s.p95 = latencies[n * 95 / 100];
-    s.p99 = latencies[n * 99 / 100];
-    s.min_val = latencies.front();
-    s.max_val = latencies.back();
-    s.throughput = (sum > 0)
-                       ? static_cast<double>(n) / (static_cast<double>(sum) / 1e9)
-                       : 0.0;
+    s.avg_ns = latency.get_mean_ns();
+    s.p50 = latency.percentile_ns(50);
+    s.p95 = latency.percentile_ns(95);
+    s.p99 = latency.percentile_ns(99);
+    s.max_val = latency.get_max_ns();
+    s.throughput =
+        (wall_ns > 0) ? static_cast<double>(latency.get_count()) / (wall_ns / 1e9)
+                      : 0.0;
     return s;
   }
 
@@ -138,25 +146,20 @@ public:
 
     for (int run = 0; run < MONTE_CARLO_RUNS; ++run) {
       Orderbook ob;
-      std::vector<int64_t> latencies;
-      latencies.reserve(N);
+      RunLogger run_logger(ob);
 
+      auto t0 = std::chrono::high_resolution_clock::now();
       for (int i = 0; i < N; ++i) {
         Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
         Price price = 1000 + (i % 200) - 100;
         Quantity qty = 1 + (i % 50);
-
-        auto t0 = std::chrono::high_resolution_clock::now();
         (void)ob.add_order(side, price, qty, orderType::GOODTOCANCEL);
-        auto t1 = std::chrono::high_resolution_clock::now();
-
-        latencies.push_back(
-            std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
-                .count());
       }
+      auto t1 = std::chrono::high_resolution_clock::now();
 
-      runs.push_back(compute_stats(latencies));
-      flush_logs(ob);
+      runs.push_back(compute_stats(
+          ob.get_latency().add_order.snapshot(),
+          std::chrono::duration<double, std::nano>(t1 - t0).count()));
       std::cout << "  [add_order] run " << (run + 1) << "/" << MONTE_CARLO_RUNS
                 << ": " << std::fixed << std::setprecision(0)
                 << runs.back().throughput << " ops/sec" << std::endl;
@@ -172,6 +175,7 @@ public:
 
     for (int run = 0; run < MONTE_CARLO_RUNS; ++run) {
       Orderbook ob;
+      RunLogger run_logger(ob);
 
       for (int i = 0; i < N; ++i) {
         Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
@@ -180,22 +184,14 @@ public:
         insert_order(ob, side, static_cast<OrderID>(i + 1), price, 10);
       }
 
-      std::vector<int64_t> latencies;
-      latencies.reserve(N);
-
-      for (int i = 0; i < N; ++i) {
-        OrderID id = static_cast<OrderID>(i + 1);
-        auto t0 = std::chrono::high_resolution_clock::now();
-        ob.cancel_order(id);
-        auto t1 = std::chrono::high_resolution_clock::now();
-
-        latencies.push_back(
-            std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
-                .count());
-      }
+      auto t0 = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < N; ++i)
+        ob.cancel_order(static_cast<OrderID>(i + 1));
+      auto t1 = std::chrono::high_resolution_clock::now();
 
-      runs.push_back(compute_stats(latencies));
-      flush_logs(ob);
+      runs.push_back(compute_stats(
+          ob.get_latency().cancel_order.snapshot(),
+          std::chrono::duration<double, std::nano>(t1 - t0).count()));
       std::cout << "  [cancel_order] run " << (run + 1) << "/"
                 << MONTE_CARLO_RUNS << ": " << std::fixed
                 << std::setprecision(0) << runs.back().throughput << " ops/sec"
@@ -212,6 +208,7 @@ public:
 
     for (int run = 0; run < MONTE_CARLO_RUNS; ++run) {
       Orderbook ob;
+      RunLogger run_logger(ob);
 
       for (int i = 0; i < N; ++i) {
         Price price = 1000 + (i % 100);
@@ -242,7 +239,6 @@ public:
                                (static_cast<double>(total_ns) / 1e9);
 
       runs.push_back(s);
-      flush_logs(ob);
       std::cout << "  [match] run " << (run + 1) << "/" << MONTE_CARLO_RUNS
                 << ": " << std::fixed << std::setprecision(0) << s.throughput
                 << " trades/sec" << std::endl;
@@ -251,6 +247,141 @@ public:
     print_match_summary(runs);
     return runs;
   }
+
+  /*production-shaped flow from OrderFlowGenerator, timed per command. flow
+   * is generated up front so only the engine is measured*/
+  static std::vector<RunStats> bench_synthetic_flow(const char *name,
+                                                    OrderFlowConfig config) {
+    const int N = 1'000'000;
+    std::vector<RunStats> runs;
+
+    for (int run = 0; run < MONTE_CARLO_RUNS; ++run) {
+      config.seed = 42 + static_cast<std::uint64_t>(run);
+      OrderFlowGenerator gen(config);
+      std::vector<JournalRecord> records = gen.generate(N);
+      Orderbook ob;
+      RunLogger run_logger(ob);
+      LatencyHistogram latency;
+
+      auto t0 = std::chrono::high_resolution_clock::now();
+      for (const auto &record : records) {
+        std::uint64_t start = LatencyClock::now();
+        (void)ob.apply_command(record);
+        latency.record(LatencyClock::now() - start);
+      }
+      auto t1 = std::chrono::high_resolution_clock::now();
+
+      runs.push_back(compute_stats(
+          latency.snapshot(),
+          std::chrono::duration<double, std::nano>(t1 - t0).count()));
+      std::cout << "  [" << name << "] run " << (run + 1) << "/"
+                << MONTE_CARLO_RUNS << ": " << std::fixed
+                << std::setprecision(0) << runs.back().throughput << " ops/sec"
+                << std::endl;
+    }
+
+    print_summary(name, N, runs);
+    return runs;
+  }
+
+  /*record one session of adds, cancels and modifies to a journal, then time
+   * recovery of that journal into fresh books*/
+  static std::vector<double> bench_journal_replay() {
+    const int N = 1'000'000;
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_bench.journal")
+            .string();
+    {
+      Orderbook ob;
+      RunLogger run_logger(ob);
+      CommandJournal journal;
+      journal.open_Journal(path);
+      ob.attach_journal(&journal);
+      for (int i = 0; i < N; ++i) {
+        ob.set_sim_tick(static_cast<SimTick>(i));
+        Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+        Price price = 1000 + (i % 200) - 100;
+        Quantity qty = 1 + (i % 50);
+        if (i % 4 == 3)
+          (void)ob.cancel_order(static_cast<OrderID>(i / 2 + 1));
+        else if (i % 8 == 5)
+          (void)ob.modify_order(static_cast<OrderID>(i / 2 + 1), price, qty);
+        else
+          (void)ob.add_order(side, price, qty, orderType::GOODTOCANCEL);
+      }
+      ob.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+
+    std::vector<JournalRecord> records;
+    CommandJournal::load(path, records);
+    std::vector<double> runs;
+
+    for (int run = 0; run < MONTE_CARLO_RUNS; ++run) {
+      Orderbook ob;
+      RunLogger run_logger(ob);
+      auto t0 = std::chrono::high_resolution_clock::now();
+      std::size_t applied = ob.replay_journal(records);
+      auto t1 = std::chrono::high_resolution_clock::now();
+      double secs =
+          std::chrono::duration<double>(t1 - t0).count();
+      runs.push_back(static_cast<double>(applied) / secs / 1e6);
+      std::cout << "  [journal replay] run " << (run + 1) << "/"
+                << MONTE_CARLO_RUNS << ": " << std::fixed
+                << std::setprecision(2) << runs.back() << " M commands/sec"
+                << std::endl;
+    }
+    std::filesystem::remove(path);
+
+    double sum = 0;
+    for (auto r : runs)
+      sum += r;
+    std::cout << "\n=== journal replay (" << records.size() << " commands x "
+              << runs.size() << " runs) ===" << std::endl;
+    std::cout << "  Throughput:  " << std::fixed << std::setprecision(2)
+              << sum / runs.size() << " M commands/sec" << std::endl;
+    return runs;
+  }
+
+  /*snapshot pause and bulk restore time on a deep resting book*/
+  static void bench_snapshot_restore() {
+    const int N = 500'000;
+    Orderbook ob;
+    for (int i = 0; i < N; ++i) {
+      Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+      Price price = (side == Side::BUY) ? (500 - (i % 200)) : (1500 + (i % 200));
+      insert_order(ob, side, static_cast<OrderID>(i + 1), price, 10);
+    }
+
+    double sum_take = 0, sum_restore = 0;
+    for (int run = 0; run < MONTE_CARLO_RUNS; ++run) {
+      auto t0 = std::chrono::high_resolution_clock::now();
+      BookSnapshot snapshot = ob.take_snapshot();
+      auto t1 = std::chrono::high_resolution_clock::now();
+      Orderbook restored;
+      auto t2 = std::chrono::high_resolution_clock::now();
+      restored.restore_snapshot(snapshot);
+      auto t3 = std::chrono::high_resolution_clock::now();
+      double take_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+      double restore_ms =
+          std::chrono::duration<double, std::milli>(t3 - t2).count();
+      sum_take += take_ms;
+      sum_restore += restore_ms;
+      std::cout << "  [snapshot] run " << (run + 1) << "/" << MONTE_CARLO_RUNS
+                << ": take " << std::fixed << std::setprecision(2) << take_ms
+                << " ms, restore " << restore_ms << " ms" << std::endl;
+    }
+
+    std::cout << "\n=== snapshot/restore (" << N << " resting orders x "
+              << MONTE_CARLO_RUNS << " runs) ===" << std::endl;
+    std::cout << "  Take (pause):  " << std::fixed << std::setprecision(2)
+              << sum_take / MONTE_CARLO_RUNS << " ms" << std::endl;
+    std::cout << "  Restore:       " << std::fixed << std::setprecision(2)
+              << sum_restore / MONTE_CARLO_RUNS << " ms  ("
+              << std::setprecision(0)
+              << N / (sum_restore / MONTE_CARLO_RUNS / 1e3) << " orders/sec)"
+              << std::endl;
+  }
 };
 
 int main() {
@@ -260,6 +391,20 @@ int main() {
   auto add_runs = OrderbookBench::bench_add_order();
   auto cancel_runs = OrderbookBench::bench_cancel_order();
   auto match_runs = OrderbookBench::bench_match_heavy();
+  auto flow_runs =
+      OrderbookBench::bench_synthetic_flow("synthetic flow", OrderFlowConfig{});
+  OrderFlowConfig cancel_heavy;
+  cancel_heavy.cancel_ratio = 0.6;
+  cancel_heavy.modify_ratio = 0.1;
+  auto cancel_heavy_runs =
+      OrderbookBench::bench_synthetic_flow("cancel-heavy flow", cancel_heavy);
+  OrderFlowConfig sweep_heavy;
+  sweep_heavy.cross_ratio = 0.25;
+  sweep_heavy.fok_ratio = 0.2;
+  auto sweep_heavy_runs =
+      OrderbookBench::bench_synthetic_flow("sweep/FOK-heavy flow", sweep_heavy);
+  auto replay_runs = OrderbookBench::bench_journal_replay();
+  OrderbookBench::bench_snapshot_restore();
 
   std::cout << "\n===== Benchmark complete. =====" << std::endl;
   return 0;
@@ -0,0 +1,1107 @@
+/*
+ * bench_suite: scenario benchmarks with machine-readable output
+ *
+ *   bench_suite [--filter substr] [--json out.json] [--repetitions R]
+ *               [--warmup W] [--cpu N]
+ *
+ * every scenario runs W discarded warm-up passes, then R measured passes on
+ * a thread pinned to cpu N (Linux only). results are printed as a table and,
+ * with --json, written as a JSON array so runs can be tracked over time
+ */
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "latencyHistogram.hpp"
+#include "orderFlowGenerator.hpp"
+#include "orderLog.hpp"
+#include "orderbook.hpp"
+#include "priceBitmap.hpp"
+
+/*one measured pass of a scenario*/
+struct PassResult {
+  std::uint64_t ops = 0;
+  double wall_ns = 0;
+  LatencyHistogramSnapshot latency; /*per-op latency, empty if not sampled*/
+};
+
+struct ScenarioResult {
+  std::string name;
+  std::uint64_t ops_per_pass = 0;
+  int repetitions = 0;
+  double ns_per_op_mean = 0;
+  double ns_per_op_stddev = 0;
+  double ops_per_sec_mean = 0;
+  double p50_ns = 0, p99_ns = 0, p999_ns = 0, max_ns = 0;
+};
+
+struct Scenario {
+  std::string name;
+  std::function<PassResult()> run;
+};
+
+class BenchSuite {
+public:
+  void add(std::string name, std::function<PassResult()> run) {
+    scenarios_.push_back(Scenario{std::move(name), std::move(run)});
+  }
+
+  std::vector<ScenarioResult> run_all(const std::string &filter, int warmup,
+                                      int repetitions) {
+    std::vector<ScenarioResult> results;
+    for (auto &scenario : scenarios_) {
+      if (!filter.empty() && scenario.name.find(filter) == std::string::npos)
+        continue;
+      for (int i = 0; i < warmup; ++i)
+        (void)scenario.run();
+      std::vector<PassResult> passes;
+      for (int i = 0; i < repetitions; ++i)
+        passes.push_back(scenario.run());
+      results.push_back(summarise(scenario.name, passes));
+      print_row(results.back());
+    }
+    return results;
+  }
+
+  static void print_header() {
+    std::cout << std::left << std::setw(40) << "scenario" << std::right
+              << std::setw(12) << "ops" << std::setw(12) << "ns/op"
+              << std::setw(10) << "stddev" << std::setw(14) << "ops/sec"
+              << std::setw(10) << "p50" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::endl;
+  }
+
+  static bool write_json(const std::string &path,
+                         const std::vector<ScenarioResult> &results) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open())
+      return false;
+    out << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto &r = results[i];
+      out << "  {\"name\":\"" << r.name << "\",\"ops_per_pass\":"
+          << r.ops_per_pass << ",\"repetitions\":" << r.repetitions
+          << std::fixed << std::setprecision(2)
+          << ",\"ns_per_op\":" << r.ns_per_op_mean
+          << ",\"ns_per_op_stddev\":" << r.ns_per_op_stddev
+          << ",\"ops_per_sec\":" << r.ops_per_sec_mean
+          << ",\"p50_ns\":" << r.p50_ns << ",\"p99_ns\":" << r.p99_ns
+          << ",\"p999_ns\":" << r.p999_ns << ",\"max_ns\":" << r.max_ns << "}"
+          << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+    return static_cast<bool>(out);
+  }
+
+private:
+  std::vector<Scenario> scenarios_;
+
+  static ScenarioResult summarise(const std::string &name,
+                                  const std::vector<PassResult> &passes) {
+    ScenarioResult r;
+    r.name = name;
+    r.repetitions = static_cast<int>(passes.size());
+    r.ops_per_pass = passes.empty() ? 0 : passes[0].ops;
+    std::vector<double> ns_per_op;
+    for (const auto &p : passes) {
+      double v = p.ops ? p.wall_ns / static_cast<double>(p.ops) : 0.0;
+      ns_per_op.push_back(v);
+      r.ns_per_op_mean += v;
+      r.ops_per_sec_mean += v > 0 ? 1e9 / v : 0.0;
+      r.p50_ns += p.latency.percentile_ns(50);
+      r.p99_ns += p.latency.percentile_ns(99);
+      r.p999_ns += p.latency.percentile_ns(99.9);
+      r.max_ns = std::max(r.max_ns, p.latency.get_max_ns());
+    }
+    double n = static_cast<double>(passes.size());
+    r.ns_per_op_mean /= n;
+    r.ops_per_sec_mean /= n;
+    r.p50_ns /= n;
+    r.p99_ns /= n;
+    r.p999_ns /= n;
+    double variance = 0;
+    for (auto v : ns_per_op)
+      variance += (v - r.ns_per_op_mean) * (v - r.ns_per_op_mean);
+    r.ns_per_op_stddev = std::sqrt(variance / n);
+    return r;
+  }
+
+  static void print_row(const ScenarioResult &r) {
+    std::cout << std::left << std::setw(40) << r.name << std::right
+              << std::setw(12) << r.ops_per_pass << std::fixed
+              << std::setprecision(1) << std::setw(12) << r.ns_per_op_mean
+              << std::setw(10) << r.ns_per_op_stddev << std::setprecision(0)
+              << std::setw(14) << r.ops_per_sec_mean << std::setw(10)
+              << r.p50_ns << std::setw(10) << r.p99_ns << std::setw(10)
+              << r.p999_ns << std::endl;
+  }
+};
+
+static bool pin_to_cpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point t0,
+                         std::chrono::steady_clock::time_point t1) {
+  return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+/*books configured with a logger log to a freshly opened one, like a
+ * production book, and the file is removed afterwards*/
+template <typename Book> struct BenchLogger {
+  static constexpr bool enabled =
+      !std::is_same_v<typename Book::logger_type, NullLogger>;
+  typename Book::logger_type logger;
+
+  explicit BenchLogger(Book &ob) {
+    if constexpr (enabled) {
+      logger.init_Log();
+      ob.attach_logger(&logger);
+    }
+  }
+  ~BenchLogger() {
+    if constexpr (enabled) {
+      logger.close_Log();
+      std::filesystem::remove(logger.get_logfile_location());
+    }
+  }
+};
+
+/*non-crossing book: bids on levels 999 down, asks on 1001 up*/
+static void build_resting_book(Orderbook &ob, std::size_t orders,
+                               std::size_t levels_per_side) {
+  for (std::size_t i = 0; i < orders; ++i) {
+    Price offset = static_cast<Price>(1 + (i / 2) % levels_per_side);
+    if (i % 2 == 0)
+      (void)ob.add_order(Side::BUY, 1000 - offset, 10, orderType::GOODTOCANCEL);
+    else
+      (void)ob.add_order(Side::SELL, 1000 + offset, 10,
+                         orderType::GOODTOCANCEL);
+  }
+}
+
+/* ==================== scenarios ==================== */
+
+/*add latency with N orders already resting*/
+static PassResult depth_add(std::size_t depth) {
+  const std::size_t OPS = 100'000;
+  Orderbook ob;
+  BenchLogger<Orderbook> bench_logger(ob);
+  build_resting_book(ob, depth, 100);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+    Price offset = static_cast<Price>(1 + (i * 7) % 100);
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.add_order(side, side == Side::BUY ? 1000 - offset : 1000 + offset,
+                       10, orderType::GOODTOCANCEL);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*cancel latency picking scattered IDs out of N resting orders*/
+static PassResult depth_cancel(std::size_t depth) {
+  const std::size_t OPS = std::min<std::size_t>(100'000, depth);
+  Orderbook ob;
+  BenchLogger<Orderbook> bench_logger(ob);
+  build_resting_book(ob, depth, 100);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    OrderID id = static_cast<OrderID>(1 + (i * 7919) % depth);
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.cancel_order(id);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*rejected FOK that has to scan every ask level before giving up*/
+static PassResult level_fok_scan(std::size_t levels) {
+  const std::size_t OPS = 2'000;
+  Orderbook ob;
+  BenchLogger<Orderbook> bench_logger(ob);
+  build_resting_book(ob, levels * 2, levels);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.add_order(Side::BUY, 1000 + static_cast<Price>(levels),
+                       static_cast<Quantity>(levels * 10 + 1),
+                       orderType::FILLORKILL);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*rejected FOK walking every order of one deep level*/
+template <typename Book = Orderbook>
+static PassResult level_walk(std::size_t orders) {
+  const std::size_t OPS = 2'000;
+  Book ob;
+  for (std::size_t i = 0; i < orders; ++i)
+    (void)ob.add_order(Side::SELL, 1001, 10, orderType::GOODTOCANCEL);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.add_order(Side::BUY, 1001, static_cast<Quantity>(orders * 10 + 1),
+                       orderType::FILLORKILL);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*one aggressive buy sweeping K ask levels, book rebuilt between sweeps*/
+template <typename Book = Orderbook>
+static PassResult sweep(std::size_t levels) {
+  const std::size_t SWEEPS = 200;
+  LatencyHistogram latency;
+  double wall = 0;
+  for (std::size_t s = 0; s < SWEEPS; ++s) {
+    Book ob;
+    BenchLogger<Book> bench_logger(ob);
+    for (std::size_t i = 0; i < levels; ++i)
+      (void)ob.add_order(Side::SELL, 1001 + static_cast<Price>(i), 10,
+                         orderType::GOODTOCANCEL);
+    auto t0 = std::chrono::steady_clock::now();
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.add_order(Side::BUY, 1001 + static_cast<Price>(levels),
+                       static_cast<Quantity>(levels * 10),
+                       orderType::GOODTOCANCEL);
+    latency.record(LatencyClock::now() - start);
+    wall += elapsed_ns(t0, std::chrono::steady_clock::now());
+  }
+  return PassResult{SWEEPS, wall, latency.snapshot()};
+}
+
+/*one depth scan kernel over N contiguous level totals. the target is never
+ * reached so every level is read*/
+static PassResult depth_scan_kernel(const depth_scan::Kernels &kernels,
+                                    std::size_t levels, bool prefix_sum) {
+  const std::size_t OPS = std::max<std::size_t>(1'000, 20'000'000 / levels);
+  std::vector<std::uint64_t> qty(levels), out(levels);
+  for (std::size_t i = 0; i < levels; ++i)
+    qty[i] = 1 + (i * 7) % 100;
+  volatile std::uint64_t sink = 0;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    if (prefix_sum) {
+      kernels.prefix_sum(qty.data(), out.data(), levels);
+      sink = out.back();
+    } else {
+      sink = kernels.cover(qty.data(), levels, ~0ull >> 1).quantity;
+    }
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  (void)sink;
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*best ask level empties, find the next one: a std::map erase + begin()
+ * against a bitmap clear + find_next(). levels are spread over `span` ticks,
+ * every pass pops all of them in price order*/
+static std::vector<std::size_t> occupied_ticks(std::size_t levels,
+                                               std::size_t span) {
+  std::vector<std::size_t> ticks;
+  ticks.reserve(levels);
+  for (std::size_t i = 0; i < levels; ++i)
+    ticks.push_back(i * (span / levels) + (i * 7919) % (span / levels));
+  return ticks;
+}
+
+static PassResult next_level_map(std::size_t levels, std::size_t span) {
+  std::map<Price, std::uint64_t> side;
+  for (std::size_t tick : occupied_ticks(levels, span))
+    side.emplace(static_cast<Price>(tick), tick);
+  volatile Price sink = 0;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  while (!side.empty()) {
+    std::uint64_t start = LatencyClock::now();
+    side.erase(side.begin());
+    if (!side.empty())
+      sink = side.begin()->first;
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  (void)sink;
+  return PassResult{levels, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+static PassResult next_level_bitmap(std::size_t levels, std::size_t span) {
+  PriceBitmap side(span);
+  for (std::size_t tick : occupied_ticks(levels, span))
+    side.set(tick);
+  std::size_t best = side.find_first();
+  volatile std::size_t sink = 0;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  while (best != PriceBitmap::npos) {
+    std::uint64_t start = LatencyClock::now();
+    side.clear(best);
+    best = side.find_next(best);
+    sink = best;
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  (void)sink;
+  return PassResult{levels, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+template <typename Book = Orderbook>
+static PassResult flow(const OrderFlowConfig &config) {
+  const std::size_t OPS = 500'000;
+  OrderFlowGenerator gen(config);
+  std::vector<JournalRecord> records = gen.generate(OPS);
+  Book ob;
+  BenchLogger<Book> bench_logger(ob);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const auto &record : records) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.apply_command(record);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*the default flow through the public API, orders spread over 1k accounts.
+ * with risk every add and modify is checked against finite limits and every
+ * add, fill and cancel keeps exposure, the ns/op difference is that cost*/
+template <typename Book = LeanOrderbook>
+static PassResult risk_flow(bool with_risk) {
+  const std::size_t OPS = 500'000;
+  const std::size_t ACCOUNTS = 1'000;
+  OrderFlowGenerator gen(OrderFlowConfig{});
+  std::vector<JournalRecord> records = gen.generate(OPS);
+  PreTradeRisk risk(ACCOUNTS);
+  RiskLimits limits;
+  limits.max_order_quantity = 1'000'000;
+  limits.max_open_quantity = 1'000'000'000;
+  limits.max_open_notional = 1'000'000'000'000;
+  limits.price_band = 1'000'000;
+  for (AccountID account = 0; account < ACCOUNTS; ++account)
+    risk.set_limits(account, limits);
+  Book ob;
+  if (with_risk)
+    ob.attach_risk(&risk);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const auto &record : records) {
+    Side side = static_cast<Side>(record.side);
+    std::uint64_t start = LatencyClock::now();
+    switch (record.type) {
+    case CommandType::ADD:
+      /*generator IDs count up from 1 like the book's*/
+      (void)ob.add_order(side, record.price, record.quantity,
+                         static_cast<orderType>(record.order_type),
+                         static_cast<AccountID>(record.id % ACCOUNTS));
+      break;
+    case CommandType::CANCEL:
+      (void)ob.cancel_order(record.id);
+      break;
+    case CommandType::MODIFY:
+      (void)ob.modify_order(record.id, record.price, record.quantity);
+      break;
+    default:
+      break;
+    }
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int reason = 1; reason < NUM_RISK_REJECTS; ++reason)
+    if (risk.get_rejects(static_cast<RiskReject>(reason)) != 0)
+      std::cerr << "risk_flow: orders refused" << std::endl;
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*the default flow with every add tagged: accounts = 0 leaves all orders in
+ * one account without an instruction (the check is one compare per
+ * step), otherwise orders are spread over that many accounts and all carry
+ * mode. with one account per order nothing ever self-matches*/
+template <typename Book = LeanOrderbook>
+static PassResult stp_flow(std::uint64_t accounts, StpMode mode) {
+  const std::size_t OPS = 500'000;
+  OrderFlowGenerator gen(OrderFlowConfig{});
+  std::vector<JournalRecord> records = gen.generate(OPS);
+  if (accounts != 0)
+    for (auto &record : records) {
+      record.account = static_cast<AccountID>(record.id % accounts);
+      record.stp_mode = static_cast<std::uint8_t>(mode);
+    }
+  Book ob;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const auto &record : records) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.apply_command(record);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*one market maker's 100k resting orders, sharing 1'000 levels with `others`
+ * orders of other owners, all cancelled in one call. ops are the cancelled
+ * orders: owner lists visit only those, a scan visits the whole index*/
+template <typename Book> static PassResult owner_disconnect(std::size_t others) {
+  const std::size_t OWNED = 100'000;
+  const int ROUNDS = 5;
+  double wall = 0;
+  for (int round = 0; round < ROUNDS; ++round) {
+    Book ob;
+    for (std::size_t i = 0; i < std::max(OWNED, others); ++i) {
+      Side side = i % 2 ? Side::SELL : Side::BUY;
+      Price price = i % 2 ? 1001 + i % 500 : 999 - i % 500;
+      if (i < OWNED)
+        (void)ob.add_order(side, price, 10, orderType::GOODTOCANCEL, 1);
+      if (i < others)
+        (void)ob.add_order(side, price, 10, orderType::GOODTOCANCEL,
+                           static_cast<AccountID>(2 + i % 100));
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::size_t cancelled = ob.cancel_all_for_owner(1);
+    auto t1 = std::chrono::steady_clock::now();
+    if (cancelled != OWNED)
+      std::cerr << "owner_disconnect: orders left behind" << std::endl;
+    wall += elapsed_ns(t0, t1);
+  }
+  return PassResult{OWNED * ROUNDS, wall, {}};
+}
+
+/*the default flow through the single-call API (batch 0) or apply_batch() in
+ * batches of batch commands. ns/op is per command either way, latency is
+ * sampled per call, so per batch when batching*/
+template <typename Book> static PassResult batch_flow(std::size_t batch) {
+  const std::size_t OPS = 500'000;
+  OrderFlowGenerator gen(OrderFlowConfig{});
+  std::vector<JournalRecord> records = gen.generate(OPS);
+  Book ob;
+  BenchLogger<Book> bench_logger(ob);
+  TradeSink sink;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  if (batch == 0) {
+    for (const auto &record : records) {
+      Side side = static_cast<Side>(record.side);
+      std::uint64_t start = LatencyClock::now();
+      ob.set_sim_tick(record.tick);
+      switch (record.type) {
+      case CommandType::ADD:
+        (void)ob.add_order(side, record.price, record.quantity,
+                           static_cast<orderType>(record.order_type));
+        break;
+      case CommandType::CANCEL:
+        (void)ob.cancel_order(record.id);
+        break;
+      case CommandType::MODIFY:
+        (void)ob.modify_order(record.id, record.price, record.quantity);
+        break;
+      default:
+        break;
+      }
+      latency.record(LatencyClock::now() - start);
+    }
+  } else {
+    for (std::size_t i = 0; i < OPS; i += batch) {
+      std::uint64_t start = LatencyClock::now();
+      (void)ob.apply_batch(&records[i], std::min(batch, OPS - i), sink);
+      latency.record(LatencyClock::now() - start);
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*cancel-heavy batches against a book of resting orders far larger than L2:
+ * three cancels of random resting orders for every add that replaces one,
+ * so the book keeps its size. the commands are fixed up front, one per op,
+ * and run 64 to a batch with the look-ahead prefetch distance*/
+template <typename Book>
+static PassResult batch_cancel_heavy(std::size_t resting, std::size_t distance) {
+  const std::size_t OPS = 400'000;
+  const std::size_t LEVELS = 1'000; /*per side, inside the ladder window*/
+  const std::size_t BATCH = 64;
+  Book ob;
+  ob.set_prefetch_distance(distance);
+  std::mt19937_64 rng(42);
+  std::vector<OrderID> live;
+  std::vector<JournalRecord> commands;
+  OrderID next_id = 0;
+  auto add = [&](std::vector<JournalRecord> &out) {
+    JournalRecord record{};
+    record.type = CommandType::ADD;
+    record.id = ++next_id;
+    bool buy = rng() % 2 == 0;
+    Price offset = static_cast<Price>(1 + rng() % LEVELS);
+    record.side = static_cast<std::uint8_t>(buy ? Side::BUY : Side::SELL);
+    record.price = buy ? 100'000 - offset : 100'000 + offset;
+    record.quantity = 10;
+    record.order_type = static_cast<std::uint8_t>(orderType::GOODTOCANCEL);
+    out.push_back(record);
+    live.push_back(record.id);
+  };
+  std::vector<JournalRecord> build;
+  for (std::size_t i = 0; i < resting; ++i)
+    add(build);
+  TradeSink sink;
+  for (std::size_t i = 0; i < build.size(); i += BATCH)
+    (void)ob.apply_batch(&build[i], std::min(BATCH, build.size() - i), sink);
+  for (std::size_t i = 0; i < OPS; ++i) {
+    if (i % 4 == 3) {
+      add(commands);
+      continue;
+    }
+    std::size_t pick = rng() % live.size();
+    JournalRecord record{};
+    record.type = CommandType::CANCEL;
+    record.id = live[pick];
+    commands.push_back(record);
+    live[pick] = live.back();
+    live.pop_back();
+  }
+
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; i += BATCH) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.apply_batch(&commands[i], std::min(BATCH, OPS - i), sink);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  if (ob.get_size() != resting - OPS / 2)
+    std::cerr << "batch_cancel_heavy: book size drifted" << std::endl;
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*add/cancel churn against a 10k order book, for comparing configurations*/
+template <typename Book> static PassResult churn() {
+  const std::size_t OPS = 200'000;
+  const std::size_t DEPTH = 10'000;
+  Book ob;
+  BenchLogger<Book> bench_logger(ob);
+  for (std::size_t i = 0; i < DEPTH; ++i)
+    (void)ob.add_order(i % 2 ? Side::SELL : Side::BUY,
+                       i % 2 ? 1001 + i % 50 : 999 - i % 50, 10,
+                       orderType::GOODTOCANCEL);
+  OrderID oldest = 1;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    if (i % 2 == 0)
+      (void)ob.add_order(i % 4 ? Side::SELL : Side::BUY,
+                         i % 4 ? 1001 + i % 50 : 999 - i % 50, 10,
+                         orderType::GOODTOCANCEL);
+    else
+      (void)ob.cancel_order(oldest++);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*a level of icebergs hit one tranche at a time: every op is a trade plus a
+ * refill that sends the front iceberg to the back of the level*/
+template <typename Book> static PassResult iceberg_refill(std::size_t orders) {
+  const std::size_t OPS = 200'000;
+  Book ob;
+  BenchLogger<Book> bench_logger(ob);
+  for (std::size_t i = 0; i < orders; ++i)
+    (void)ob.add_iceberg_order(Side::SELL, 1001, 100'000'000, 10);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.add_order(Side::BUY, 1001, 10, orderType::FILLANDKILL);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*one sell that sets off N stop-market sells, each printing on the next bid
+ * down and so reaching the next trigger. the book is rebuilt between
+ * cascades, the latency is the whole cascade*/
+template <typename Book = LeanOrderbook>
+static PassResult stop_cascade(std::size_t stops) {
+  const std::size_t CASCADES = std::max<std::size_t>(10, 200'000 / stops);
+  const Price TOP = 1'000'000;
+  LatencyHistogram latency;
+  double wall = 0;
+  for (std::size_t c = 0; c < CASCADES; ++c) {
+    Book ob;
+    BenchLogger<Book> bench_logger(ob);
+    for (std::size_t i = 0; i <= stops; ++i)
+      (void)ob.add_order(Side::BUY, TOP - static_cast<Price>(i), 1,
+                         orderType::GOODTOCANCEL);
+    for (std::size_t i = 0; i < stops; ++i)
+      (void)ob.add_stop_order(Side::SELL, TOP - static_cast<Price>(i), 0, 1,
+                              orderType::MARKET);
+    auto t0 = std::chrono::steady_clock::now();
+    std::uint64_t start = LatencyClock::now();
+    Trades trades = ob.add_order(Side::SELL, TOP, 1, orderType::GOODTOCANCEL);
+    latency.record(LatencyClock::now() - start);
+    wall += elapsed_ns(t0, std::chrono::steady_clock::now());
+    if (trades.size() != stops + 1 || ob.get_stop_count() != 0)
+      std::cerr << "stop_cascade: cascade stopped early" << std::endl;
+  }
+  return PassResult{CASCADES, wall, latency.snapshot()};
+}
+
+/*default flow with N stops waiting far from the market: the per-trade
+ * trigger check is a range scan, so it should not grow with N*/
+template <typename Book = LeanOrderbook>
+static PassResult flow_with_idle_stops(std::size_t stops) {
+  const std::size_t OPS = 500'000;
+  OrderFlowConfig config;
+  OrderFlowGenerator gen(config);
+  std::vector<JournalRecord> records = gen.generate(OPS);
+  Book ob;
+  BenchLogger<Book> bench_logger(ob);
+  /*IDs past the generator's so both streams can share the book*/
+  OrderID id = OPS + 1;
+  for (std::size_t i = 0; i < stops; ++i) {
+    JournalRecord stop{};
+    stop.type = CommandType::ADD_STOP;
+    stop.id = id++;
+    stop.side = static_cast<std::uint8_t>(i % 2 ? Side::SELL : Side::BUY);
+    stop.price = i % 2 ? 1 : 1'000'000;
+    stop.trigger_price = i % 2 ? 1 + static_cast<Price>(i % 1'000)
+                               : 1'000'000 - static_cast<Price>(i % 1'000);
+    stop.quantity = 1;
+    stop.order_type = static_cast<std::uint8_t>(orderType::GOODTOCANCEL);
+    (void)ob.apply_command(stop);
+  }
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const auto &record : records) {
+    std::uint64_t start = LatencyClock::now();
+    (void)ob.apply_command(record);
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*the BBO moves on every command while N pegged orders rest behind it. they
+ * sit in a few offset buckets priced when matched, so nothing walks them
+ * and the cost per move should not grow with N*/
+template <typename Book = LeanOrderbook>
+static PassResult peg_bbo_moves(std::size_t pegs) {
+  const std::size_t MOVES = 200'000;
+  Book ob;
+  (void)ob.add_order(Side::BUY, 1'000, 100, orderType::GOODTOCANCEL);
+  (void)ob.add_order(Side::SELL, 1'020, 100, orderType::GOODTOCANCEL);
+  for (std::size_t i = 0; i < pegs; ++i) {
+    Side side = i % 2 ? Side::SELL : Side::BUY;
+    PegType peg = i % 4 < 2 ? PegType::PRIMARY : PegType::MIDPOINT;
+    std::int32_t away = static_cast<std::int32_t>(i % 16) + 1;
+    (void)ob.add_pegged_order(side, peg, side == Side::BUY ? -away : away, 1);
+  }
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < MOVES; ++i) {
+    /*improve the bid, then take the improvement away again*/
+    Price price = 1'001 + static_cast<Price>(i % 8);
+    std::uint64_t start = LatencyClock::now();
+    Trades trades = ob.add_order(Side::BUY, price, 1, orderType::GOODTOCANCEL);
+    (void)ob.cancel_order(pegs + 3 + i);
+    latency.record(LatencyClock::now() - start);
+    if (!trades.empty())
+      std::cerr << "peg_bbo_moves: pegs crossed" << std::endl;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{MOVES, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*N orders collected in an auction, bids and asks overlapping by 200 ticks
+ * of a 1000 tick range. ns/op is per resting order: the price alone only
+ * reads the crossed levels, the uncross also fills every order it trades*/
+template <typename Book = LeanOrderbook>
+static PassResult auction_uncross(std::size_t orders, bool execute) {
+  Book ob;
+  ob.start_auction();
+  std::mt19937_64 rng(orders);
+  for (std::size_t i = 0; i < orders; ++i) {
+    bool buy = i % 2 == 0;
+    Price offset = static_cast<Price>(rng() % 600);
+    (void)ob.add_order(buy ? Side::BUY : Side::SELL,
+                       buy ? 9'500 + offset : 9'900 + offset,
+                       1 + static_cast<Quantity>(rng() % 100),
+                       orderType::GOODTOCANCEL);
+  }
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  std::uint64_t start = LatencyClock::now();
+  std::uint64_t volume = 0;
+  if (execute) {
+    for (const auto &trade : ob.uncross())
+      volume += trade.get_bid_info().quantity_;
+  } else {
+    volume = ob.get_indicative_uncross().volume;
+  }
+  latency.record(LatencyClock::now() - start);
+  auto t1 = std::chrono::steady_clock::now();
+  if (volume == 0)
+    std::cerr << "auction_uncross: nothing crossed" << std::endl;
+  return PassResult{orders, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*buys of 1% of a level of N sells, 50 of them. ns/op is per aggressor:
+ * FIFO only touches the front orders, pro-rata shares every fill over the
+ * whole level*/
+template <typename Book>
+static PassResult allocation_level(std::size_t level_orders) {
+  const std::size_t AGGRESSORS = 50;
+  Book ob;
+  std::mt19937_64 rng(level_orders);
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < level_orders; ++i) {
+    Quantity qty = 1 + static_cast<Quantity>(rng() % 100);
+    total += qty;
+    (void)ob.add_order(Side::SELL, 10'000, qty, orderType::GOODTOCANCEL);
+  }
+  Quantity clip = static_cast<Quantity>(total / 100);
+  LatencyHistogram latency;
+  std::size_t fills = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < AGGRESSORS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    fills += ob.add_order(Side::BUY, 10'000, clip, orderType::GOODTOCANCEL)
+                 .size();
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  if (fills < AGGRESSORS)
+    std::cerr << "allocation_level: aggressors did not trade" << std::endl;
+  return PassResult{AGGRESSORS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*building the books for a 10k symbol universe*/
+template <typename Book> static PassResult startup() {
+  const std::size_t BOOKS = 10'000;
+  std::vector<std::unique_ptr<Book>> books;
+  books.reserve(BOOKS);
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < BOOKS; ++i) {
+    std::uint64_t start = LatencyClock::now();
+    books.push_back(std::make_unique<Book>());
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return PassResult{BOOKS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+/*producer cost of pushing log entries through a queue of the given size
+ * while a consumer drains it*/
+template <std::size_t Capacity> static PassResult queue_capacity() {
+  const std::size_t OPS = 2'000'000;
+  auto queue = std::make_unique<SPSCQueue<LogEntry, Capacity>>();
+  std::atomic<bool> done{false};
+  std::thread consumer([&] {
+    LogEntry entry;
+    volatile std::uint64_t sink = 0;
+    while (!done.load(std::memory_order_acquire)) {
+      while (queue->try_pop(entry))
+        sink = sink + entry.quantity;
+    }
+    while (queue->try_pop(entry))
+      sink = sink + entry.quantity;
+  });
+  LogEntry entry{};
+  entry.type = LogEntryType::TRADE;
+  LatencyHistogram latency;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < OPS; ++i) {
+    entry.quantity = static_cast<Quantity>(i);
+    std::uint64_t start = LatencyClock::now();
+    while (!queue->try_push(entry))
+      std::this_thread::yield();
+    latency.record(LatencyClock::now() - start);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  done.store(true, std::memory_order_release);
+  consumer.join();
+  return PassResult{OPS, elapsed_ns(t0, t1), latency.snapshot()};
+}
+
+static void register_scenarios(BenchSuite &suite) {
+  for (std::size_t depth : {1'000, 10'000, 100'000, 1'000'000}) {
+    suite.add("depth_scaling/add/" + std::to_string(depth),
+              [depth] { return depth_add(depth); });
+    suite.add("depth_scaling/cancel/" + std::to_string(depth),
+              [depth] { return depth_cancel(depth); });
+  }
+  for (std::size_t levels : {10, 100, 1'000, 10'000})
+    suite.add("level_scaling/fok_scan/" + std::to_string(levels),
+              [levels] { return level_fok_scan(levels); });
+  for (const depth_scan::Kernels &kernels : depth_scan::available())
+    for (std::size_t levels : {64, 1'024, 65'536}) {
+      std::string name = std::string(kernels.name);
+      suite.add("depth_scan/" + name + "/cover/" + std::to_string(levels),
+                [kernels, levels] {
+                  return depth_scan_kernel(kernels, levels, false);
+                });
+      suite.add("depth_scan/" + name + "/prefix_sum/" + std::to_string(levels),
+                [kernels, levels] {
+                  return depth_scan_kernel(kernels, levels, true);
+                });
+    }
+  /*dense: every tick occupied. sparse: one level per ~1000 ticks*/
+  for (auto [name, levels, span] :
+       {std::tuple<const char *, std::size_t, std::size_t>{"dense_64k", 65'536,
+                                                            65'536},
+        {"sparse_1k_of_1m", 1'024, 1 << 20},
+        {"sparse_64k_of_16m", 65'536, 1 << 24}}) {
+    suite.add(std::string("next_level/map/") + name,
+              [levels, span] { return next_level_map(levels, span); });
+    suite.add(std::string("next_level/bitmap/") + name,
+              [levels, span] { return next_level_bitmap(levels, span); });
+  }
+  for (std::size_t orders : {100, 1'000, 10'000})
+    suite.add("level_walk/" + std::to_string(orders),
+              [orders] { return level_walk(orders); });
+  for (std::size_t levels : {1, 10, 100, 1'000})
+    suite.add("sweep/" + std::to_string(levels),
+              [levels] { return sweep(levels); });
+
+  OrderFlowConfig fok_heavy;
+  fok_heavy.fok_ratio = 0.4;
+  fok_heavy.cross_ratio = 0.2;
+  OrderFlowConfig cancel_heavy;
+  cancel_heavy.cancel_ratio = 0.65;
+  cancel_heavy.modify_ratio = 0.1;
+  suite.add("flow/default", [] { return flow(OrderFlowConfig{}); });
+  suite.add("flow/fok_heavy", [fok_heavy] { return flow(fok_heavy); });
+  suite.add("flow/cancel_heavy", [cancel_heavy] { return flow(cancel_heavy); });
+  suite.add("risk/off", [] { return risk_flow(false); });
+  suite.add("risk/on", [] { return risk_flow(true); });
+  suite.add("stp/off", [] { return stp_flow(0, StpMode::NONE); });
+  suite.add("stp/no_self_match", [] {
+    return stp_flow(std::numeric_limits<std::uint64_t>::max(),
+                    StpMode::CANCEL_RESTING);
+  });
+  suite.add("stp/self_match_4_accounts",
+            [] { return stp_flow(4, StpMode::CANCEL_RESTING); });
+  suite.add("session/disconnect/scan/alone",
+            [] { return owner_disconnect<Orderbook>(0); });
+  suite.add("session/disconnect/lists/alone",
+            [] { return owner_disconnect<SessionOrderbook>(0); });
+  suite.add("session/disconnect/scan/among_400k",
+            [] { return owner_disconnect<Orderbook>(400'000); });
+  suite.add("session/disconnect/lists/among_400k",
+            [] { return owner_disconnect<SessionOrderbook>(400'000); });
+  /*what keeping the lists costs every add, fill and cancel*/
+  suite.add("session/flow/scan",
+            [] { return stp_flow<Orderbook>(8, StpMode::NONE); });
+  suite.add("session/flow/lists",
+            [] { return stp_flow<SessionOrderbook>(8, StpMode::NONE); });
+  suite.add("batch/binary_log/single_call",
+            [] { return batch_flow<BinaryLogOrderbook>(0); });
+  suite.add("batch/lean/single_call",
+            [] { return batch_flow<LeanOrderbook>(0); });
+  for (std::size_t batch : {16, 64, 256}) {
+    suite.add("batch/binary_log/size_" + std::to_string(batch),
+              [batch] { return batch_flow<BinaryLogOrderbook>(batch); });
+    suite.add("batch/lean/size_" + std::to_string(batch),
+              [batch] { return batch_flow<LeanOrderbook>(batch); });
+  }
+  for (std::size_t distance : {0, 1, 4, 8, 16}) {
+    std::string suffix = "/distance_" + std::to_string(distance);
+    suite.add("prefetch/cancel_heavy/ladder_1m" + suffix, [distance] {
+      return batch_cancel_heavy<LeanLadderOrderbook>(1'000'000, distance);
+    });
+    suite.add("prefetch/cancel_heavy/map_1m" + suffix, [distance] {
+      return batch_cancel_heavy<LeanOrderbook>(1'000'000, distance);
+    });
+    suite.add("prefetch/cancel_heavy/hash_1m" + suffix, [distance] {
+      return batch_cancel_heavy<UnloggedOrderbook>(1'000'000, distance);
+    });
+  }
+  suite.add("logger/text", [] { return flow<Orderbook>(OrderFlowConfig{}); });
+  suite.add("logger/binary",
+            [] { return flow<BinaryLogOrderbook>(OrderFlowConfig{}); });
+  suite.add("logger/off",
+            [] { return flow<UnloggedOrderbook>(OrderFlowConfig{}); });
+
+  /*the same work through every instantiated configuration*/
+  suite.add("config/default/churn", [] { return churn<Orderbook>(); });
+  suite.add("config/binary_log/churn",
+            [] { return churn<BinaryLogOrderbook>(); });
+  suite.add("config/unlogged/churn", [] { return churn<UnloggedOrderbook>(); });
+  suite.add("config/lean/churn", [] { return churn<LeanOrderbook>(); });
+  suite.add("config/default/flow", [] { return flow<Orderbook>(OrderFlowConfig{}); });
+  suite.add("config/lean/flow",
+            [] { return flow<LeanOrderbook>(OrderFlowConfig{}); });
+
+  /*std::list levels against chunked ring levels*/
+  suite.add("level/list/churn", [] { return churn<LeanOrderbook>(); });
+  suite.add("level/ring/churn", [] { return churn<LeanRingOrderbook>(); });
+  suite.add("level/list/flow",
+            [] { return flow<LeanOrderbook>(OrderFlowConfig{}); });
+  suite.add("level/ring/flow",
+            [] { return flow<LeanRingOrderbook>(OrderFlowConfig{}); });
+  suite.add("level/list/cancel_heavy",
+            [cancel_heavy] { return flow<LeanOrderbook>(cancel_heavy); });
+  suite.add("level/ring/cancel_heavy",
+            [cancel_heavy] { return flow<LeanRingOrderbook>(cancel_heavy); });
+  suite.add("level/list/walk_10k",
+            [] { return level_walk<LeanOrderbook>(10'000); });
+  suite.add("level/ring/walk_10k",
+            [] { return level_walk<LeanRingOrderbook>(10'000); });
+  suite.add("level/list/sweep_100", [] { return sweep<LeanOrderbook>(100); });
+  suite.add("level/ring/sweep_100",
+            [] { return sweep<LeanRingOrderbook>(100); });
+
+  /*std::map sides against the ladder, both with ring levels*/
+  OrderFlowConfig stubs;
+  stubs.stub_ratio = 0.05;
+  OrderFlowConfig trending;
+  trending.mid_step = 1.0;
+  trending.max_distance = 3'000;
+  for (auto [name, config] :
+       {std::pair<const char *, OrderFlowConfig>{"flow", OrderFlowConfig{}},
+        {"cancel_heavy", cancel_heavy},
+        {"stub_quotes", stubs},
+        {"trending", trending}}) {
+    suite.add(std::string("storage/map/") + name,
+              [config] { return flow<LeanRingOrderbook>(config); });
+    suite.add(std::string("storage/ladder/") + name,
+              [config] { return flow<LeanLadderOrderbook>(config); });
+  }
+  suite.add("storage/map/churn", [] { return churn<LeanRingOrderbook>(); });
+  suite.add("storage/ladder/churn",
+            [] { return churn<LeanLadderOrderbook>(); });
+  suite.add("storage/map/sweep_100",
+            [] { return sweep<LeanRingOrderbook>(100); });
+  suite.add("storage/ladder/sweep_100",
+            [] { return sweep<LeanLadderOrderbook>(100); });
+
+  /*refills are a splice on list levels, a slot copy on ring levels*/
+  OrderFlowConfig icebergs;
+  icebergs.iceberg_ratio = 0.2;
+  for (std::size_t orders : {1, 64, 4'096}) {
+    suite.add("iceberg/list/refill_" + std::to_string(orders),
+              [orders] { return iceberg_refill<LeanOrderbook>(orders); });
+    suite.add("iceberg/ring/refill_" + std::to_string(orders),
+              [orders] { return iceberg_refill<LeanRingOrderbook>(orders); });
+  }
+  suite.add("iceberg/list/flow",
+            [icebergs] { return flow<LeanOrderbook>(icebergs); });
+  suite.add("iceberg/ring/flow",
+            [icebergs] { return flow<LeanRingOrderbook>(icebergs); });
+
+  for (std::size_t stops : {100, 1'000, 10'000})
+    suite.add("stops/cascade/" + std::to_string(stops),
+              [stops] { return stop_cascade(stops); });
+  for (std::size_t stops : {0, 100'000})
+    suite.add("stops/idle_" + std::to_string(stops) + "/flow",
+              [stops] { return flow_with_idle_stops(stops); });
+
+  OrderFlowConfig pegged;
+  pegged.peg_ratio = 0.2;
+  for (std::size_t pegs : {0, 1'000, 100'000})
+    suite.add("peg/bbo_moves/" + std::to_string(pegs),
+              [pegs] { return peg_bbo_moves(pegs); });
+  suite.add("peg/flow", [pegged] { return flow<LeanOrderbook>(pegged); });
+
+  for (std::size_t orders : {10'000, 1'000'000}) {
+    suite.add("auction/equilibrium/" + std::to_string(orders),
+              [orders] { return auction_uncross(orders, false); });
+    suite.add("auction/uncross/" + std::to_string(orders),
+              [orders] { return auction_uncross(orders, true); });
+  }
+
+  for (std::size_t orders : {1'000, 10'000}) {
+    std::string level = "/level_" + std::to_string(orders);
+    suite.add("allocation/fifo" + level,
+              [orders] { return allocation_level<Orderbook>(orders); });
+    suite.add("allocation/pro_rata" + level,
+              [orders] { return allocation_level<ProRataOrderbook>(orders); });
+    suite.add("allocation/top_pro_rata" + level, [orders] {
+      return allocation_level<TopOrderProRataOrderbook>(orders);
+    });
+  }
+
+  suite.add("startup/10k_books/default", [] { return startup<Orderbook>(); });
+  suite.add("startup/10k_books/lean", [] { return startup<LeanOrderbook>(); });
+
+  suite.add("queue_capacity/1024", [] { return queue_capacity<1024>(); });
+  suite.add("queue_capacity/8192", [] { return queue_capacity<8192>(); });
+  suite.add("queue_capacity/65536", [] { return queue_capacity<65536>(); });
+}
+
+int main(int argc, char **argv) {
+  std::string filter, json_path;
+  int repetitions = 5, warmup = 1, cpu = 0;
+  for (int i = 1; i < argc; ++i) {
+    auto has_value = [&] { return i + 1 < argc; };
+    if (std::strcmp(argv[i], "--filter") == 0 && has_value())
+      filter = argv[++i];
+    else if (std::strcmp(argv[i], "--json") == 0 && has_value())
+      json_path = argv[++i];
+    else if (std::strcmp(argv[i], "--repetitions") == 0 && has_value())
+      repetitions = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--warmup") == 0 && has_value())
+      warmup = std::max(0, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--cpu") == 0 && has_value())
+      cpu = std::atoi(argv[++i]);
+  }
+
+  if (!pin_to_cpu(cpu))
+    std::cerr << "warning: could not pin to cpu " << cpu << std::endl;
+
+  BenchSuite suite;
+  register_scenarios(suite);
+  BenchSuite::print_header();
+  auto results = suite.run_all(filter, warmup, repetitions);
+
+  if (!json_path.empty() && !BenchSuite::write_json(json_path, results)) {
+    std::cerr << "Error writing " << json_path << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,213 @@
+#ifndef YINHE_SRC_TESTS_ORDERFLOWGENERATOR_H
+#define YINHE_SRC_TESTS_ORDERFLOWGENERATOR_H
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "commandJournal.hpp"
+#include "enums.hpp"
+#include "types.hpp"
+
+/*
+ * synthetic order flow shaped like production traffic, shared by the
+ * benchmark and stress tests. commands come out as JournalRecords so they can
+ * be fed through Orderbook::apply_command() or written out for yinhe_replay
+ *
+ *  - arrivals are Poisson: exponential gaps of mean 1/arrival_rate ticks
+ *  - resting prices sit at a power-law distance from a random-walk mid, so
+ *    the book is deep near the touch with a long thin tail
+ *  - a fraction of adds cross the spread with sweep-sized quantities
+ *  - cancels target recently added orders, which is where real cancels land
+ *  - optionally, a share of resting adds are stub quotes far from the market
+ *  - optionally, a share of resting good-till-cancel adds are icebergs
+ *  - optionally, a share of resting good-till-cancel adds are pegged, half
+ *    to the same side's best price and half to the midpoint
+ *
+ * all randomness comes from one seeded mt19937_64 with hand-rolled
+ * distributions, so a seed gives the same flow on every standard library
+ */
+struct OrderFlowConfig {
+  std::uint64_t seed = 42;
+  double arrival_rate = 4.0;   // mean commands per tick
+  Price initial_mid = 10'000;
+  double mid_step = 0.2;       // probability the mid moves one tick per command
+  double distance_alpha = 1.3; // power-law exponent of distance from mid
+  Price max_distance = 500;
+  double cross_ratio = 0.08;   // share of adds priced through the mid
+  double cancel_ratio = 0.35;  // share of commands that are cancels
+  double modify_ratio = 0.05;  // share of commands that are modifies
+  double fok_ratio = 0.05;     // share of adds that are FILLORKILL
+  double fak_ratio = 0.05;     // share of adds that are FILLANDKILL
+  Quantity max_quantity = 100;
+  Quantity sweep_multiplier = 8; // crossing orders are this much larger
+  std::size_t cancel_window = 2'048; // cancels pick among the newest IDs
+  double stub_ratio = 0.0;       // share of resting adds quoted far away
+  Price stub_distance = 1'000'000; // how far from the mid stub quotes sit
+  double iceberg_ratio = 0.0; // share of resting GTC adds that are icebergs,
+                              // sweep-sized and showing a normal clip
+  double peg_ratio = 0.0; // share of resting GTC adds that are pegged, offset
+                          // away from the reference by distance - 1
+};
+
+class OrderFlowGenerator {
+public:
+  explicit OrderFlowGenerator(const OrderFlowConfig &config = OrderFlowConfig{})
+      : config_(config), rng_(config.seed),
+        mid_(static_cast<double>(config.initial_mid)) {}
+
+  JournalRecord next() {
+    time_ += -std::log(1.0 - uniform()) / config_.arrival_rate;
+    walk_mid();
+
+    JournalRecord record{};
+    record.tick = static_cast<SimTick>(time_);
+    double roll = uniform();
+    if (!live_.empty() && roll < config_.cancel_ratio) {
+      record.type = CommandType::CANCEL;
+      record.id = take_recent_id();
+      return record;
+    }
+    if (!live_.empty() && roll < config_.cancel_ratio + config_.modify_ratio) {
+      Side side = uniform() < 0.5 ? Side::BUY : Side::SELL;
+      record.type = CommandType::MODIFY;
+      record.id = live_[pick_recent()];
+      record.side = static_cast<std::uint8_t>(side);
+      record.price = resting_price(side);
+      record.quantity = quantity();
+      auto peg = pegged_.find(record.id);
+      if (peg != pegged_.end()) /*a pegged order moves by offset*/
+        record.price = peg_offset(peg->second);
+      return record;
+    }
+
+    Side side = uniform() < 0.5 ? Side::BUY : Side::SELL;
+    bool crossing = uniform() < config_.cross_ratio;
+    double type_roll = uniform();
+    orderType type = orderType::GOODTOCANCEL;
+    if (type_roll < config_.fok_ratio)
+      type = orderType::FILLORKILL;
+    else if (type_roll < config_.fok_ratio + config_.fak_ratio)
+      type = orderType::FILLANDKILL;
+
+    record.type = CommandType::ADD;
+    record.id = ++last_id_;
+    record.side = static_cast<std::uint8_t>(side);
+    record.order_type = static_cast<std::uint8_t>(type);
+    if (crossing) {
+      record.price = crossing_price(side);
+      record.quantity = quantity() * config_.sweep_multiplier;
+    } else {
+      record.price = resting_price(side);
+      record.quantity = quantity();
+      if (config_.stub_ratio > 0 && uniform() < config_.stub_ratio)
+        record.price = stub_price(side);
+      else if (config_.iceberg_ratio > 0 && type == orderType::GOODTOCANCEL &&
+               uniform() < config_.iceberg_ratio) {
+        record.display_quantity = record.quantity;
+        record.quantity *= config_.sweep_multiplier;
+      } else if (config_.peg_ratio > 0 && type == orderType::GOODTOCANCEL &&
+                 uniform() < config_.peg_ratio) {
+        record.type = CommandType::ADD_PEG;
+        record.peg_type = static_cast<std::uint8_t>(
+            uniform() < 0.5 ? PegType::PRIMARY : PegType::MIDPOINT);
+        record.price = peg_offset(side);
+        pegged_.emplace(record.id, side);
+      }
+    }
+    live_.push_back(record.id);
+    return record;
+  }
+
+  std::vector<JournalRecord> generate(std::size_t count) {
+    std::vector<JournalRecord> records;
+    records.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+      records.push_back(next());
+    return records;
+  }
+
+  Price get_mid() const { return static_cast<Price>(mid_); }
+
+private:
+  OrderFlowConfig config_;
+  std::mt19937_64 rng_;
+  double time_ = 0;
+  double mid_;
+  OrderID last_id_ = 0;
+  std::vector<OrderID> live_; /*IDs issued and not yet cancelled by us*/
+  std::unordered_map<OrderID, Side> pegged_; /*IDs added as pegged orders*/
+
+  double uniform() {
+    return static_cast<double>(rng_() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  void walk_mid() {
+    double roll = uniform();
+    double floor = static_cast<double>(config_.max_distance) + 1;
+    if (roll < config_.mid_step / 2)
+      mid_ += 1;
+    else if (roll < config_.mid_step && mid_ > floor)
+      mid_ -= 1;
+  }
+
+  /*Pareto with x_min = 1, capped at max_distance*/
+  Price distance() {
+    double d = std::pow(1.0 - uniform(), -1.0 / config_.distance_alpha);
+    if (d > config_.max_distance)
+      d = config_.max_distance;
+    return static_cast<Price>(d);
+  }
+
+  /*placeholder quotes nowhere near the market, bids floor at one tick*/
+  Price stub_price(Side side) {
+    Price mid = get_mid();
+    if (side == Side::SELL)
+      return mid + config_.stub_distance;
+    return mid > config_.stub_distance ? mid - config_.stub_distance : 1;
+  }
+
+  Price resting_price(Side side) {
+    Price mid = get_mid();
+    Price d = distance();
+    return side == Side::BUY ? mid - d : mid + d;
+  }
+
+  /*behind the reference, as a journal price (the offset's bit pattern)*/
+  Price peg_offset(Side side) {
+    std::int32_t away = static_cast<std::int32_t>(distance()) - 1;
+    return static_cast<Price>(side == Side::BUY ? -away : away);
+  }
+
+  Price crossing_price(Side side) {
+    Price mid = get_mid();
+    Price d = distance();
+    return side == Side::BUY ? mid + d : mid - d;
+  }
+
+  /*geometric-ish size: many small clips, a few large ones*/
+  Quantity quantity() {
+    double q = std::pow(1.0 - uniform(), -1.0 / 1.5);
+    if (q > config_.max_quantity)
+      q = config_.max_quantity;
+    return static_cast<Quantity>(q);
+  }
+
+  std::size_t pick_recent() {
+    std::size_t window =
+        live_.size() < config_.cancel_window ? live_.size() : config_.cancel_window;
+    return live_.size() - 1 - static_cast<std::size_t>(uniform() * window);
+  }
+
+  OrderID take_recent_id() {
+    std::size_t index = pick_recent();
+    OrderID id = live_[index];
+    live_[index] = live_.back();
+    live_.pop_back();
+    return id;
+  }
+};
+
+#endif
@@ -1,8 +1,24 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
+#include "l3BookBuilder.hpp"
 #include "order.hpp"
+#include "orderFlowGenerator.hpp"
 #include "orderbook.hpp"
+#include "priceBitmap.hpp"
 
 class OrderbookTest {
 public:
@@ -11,9 +27,8 @@ public:
                            Quantity qty,
                            orderType type = orderType::GOODTOCANCEL) {
     auto &level = (side == Side::BUY) ? ob.bids_[price] : ob.asks_[price];
-    level.push_back(Order(side, id, price, qty, type));
-    auto it = std::prev(level.end());
-    ob.orders_.insert({id, orderEntry{it}});
+    auto it = level.push_back(Order(side, id, price, qty, type));
+    ob.orders_.insert(id, {it});
   }
 
   /*helper: call match() directly*/
@@ -385,6 +400,2610 @@ public:
     assert(call_can_fully_fill(ob, Side::BUY, 100, 50));
     std::cout << "PASS: test_can_fully_fill_across_levels" << std::endl;
   }
+
+  /* ==================== L3 event stream tests ==================== */
+
+  static bool same_levels(const levelInfos &a, const levelInfos &b) {
+    if (a.size() != b.size())
+      return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      if (a[i].price != b[i].price || a[i].quantity != b[i].quantity)
+        return false;
+    }
+    return true;
+  }
+
+  static void test_l3_event_sequence() {
+    Orderbook ob;
+    L3Feed feed;
+    ob.attach_l3_feed(&feed);
+    (void)ob.add_order(Side::SELL, 100, 30, orderType::GOODTOCANCEL); /*id 1*/
+    (void)ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL);  /*id 2*/
+    (void)ob.add_order(Side::BUY, 100, 50, orderType::FILLORKILL);    /*id 3*/
+    assert(ob.cancel_order(1) == 0);
+
+    std::vector<L3Event> events;
+    L3Event event;
+    while (feed.poll(event))
+      events.push_back(event);
+
+    assert(events.size() == 6);
+    for (std::size_t i = 0; i < events.size(); ++i)
+      assert(events[i].seq == i + 1);
+    assert(events[0].type == L3EventType::ADD && events[0].id == 1);
+    assert(events[1].type == L3EventType::ADD && events[1].id == 2);
+    /*bid fully filled, ask partially filled at the ask price*/
+    assert(events[2].type == L3EventType::FILL && events[2].id == 2);
+    assert(events[3].type == L3EventType::PARTIAL_FILL && events[3].id == 1);
+    assert(events[3].quantity == 10 && events[3].price == 100);
+    /*FOK for 50 against 20 resting is rejected before it rests*/
+    assert(events[4].type == L3EventType::REJECT && events[4].id == 3);
+    assert(events[5].type == L3EventType::CANCEL && events[5].id == 1);
+    assert(events[5].quantity == 20);
+    std::cout << "PASS: test_l3_event_sequence" << std::endl;
+  }
+
+  static void test_l3_replica_matches_book() {
+    Orderbook ob;
+    L3Feed feed;
+    L3BookBuilder replica;
+    ob.attach_l3_feed(&feed);
+
+    /*the workload is many times the queue: drain between bursts on this
+     * thread, each burst far below capacity, so nothing is dropped however
+     * the scheduler runs*/
+    std::vector<OrderID> resting;
+    for (int i = 0; i < 50'000; ++i) {
+      Side side = (i * 7 % 3 == 0) ? Side::BUY : Side::SELL;
+      Price price = 1000 + (i * 31 % 40) - 20;
+      Quantity qty = 1 + (i * 13 % 25);
+      orderType type =
+          (i % 17 == 0) ? orderType::FILLORKILL : orderType::GOODTOCANCEL;
+      (void)ob.add_order(side, price, qty, type);
+      resting.push_back(static_cast<OrderID>(i + 1));
+      if (i % 5 == 0)
+        (void)ob.cancel_order(resting[(i * 11) % resting.size()]);
+      if (i % 64 == 63)
+        replica.drain(feed);
+    }
+    replica.drain(feed);
+
+    auto live = ob.get_levelInfos();
+    auto rebuilt = replica.get_levelInfos();
+    assert(ob.snapshot_stats().l3_overflows == 0);
+    assert(replica.get_sequence_gaps() == 0);
+    assert(replica.get_last_seq() > L3Feed::capacity());
+    assert(replica.get_size() == ob.get_size());
+    assert(same_levels(live.get_bids(), rebuilt.get_bids()));
+    assert(same_levels(live.get_asks(), rebuilt.get_asks()));
+    std::cout << "PASS: test_l3_replica_matches_book" << std::endl;
+  }
+
+  /*nobody polls: the book carries on, events past the queue's capacity are
+   * counted and the replica finds the gap on the next one it reads*/
+  static void test_l3_full_feed_drops() {
+    Orderbook ob;
+    L3Feed feed;
+    L3BookBuilder replica;
+    ob.attach_l3_feed(&feed);
+    const int ORDERS = 10'000;
+    for (int i = 0; i < ORDERS; ++i)
+      (void)ob.add_order(Side::BUY, 100, 1, orderType::GOODTOCANCEL);
+    std::uint64_t dropped = ORDERS - L3Feed::capacity();
+    assert(ob.get_size() == ORDERS);
+    assert(ob.snapshot_stats().l3_overflows == dropped);
+    assert(replica.drain(feed) == L3Feed::capacity());
+    assert(replica.get_sequence_gaps() == 0);
+    (void)ob.add_order(Side::BUY, 100, 1, orderType::GOODTOCANCEL);
+    replica.drain(feed);
+    assert(replica.get_sequence_gaps() == 1);
+    assert(replica.get_last_seq() == ORDERS + 1);
+    std::cout << "PASS: test_l3_full_feed_drops" << std::endl;
+  }
+
+  /*pegs are not published: a peg's fill shows only as its limit
+   * counterparty's event, the replica has the displayed book alone*/
+  static void test_l3_leaves_out_pegs() {
+    Orderbook ob;
+    L3Feed feed;
+    L3BookBuilder replica;
+    ob.attach_l3_feed(&feed);
+    (void)ob.add_order(Side::BUY, 99, 10, orderType::GOODTOCANCEL);
+    (void)ob.add_order(Side::SELL, 101, 10, orderType::GOODTOCANCEL);
+    (void)ob.add_pegged_order(Side::BUY, PegType::PRIMARY, 0, 5); /*id 3*/
+    Trades trades = ob.add_order(Side::SELL, 99, 12, orderType::GOODTOCANCEL);
+    assert(trades.size() == 2 && trades[0].get_bid_info().orderID_ == 1 &&
+           trades[1].get_bid_info().orderID_ == 3);
+    std::vector<L3Event> events;
+    L3Event event;
+    while (feed.poll(event)) {
+      events.push_back(event);
+      replica.apply(event);
+    }
+    for (const L3Event &e : events)
+      assert(e.id != 3);
+    assert(replica.get_sequence_gaps() == 0);
+    assert(replica.get_size() == ob.get_size() - 1);
+    auto live = ob.get_levelInfos();
+    auto rebuilt = replica.get_levelInfos();
+    assert(same_levels(live.get_bids(), rebuilt.get_bids()));
+    assert(same_levels(live.get_asks(), rebuilt.get_asks()));
+    std::cout << "PASS: test_l3_leaves_out_pegs" << std::endl;
+  }
+
+  /* ==================== command journal tests ==================== */
+
+  static void test_journal_replay_rebuilds_book() {
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_test.journal")
+            .string();
+    Orderbook live;
+    {
+      CommandJournal journal;
+      journal.open_Journal(path);
+      live.attach_journal(&journal);
+      for (int i = 0; i < 20'000; ++i) {
+        live.set_sim_tick(static_cast<SimTick>(i));
+        Side side = (i % 3 == 0) ? Side::BUY : Side::SELL;
+        Price price = 500 + (i * 37 % 30) - 15;
+        orderType type =
+            (i % 11 == 0) ? orderType::FILLORKILL : orderType::GOODTOCANCEL;
+        (void)live.add_order(side, price, 1 + (i % 20), type);
+        if (i % 4 == 0)
+          (void)live.cancel_order(static_cast<OrderID>(i / 2 + 1));
+        if (i % 7 == 0)
+          (void)live.modify_order(static_cast<OrderID>(i / 3 + 1), price,
+                                  5 + (i % 9));
+      }
+      live.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+
+    Orderbook recovered;
+    assert(recovered.recover_from_journal(path) == 0);
+    auto a = live.get_levelInfos();
+    auto b = recovered.get_levelInfos();
+    assert(live.get_size() == recovered.get_size());
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(same_levels(a.get_asks(), b.get_asks()));
+    /*ID generation resumes where the live book left off*/
+    assert(live.gen_order_id() == recovered.gen_order_id());
+    std::filesystem::remove(path);
+    std::cout << "PASS: test_journal_replay_rebuilds_book" << std::endl;
+  }
+
+  static void test_recover_missing_journal() {
+    Orderbook ob;
+    assert(ob.recover_from_journal("does/not/exist.journal") == -1);
+    assert(ob.get_size() == 0);
+    std::cout << "PASS: test_recover_missing_journal" << std::endl;
+  }
+
+  /*the loader checks only the header, a record's enum bytes are checked
+   * before the replay applies any of them*/
+  static void test_recover_refuses_corrupt_journal() {
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_corrupt.journal")
+            .string();
+    Orderbook live;
+    {
+      CommandJournal journal;
+      journal.open_Journal(path);
+      live.attach_journal(&journal);
+      for (int i = 0; i < 10; ++i)
+        (void)live.add_order(Side::BUY, 100 - i, 10, orderType::GOODTOCANCEL);
+      live.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+    {
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(sizeof(JournalHeader) + 5 * sizeof(JournalRecord) +
+                 offsetof(JournalRecord, order_type));
+      file.put(static_cast<char>(9));
+    }
+    Orderbook recovered;
+    assert(recovered.recover_from_journal(path) == -1);
+    assert(recovered.get_size() == 0);
+
+    std::vector<JournalRecord> records;
+    assert(CommandJournal::load(path, records) && records.size() == 10);
+    assert(recovered.replay_journal(records) == 0);
+    assert(recovered.get_size() == 0);
+    assert(recovered.apply_command(records[5]).empty());
+    assert(recovered.get_size() == 0);
+    records[5].order_type = static_cast<std::uint8_t>(orderType::GOODTOCANCEL);
+    assert(recovered.replay_journal(records) == 10);
+    assert(recovered.get_size() == 10);
+    std::filesystem::remove(path);
+    std::cout << "PASS: test_recover_refuses_corrupt_journal" << std::endl;
+  }
+
+  static void test_modify_loses_priority() {
+    Orderbook ob;
+    (void)ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL); /*id 1*/
+    (void)ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL); /*id 2*/
+    Trades none = ob.modify_order(1, 100, 15);
+    assert(none.empty());
+    Trades trades = ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1);
+    /*order 1 was re-queued behind order 2*/
+    assert(trades[0].get_bid_info().orderID_ == 2);
+    assert(ob.get_size() == 1);
+    assert(ob.get_levelInfos().get_bids()[0].quantity == 15);
+    std::cout << "PASS: test_modify_loses_priority" << std::endl;
+  }
+
+  /* ==================== snapshot tests ==================== */
+
+  static void fill_book(Orderbook &ob, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+      ob.set_sim_tick(static_cast<SimTick>(i));
+      Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+      Price price = 1000 + (i * 17 % 60) - 30;
+      (void)ob.add_order(side, price, 1 + (i % 15), orderType::GOODTOCANCEL);
+      if (i % 6 == 0)
+        (void)ob.cancel_order(static_cast<OrderID>(i / 2 + 1));
+    }
+  }
+
+  static void test_snapshot_round_trip() {
+    Orderbook live;
+    fill_book(live, 0, 5'000);
+    BookSnapshot snapshot = live.take_snapshot();
+    /*padding goes to disk zeroed, not as whatever the stack held*/
+    const auto *tail = reinterpret_cast<const unsigned char *>(
+                           &snapshot.orders[0]) +
+                       offsetof(SnapshotOrder, stp_mode) + 1;
+    assert(std::all_of(tail,
+                       reinterpret_cast<const unsigned char *>(
+                           &snapshot.orders[1]),
+                       [](unsigned char byte) { return byte == 0; }));
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_test.snapshot")
+            .string();
+    assert(snapshot.save(path));
+
+    BookSnapshot loaded;
+    assert(loaded.load(path));
+    Orderbook restored;
+    assert(restored.restore_snapshot(loaded) == 0);
+    std::filesystem::remove(path);
+
+    auto a = live.get_levelInfos();
+    auto b = restored.get_levelInfos();
+    assert(live.get_size() == restored.get_size());
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(same_levels(a.get_asks(), b.get_asks()));
+    assert(restored.last_sim_tick == live.last_sim_tick);
+
+    /*time priority survives: the same sweep hits the same orders*/
+    Trades live_trades =
+        live.add_order(Side::BUY, 2000, 500, orderType::GOODTOCANCEL);
+    Trades restored_trades =
+        restored.add_order(Side::BUY, 2000, 500, orderType::GOODTOCANCEL);
+    assert(!live_trades.empty());
+    assert(live_trades.size() == restored_trades.size());
+    for (std::size_t i = 0; i < live_trades.size(); ++i) {
+      assert(live_trades[i].get_ask_info().orderID_ ==
+             restored_trades[i].get_ask_info().orderID_);
+      assert(live_trades[i].get_bid_info().orderID_ ==
+             restored_trades[i].get_bid_info().orderID_);
+    }
+    std::cout << "PASS: test_snapshot_round_trip" << std::endl;
+  }
+
+  static void test_snapshot_then_journal_tail() {
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_tail.journal")
+            .string();
+    Orderbook live;
+    BookSnapshot snapshot;
+    {
+      CommandJournal journal;
+      journal.open_Journal(path);
+      live.attach_journal(&journal);
+      fill_book(live, 0, 3'000);
+      snapshot = live.take_snapshot();
+      fill_book(live, 3'000, 3'000);
+      live.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+
+    /*snapshot covers the first half, only the tail is replayed*/
+    Orderbook recovered;
+    assert(recovered.restore_snapshot(snapshot) == 0);
+    assert(recovered.recover_from_journal(path) == 0);
+    std::filesystem::remove(path);
+
+    auto a = live.get_levelInfos();
+    auto b = recovered.get_levelInfos();
+    assert(live.get_size() == recovered.get_size());
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(same_levels(a.get_asks(), b.get_asks()));
+    assert(live.gen_order_id() == recovered.gen_order_id());
+    std::cout << "PASS: test_snapshot_then_journal_tail" << std::endl;
+  }
+
+  static void test_restore_rejects_inconsistent_snapshot() {
+    Orderbook live;
+    fill_book(live, 0, 100);
+    BookSnapshot snapshot = live.take_snapshot();
+    snapshot.orders.pop_back();
+    Orderbook restored;
+    insert_order(restored, Side::BUY, 1, 100, 10);
+    assert(restored.restore_snapshot(snapshot) == -1);
+    /*book is untouched on failure*/
+    assert(restored.get_size() == 1);
+
+    const BookSnapshot good = live.take_snapshot();
+    assert(good.header.bid_levels > 1 && good.header.ask_levels > 1);
+    BookSnapshot duplicate = good;
+    duplicate.orders[1].id = duplicate.orders[0].id;
+    assert(restored.restore_snapshot(duplicate) == -1);
+    BookSnapshot unordered = good;
+    std::swap(unordered.levels[0].price, unordered.levels[1].price);
+    assert(restored.restore_snapshot(unordered) == -1);
+    BookSnapshot crossed = good;
+    crossed.levels[0].price = crossed.levels[good.header.bid_levels].price;
+    assert(restored.restore_snapshot(crossed) == -1);
+    BookSnapshot bad_type = good;
+    bad_type.orders[0].order_type = 6;
+    assert(restored.restore_snapshot(bad_type) == -1);
+    BookSnapshot bad_stp = good;
+    bad_stp.orders[0].stp_mode = 5;
+    assert(restored.restore_snapshot(bad_stp) == -1);
+    BookSnapshot empty_order = good;
+    empty_order.orders[0].remain_quantity = 0;
+    empty_order.orders[0].hidden_quantity = 0;
+    assert(restored.restore_snapshot(empty_order) == -1);
+    BookSnapshot stale_next = good;
+    stale_next.header.next_order_id = stale_next.orders[0].id - 1;
+    assert(restored.restore_snapshot(stale_next) == -1);
+    /*an ID far past the rest would make a dense index allocate up to it*/
+    LeanOrderbook lean;
+    assert(lean.restore_snapshot(good) == 0);
+    BookSnapshot far_id = good;
+    far_id.orders[0].id = OrderID(1) << 40;
+    far_id.header.next_order_id = far_id.orders[0].id;
+    assert(lean.restore_snapshot(far_id) == -1);
+    assert(lean.get_size() == live.get_size());
+    Orderbook with_stop;
+    (void)with_stop.add_stop_order(Side::BUY, 200, 200, 5,
+                                   orderType::GOODTOCANCEL);
+    BookSnapshot bad_side = with_stop.take_snapshot();
+    assert(restored.restore_snapshot(bad_side) == 0);
+    bad_side.stops[0].side = 2;
+    assert(restored.restore_snapshot(bad_side) == -1);
+    assert(restored.get_stop_count() == 1);
+    assert(restored.restore_snapshot(good) == 0);
+    assert(restored.restore_snapshot(snapshot) == -1);
+    assert(restored.get_size() == live.get_size());
+
+    /*counts the file cannot hold are refused before anything is allocated*/
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_bad.snapshot")
+            .string();
+    BookSnapshot oversized = good;
+    oversized.header.order_count = std::uint64_t(1) << 60;
+    assert(oversized.save(path));
+    BookSnapshot loaded;
+    assert(!loaded.load(path));
+    std::filesystem::remove(path);
+    std::cout << "PASS: test_restore_rejects_inconsistent_snapshot"
+              << std::endl;
+  }
+
+  /* ==================== latency histogram tests ==================== */
+
+  static void test_histogram_bucket_precision() {
+    for (std::uint64_t v : {0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull,
+                            1000ull, 123456ull, 987654321ull}) {
+      int bucket = LatencyHistogram::bucket_of(v);
+      std::uint64_t upper = LatencyHistogram::bucket_upper(bucket);
+      assert(upper >= v);
+      /*within one sub-bucket (1/16) of the recorded value*/
+      assert(upper - v <= v / LatencyHistogram::kSubBuckets);
+      if (bucket > 0)
+        assert(LatencyHistogram::bucket_upper(bucket - 1) < v);
+    }
+    /*huge values clamp into the last bucket instead of overflowing*/
+    assert(LatencyHistogram::bucket_of(~0ull) == LatencyHistogram::kBuckets - 1);
+    std::cout << "PASS: test_histogram_bucket_precision" << std::endl;
+  }
+
+  static void test_histogram_percentiles() {
+    LatencyHistogram histogram;
+    for (std::uint64_t v = 1; v <= 10'000; ++v)
+      histogram.record(v);
+    auto snap = histogram.snapshot();
+    double tick = LatencyClock::ns_per_tick();
+    assert(snap.get_count() == 10'000);
+    /*back to ticks, rounded: ns_per_tick() is calibrated at runtime and the
+     * division does not always land exactly on the bucket bound*/
+    long long p50 = std::llround(snap.percentile_ns(50) / tick);
+    long long p99 = std::llround(snap.percentile_ns(99) / tick);
+    assert(p50 >= 5'000 && p50 <= 5'350);
+    assert(p99 >= 9'900 && p99 <= 10'000);
+    assert(std::llround(snap.get_max_ns() / tick) == 10'000);
+    std::cout << "PASS: test_histogram_percentiles" << std::endl;
+  }
+
+  static void test_latency_readable_while_matching() {
+    Orderbook ob;
+    const int N = 50'000;
+    std::atomic<bool> done{false};
+    std::atomic<bool> monotonic{true};
+    std::thread reader([&] {
+      std::uint64_t last = 0;
+      while (!done.load(std::memory_order_acquire)) {
+        std::uint64_t count = ob.get_latency().add_order.snapshot().get_count();
+        if (count < last)
+          monotonic.store(false);
+        last = count;
+      }
+    });
+    for (int i = 0; i < N; ++i) {
+      Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+      (void)ob.add_order(side, 100 + (i % 7), 1 + (i % 9),
+                         orderType::GOODTOCANCEL);
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+    assert(monotonic.load());
+    assert(ob.get_latency().add_order.snapshot().get_count() == N);
+    /*every add runs match() once*/
+    assert(ob.get_latency().match.snapshot().get_count() == N);
+    std::cout << "PASS: test_latency_readable_while_matching" << std::endl;
+  }
+
+  /* ==================== engine stats tests ==================== */
+
+  static void test_stats_counters() {
+    OrderbookLogger logger;
+    logger.set_logfile_save_location(
+        (std::filesystem::temp_directory_path() / "").string());
+    logger.init_Log();
+    Orderbook ob;
+    ob.attach_logger(&logger);
+    (void)ob.add_order(Side::SELL, 100, 30, orderType::GOODTOCANCEL); /*id 1*/
+    (void)ob.add_order(Side::SELL, 101, 30, orderType::GOODTOCANCEL); /*id 2*/
+    (void)ob.add_order(Side::BUY, 99, 10, orderType::GOODTOCANCEL);   /*id 3*/
+    (void)ob.add_order(Side::BUY, 101, 40, orderType::GOODTOCANCEL);  /*id 4*/
+    (void)ob.add_order(Side::BUY, 101, 500, orderType::FILLORKILL);   /*id 5*/
+    assert(ob.cancel_order(3) == 0);
+    assert(ob.cancel_order(3) == -1);
+
+    EngineStatsSnapshot s = ob.snapshot_stats();
+    assert(s.orders_added[orderType::GOODTOCANCEL] == 4);
+    assert(s.orders_added[orderType::FILLORKILL] == 1);
+    assert(s.get_orders_added() == 5);
+    assert(s.fok_rejects == 1);
+    assert(s.trades == 2);
+    assert(s.traded_quantity == 40);
+    assert(s.cancels == 1 && s.cancel_misses == 1);
+    /*ask 2 has 20 left, bids are empty*/
+    assert(s.resting_orders == 1);
+    assert(s.bid_levels == 0 && s.ask_levels == 1);
+    assert(s.logger_high_water >= 1);
+    ob.attach_logger(nullptr);
+    assert(ob.snapshot_stats().logger_high_water == 0);
+    logger.close_Log();
+    std::filesystem::remove(logger.get_logfile_location());
+    std::cout << "PASS: test_stats_counters" << std::endl;
+  }
+
+  static void test_stats_dump_text_and_json() {
+    Orderbook ob;
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    (void)ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL);
+    EngineStatsSnapshot s = ob.snapshot_stats();
+    auto dir = std::filesystem::temp_directory_path();
+    std::string json_path = (dir / "yinhe_stats.json").string();
+    std::string text_path = (dir / "yinhe_stats.txt").string();
+    assert(s.dump(json_path, true));
+    assert(s.dump(text_path, false));
+
+    std::ifstream json_in(json_path), text_in(text_path);
+    std::stringstream json, text;
+    json << json_in.rdbuf();
+    text << text_in.rdbuf();
+    assert(json.str().front() == '{');
+    assert(json.str().find("\"trades\":1") != std::string::npos);
+    assert(json.str().find("\"good_to_cancel\":2") != std::string::npos);
+    assert(text.str().find("trades: 1\n") != std::string::npos);
+    std::filesystem::remove(json_path);
+    std::filesystem::remove(text_path);
+    std::cout << "PASS: test_stats_dump_text_and_json" << std::endl;
+  }
+
+  static void test_stats_monitor_thread() {
+    Orderbook ob;
+    std::atomic<bool> done{false};
+    std::atomic<bool> monotonic{true};
+    std::thread monitor([&] {
+      EngineStatsSnapshot last = ob.snapshot_stats();
+      while (!done.load(std::memory_order_acquire)) {
+        EngineStatsSnapshot now = ob.snapshot_stats();
+        if (now.trades < last.trades || now.get_orders_added() < last.get_orders_added() ||
+            now.trades_per_sec(last) < 0)
+          monotonic.store(false);
+        last = now;
+      }
+    });
+    for (int i = 0; i < 50'000; ++i) {
+      Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+      (void)ob.add_order(side, 100 + (i % 5), 1 + (i % 9),
+                         orderType::GOODTOCANCEL);
+    }
+    done.store(true, std::memory_order_release);
+    monitor.join();
+    assert(monotonic.load());
+    assert(ob.snapshot_stats().get_orders_added() == 50'000);
+    std::cout << "PASS: test_stats_monitor_thread" << std::endl;
+  }
+
+  /* ==================== policy configuration tests ==================== */
+
+  template <typename Book>
+  static OrderbookLevelInfos run_flow(Book &ob,
+                                      const std::vector<JournalRecord> &records) {
+    for (const auto &record : records)
+      (void)ob.apply_command(record);
+    return ob.get_levelInfos();
+  }
+
+  template <typename Book>
+  static bool agrees_with(const OrderbookLevelInfos &expected,
+                          const std::vector<JournalRecord> &records) {
+    Book ob;
+    OrderbookLevelInfos got = run_flow(ob, records);
+    return same_levels(expected.get_bids(), got.get_bids()) &&
+           same_levels(expected.get_asks(), got.get_asks());
+  }
+
+  static void test_configurations_agree() {
+    OrderFlowConfig cancel_heavy;
+    cancel_heavy.cancel_ratio = 0.6;
+    cancel_heavy.cancel_window = 50'000; /*cancels land mid-level*/
+    OrderFlowConfig wide; /*depth past the ladder window, stubs, fast mid*/
+    wide.max_distance = 3'000;
+    wide.distance_alpha = 0.6;
+    wide.mid_step = 1.0;
+    wide.stub_ratio = 0.02;
+    for (const auto &config : {OrderFlowConfig{}, cancel_heavy, wide}) {
+      OrderFlowGenerator gen(config);
+      std::vector<JournalRecord> records = gen.generate(20'000);
+      Orderbook text;
+      OrderbookLevelInfos expected = run_flow(text, records);
+      assert(agrees_with<UnloggedOrderbook>(expected, records));
+      assert(agrees_with<LeanOrderbook>(expected, records));
+      assert(agrees_with<RingOrderbook>(expected, records));
+      assert(agrees_with<LeanRingOrderbook>(expected, records));
+      assert(agrees_with<LadderOrderbook>(expected, records));
+      assert(agrees_with<LeanLadderOrderbook>(expected, records));
+    }
+    std::cout << "PASS: test_configurations_agree" << std::endl;
+  }
+
+  static void test_disabled_features_compile_away() {
+    static_assert(std::is_empty_v<NullLogger>);
+    static_assert(std::is_empty_v<NoLatency>);
+    static_assert(std::is_empty_v<NoCounters>);
+    assert(sizeof(LeanOrderbook) * 10 < sizeof(Orderbook));
+    LeanOrderbook lean;
+    (void)lean.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    (void)lean.add_order(Side::BUY, 100, 4, orderType::GOODTOCANCEL);
+    /*no counters to read, the snapshot is all zeros*/
+    assert(lean.snapshot_stats().trades == 0);
+    assert(lean.get_size() == 1);
+    std::cout << "PASS: test_disabled_features_compile_away" << std::endl;
+  }
+
+  static void test_dense_index() {
+    DenseIndex<orderEntry<ListLevel>> index;
+    ListLevel level;
+    auto handle =
+        level.push_back(Order(Side::BUY, 5, 100, 10, orderType::GOODTOCANCEL));
+    assert(index.find(5) == nullptr);
+    index.insert(5, {handle});
+    index.insert(2, {handle});
+    assert(index.size() == 2);
+    assert(index.find(5) != nullptr && index.find(5)->itr == handle);
+    assert(index.find(3) == nullptr && index.find(1'000) == nullptr);
+    index.erase(5);
+    index.erase(5);
+    assert(index.size() == 1 && index.find(5) == nullptr);
+    std::size_t visited = 0;
+    index.for_each([&](OrderID id, const orderEntry<ListLevel> &) {
+      assert(id == 2);
+      ++visited;
+    });
+    assert(visited == 1);
+    std::cout << "PASS: test_dense_index" << std::endl;
+  }
+
+  static void test_binary_logger_writes_records() {
+    std::string location;
+    {
+      BinaryOrderbookLogger logger;
+      logger.set_logfile_save_location(
+          (std::filesystem::temp_directory_path() / "").string());
+      logger.init_Log();
+      location = logger.get_logfile_location();
+      BinaryLogOrderbook ob;
+      ob.attach_logger(&logger);
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+      (void)ob.add_order(Side::SELL, 101, 10, orderType::GOODTOCANCEL);
+      (void)ob.add_order(Side::BUY, 101, 20, orderType::GOODTOCANCEL);
+    }
+    assert(std::filesystem::file_size(location) == 2 * sizeof(LogEntry));
+    std::ifstream in(location, std::ios::binary);
+    LogEntry entry{};
+    in.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+    assert(entry.type == LogEntryType::TRADE);
+    assert(entry.id1 == 3 && entry.id2 == 1);
+    assert(entry.price == 100 && entry.quantity == 10);
+    in.close();
+    std::filesystem::remove(location);
+    std::cout << "PASS: test_binary_logger_writes_records" << std::endl;
+  }
+
+  /* ==================== construction tests ==================== */
+
+  /*a book with no logger attached touches neither the filesystem nor
+   * stdout, even when it trades*/
+  static void test_construction_has_no_side_effects() {
+    auto cwd = std::filesystem::current_path();
+    auto dir = std::filesystem::temp_directory_path() / "yinhe_construct";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::filesystem::current_path(dir);
+
+    std::stringstream captured;
+    std::streambuf *old = std::cout.rdbuf(captured.rdbuf());
+    {
+      std::vector<Orderbook> books(1'000);
+      for (auto &ob : books) {
+        (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+        (void)ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL);
+      }
+    }
+    std::cout.rdbuf(old);
+
+    std::filesystem::current_path(cwd);
+    assert(captured.str().empty());
+    assert(std::filesystem::is_empty(dir));
+    std::filesystem::remove_all(dir);
+    std::cout << "PASS: test_construction_has_no_side_effects" << std::endl;
+  }
+
+  /* ==================== order layout tests ==================== */
+
+  static void test_order_is_compact() {
+    static_assert(sizeof(Side) == 1 && sizeof(orderType) == 1);
+    static_assert(sizeof(Order) == 40);
+    Order order(Side::SELL, 7, 101, 50, orderType::FILLORKILL, 0, 3);
+    order.fill(20);
+    assert(order.get_order_side() == Side::SELL);
+    assert(order.get_order_type() == orderType::FILLORKILL);
+    assert(order.get_order_id() == 7 && order.get_order_price() == 101);
+    assert(order.get_account() == 3 && order.get_init_quantity() == 50);
+    assert(order.get_remaining_quantity() == 30);
+    std::cout << "PASS: test_order_is_compact" << std::endl;
+  }
+
+  /*orders added one after another to a level are neighbours in memory*/
+  static void test_level_nodes_are_contiguous() {
+    LeanOrderbook ob;
+    for (int i = 0; i < 8; ++i)
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    const auto &level = ob.asks_.begin()->second;
+    const char *prev = nullptr;
+    std::ptrdiff_t stride = 0;
+    for (const auto &order : level) {
+      const char *at = reinterpret_cast<const char *>(&order);
+      if (prev != nullptr) {
+        if (stride == 0)
+          stride = at - prev;
+        assert(at - prev == stride);
+      }
+      prev = at;
+    }
+    assert(stride > 0 && stride <= 64);
+    assert(ob.node_pool_.get_slab_count() == 1);
+    std::cout << "PASS: test_level_nodes_are_contiguous" << std::endl;
+  }
+
+  static void test_node_pool_reuses_blocks() {
+    NodePool pool(128);
+    bool accepted = pool.accepts(40, 8);
+    assert(accepted);
+    void *a = pool.allocate(40, 8);
+    void *b = pool.allocate(40, 8);
+    assert(static_cast<char *>(b) - static_cast<char *>(a) == 40);
+    pool.deallocate(a, 40, 8);
+    assert(pool.allocate(40, 8) == a);
+    for (int i = 0; i < 1'000; ++i)
+      (void)pool.allocate(40, 8);
+    /*102 blocks (4KB), then 128 per slab*/
+    assert(pool.get_slab_count() == 9);
+
+    /*other sizes get slabs of their own, up to kMaxSizes of them*/
+    accepted = pool.accepts(80, 8);
+    assert(accepted);
+    void *c = pool.allocate(80, 8);
+    assert(pool.get_slab_count() == 10);
+    pool.deallocate(c, 80, 8);
+    assert(pool.allocate(80, 8) == c && pool.allocate(40, 8) != c);
+    for (std::size_t bytes : {120, 160})
+      (void)pool.accepts(bytes, 8);
+    accepted = pool.accepts(200, 8);
+    assert(!accepted);
+
+    /*a ring book whose first node is a stop still pools its chunks*/
+    RingOrderbook ring;
+    (void)ring.add_stop_order(Side::BUY, 110, 111, 5, orderType::GOODTOCANCEL);
+    std::size_t slabs = ring.node_pool_.get_slab_count();
+    (void)ring.add_order(Side::SELL, 120, 10, orderType::GOODTOCANCEL);
+    assert(ring.node_pool_.get_slab_count() == slabs + 1);
+
+    /*a list without a pool still works*/
+    order_list plain;
+    plain.emplace_back(Side::BUY, 1, 100, 10, orderType::GOODTOCANCEL);
+    assert(plain.front().get_order_id() == 1);
+    std::cout << "PASS: test_node_pool_reuses_blocks" << std::endl;
+  }
+
+  /* ==================== ring level tests ==================== */
+
+  static std::vector<OrderID> level_ids(const RingLevel &level) {
+    std::vector<OrderID> ids;
+    for (const auto &order : level)
+      ids.push_back(order.get_order_id());
+    return ids;
+  }
+
+  static void test_ring_level_fifo_and_tombstones() {
+    NodePool pool;
+    RingLevel level(&pool);
+    std::vector<RingLevel::handle> handles;
+    for (OrderID id = 1; id <= 100; ++id)
+      handles.push_back(
+          level.push_back(Order(Side::BUY, id, 100, 10, orderType::GOODTOCANCEL)));
+    assert(level.size() == 100 && level.get_chunk_count() == 4);
+
+    /*middle cancels leave tombstones, the other handles stay valid*/
+    for (OrderID id = 2; id <= 100; id += 3)
+      level.erase(handles[id - 1]);
+    assert(handles[0]->get_order_id() == 1 && handles[99]->get_order_id() == 100);
+    std::vector<OrderID> ids = level_ids(level);
+    assert(ids.size() == level.size());
+    for (std::size_t i = 1; i < ids.size(); ++i)
+      assert(ids[i] > ids[i - 1] && ids[i] % 3 != 2);
+
+    /*a chunk whose orders are all gone is released*/
+    for (OrderID id = 33; id <= 64; ++id)
+      if (id % 3 != 2)
+        level.erase(handles[id - 1]);
+    assert(level.get_chunk_count() == 3);
+
+    /*front skips tombstones and crosses chunks*/
+    assert(level.front().get_order_id() == 1);
+    level.pop_front();
+    assert(level.front().get_order_id() == 3);
+    std::size_t popped = 0;
+    while (!level.empty()) {
+      level.fill(level.front(), level.front().get_remaining_quantity());
+      level.pop_front();
+      ++popped;
+    }
+    assert(popped == ids.size() - 1 - 22 && level.get_chunk_count() == 0);
+    assert(level.get_quantity() == 0);
+    std::cout << "PASS: test_ring_level_fifo_and_tombstones" << std::endl;
+  }
+
+  static void test_ring_level_compaction() {
+    RingLevel level;
+    std::vector<RingLevel::handle> handles;
+    for (OrderID id = 1; id <= 320; ++id)
+      handles.push_back(
+          level.push_back(Order(Side::SELL, id, 100, id, orderType::GOODTOCANCEL)));
+    /*keep one order per chunk*/
+    for (OrderID id = 1; id <= 320; ++id)
+      if (id % 32 != 5)
+        level.erase(handles[id - 1]);
+    assert(level.size() == 10 && level.get_chunk_count() == 10);
+    assert(level.needs_compaction());
+
+    std::vector<std::pair<OrderID, RingLevel::handle>> moved;
+    level.compact([&](OrderID id, RingLevel::handle h) { moved.push_back({id, h}); });
+    assert(level.get_chunk_count() == 1 && !level.needs_compaction());
+    assert(moved.size() == 10);
+    for (std::size_t i = 0; i < moved.size(); ++i) {
+      OrderID id = 32 * i + 5;
+      assert(moved[i].first == id);
+      assert(moved[i].second->get_order_id() == id);
+      assert(moved[i].second->get_remaining_quantity() == id);
+    }
+    std::vector<OrderID> ids = level_ids(level);
+    assert(ids.size() == 10 && ids.front() == 5 && ids.back() == 293);
+    std::cout << "PASS: test_ring_level_compaction" << std::endl;
+  }
+
+  /*the book keeps its index right when a cancel triggers compaction*/
+  static void test_ring_book_cancel_after_compaction() {
+    RingOrderbook ob;
+    for (int i = 0; i < 320; ++i)
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    for (OrderID id = 1; id <= 320; ++id)
+      if (id % 32 != 5)
+        assert(ob.cancel_order(id) == 0);
+    assert(ob.get_size() == 10);
+    assert(ob.asks_.begin()->second.get_chunk_count() < 10);
+    assert(ob.cancel_order(37) == 0);
+    assert(ob.cancel_order(37) == -1);
+    Trades trades = ob.add_order(Side::BUY, 100, 90, orderType::GOODTOCANCEL);
+    assert(trades.size() == 9);
+    assert(trades.front().get_ask_info().orderID_ == 5);
+    assert(trades.back().get_ask_info().orderID_ == 293);
+    assert(ob.get_size() == 0);
+    std::cout << "PASS: test_ring_book_cancel_after_compaction" << std::endl;
+  }
+
+  /* ==================== depth scan tests ==================== */
+
+  static void test_depth_scan_kernels_agree() {
+    std::vector<depth_scan::Kernels> kernels = depth_scan::available();
+    assert(std::string(kernels.front().name) == "scalar");
+    std::mt19937_64 rng(38);
+    for (std::size_t n = 0; n <= 70; ++n) {
+      std::vector<std::uint64_t> qty(n);
+      for (auto &q : qty)
+        q = rng() % 1000;
+      std::vector<std::uint64_t> expected(n), got(n);
+      depth_scan::prefix_sum_scalar(qty.data(), expected.data(), n);
+      std::uint64_t total = n == 0 ? 0 : expected.back();
+      std::vector<std::uint64_t> targets = {0, 1, total, total + 1,
+                                            total / 2 + 1};
+      for (std::size_t i = 0; i < n; i += 3)
+        targets.push_back(expected[i]); /*lands exactly on a level*/
+      for (const auto &k : kernels) {
+        std::fill(got.begin(), got.end(), 0);
+        k.prefix_sum(qty.data(), got.data(), n);
+        assert(got == expected);
+        for (std::uint64_t target : targets) {
+          depth_scan::DepthCover want =
+              depth_scan::cover_scalar(qty.data(), n, target);
+          depth_scan::DepthCover have = k.cover(qty.data(), n, target);
+          assert(have.levels == want.levels && have.quantity == want.quantity);
+        }
+      }
+    }
+    std::cout << "PASS: test_depth_scan_kernels_agree ("
+              << depth_scan::active().name << ")" << std::endl;
+  }
+
+  static void test_depth_to_cover_both_sides() {
+    UnloggedOrderbook ob;
+    /*100 levels a side, level k holds k*10, more than one scan batch*/
+    for (Price k = 1; k <= 100; ++k) {
+      for (Quantity part = 0; part < k; ++part)
+        (void)ob.add_order(Side::SELL, 1000 + k, 10, orderType::GOODTOCANCEL);
+      (void)ob.add_order(Side::BUY, 1000 - k, 10 * k, orderType::GOODTOCANCEL);
+    }
+    depth_scan::DepthCover cover = ob.get_depth_to_cover(Side::BUY, 1100, 60);
+    assert(cover.levels == 3 && cover.quantity == 60);
+    cover = ob.get_depth_to_cover(Side::BUY, 1100, 61);
+    assert(cover.levels == 4 && cover.quantity == 100);
+    cover = ob.get_depth_to_cover(Side::BUY, 1100, 50'500);
+    assert(cover.levels == 100 && cover.quantity == 50'500);
+    /*the limit price stops the scan*/
+    cover = ob.get_depth_to_cover(Side::BUY, 1070, 50'500);
+    assert(cover.levels == 70 && cover.quantity == 24'850);
+    cover = ob.get_depth_to_cover(Side::SELL, 930, 50'500);
+    assert(cover.levels == 70 && cover.quantity == 24'850);
+    cover = ob.get_depth_to_cover(Side::SELL, 999, 10);
+    assert(cover.levels == 1 && cover.quantity == 10);
+    assert(ob.get_depth_to_cover(Side::SELL, 1000, 10).levels == 0);
+    /*every cut, across the scalar head and the growing batches*/
+    for (std::uint64_t k = 1; k < 100; ++k) {
+      std::uint64_t through_k = 10 * k * (k + 1) / 2;
+      cover = ob.get_depth_to_cover(Side::BUY, 1100, through_k);
+      assert(cover.levels == k && cover.quantity == through_k);
+      cover = ob.get_depth_to_cover(Side::BUY, 1100, through_k + 1);
+      assert(cover.levels == k + 1);
+    }
+
+    assert(ob.can_fully_fill(Side::BUY, 1070, 24'850));
+    assert(!ob.can_fully_fill(Side::BUY, 1070, 24'851));
+    Trades trades = ob.add_order(Side::BUY, 1070, 24'851, orderType::FILLORKILL);
+    assert(trades.empty());
+    trades = ob.add_order(Side::BUY, 1070, 24'850, orderType::FILLORKILL);
+    assert(ob.asks_.begin()->first == 1071);
+    std::cout << "PASS: test_depth_to_cover_both_sides" << std::endl;
+  }
+
+  template <typename Book> static bool level_totals_exact(Book &ob) {
+    auto exact = [](const auto &side) {
+      for (const auto &[price, level] : side) {
+        std::uint64_t sum = 0, reserve = 0;
+        for (const auto &order : level) {
+          sum += order.get_remaining_quantity();
+          reserve += order.get_hidden_quantity();
+        }
+        if (sum != level.get_quantity() ||
+            sum + reserve != level.get_total_quantity())
+          return false;
+      }
+      return true;
+    };
+    return exact(ob.bids_) && exact(ob.asks_);
+  }
+
+  /*partial fills, cancels, modifies and compaction all keep the totals*/
+  static void test_level_quantity_tracks_fills() {
+    OrderFlowConfig config;
+    config.cancel_ratio = 0.5;
+    config.cross_ratio = 0.3;
+    config.iceberg_ratio = 0.2; /*reserve totals too*/
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    UnloggedOrderbook list;
+    LeanRingOrderbook ring;
+    (void)run_flow(list, records);
+    (void)run_flow(ring, records);
+    assert(level_totals_exact(list));
+    assert(level_totals_exact(ring));
+
+    BookSnapshot snapshot = list.take_snapshot();
+    UnloggedOrderbook restored;
+    assert(restored.restore_snapshot(snapshot) == 0);
+    assert(level_totals_exact(restored));
+    std::cout << "PASS: test_level_quantity_tracks_fills" << std::endl;
+  }
+
+  /* ==================== price bitmap tests ==================== */
+
+  static void test_price_bitmap_edges() {
+    PriceBitmap bitmap(1'000'000);
+    assert(bitmap.empty());
+    assert(bitmap.find_first() == PriceBitmap::npos);
+    assert(bitmap.find_last() == PriceBitmap::npos);
+    for (std::size_t slot : {0ul, 63ul, 64ul, 4'095ul, 4'096ul, 999'999ul})
+      bitmap.set(slot);
+    assert(!bitmap.empty() && bitmap.test(4'095) && !bitmap.test(4'094));
+    assert(bitmap.find_first() == 0 && bitmap.find_last() == 999'999);
+    assert(bitmap.find_next(1) == 63 && bitmap.find_next(65) == 4'095);
+    assert(bitmap.find_next(4'097) == 999'999);
+    assert(bitmap.find_next(1'000'000) == PriceBitmap::npos);
+    assert(bitmap.find_prev(999'998) == 4'096 && bitmap.find_prev(62) == 0);
+    assert(bitmap.find_prev(5'000'000) == 999'999);
+    bitmap.clear(0);
+    bitmap.clear(999'999);
+    assert(bitmap.find_prev(62) == PriceBitmap::npos);
+    assert(bitmap.find_next(4'097) == PriceBitmap::npos);
+    /*clearing one bit of a shared word keeps the summaries*/
+    bitmap.clear(63);
+    assert(bitmap.find_first() == 64);
+    bitmap.reset();
+    assert(bitmap.empty());
+    std::cout << "PASS: test_price_bitmap_edges" << std::endl;
+  }
+
+  static void test_price_bitmap_matches_ordered_set() {
+    const std::size_t SPAN = 300'000;
+    PriceBitmap bitmap(SPAN);
+    std::set<std::size_t> expected;
+    std::mt19937_64 rng(39);
+    for (int i = 0; i < 200'000; ++i) {
+      /*clustered around a drifting mid, like a book, with some far outliers*/
+      std::size_t slot = i % 10 == 0 ? rng() % SPAN
+                                     : (i * 7 + rng() % 2'000) % SPAN;
+      if (rng() % 2) {
+        bitmap.set(slot);
+        expected.insert(slot);
+      } else {
+        bitmap.clear(slot);
+        expected.erase(slot);
+      }
+      std::size_t probe = rng() % SPAN;
+      auto next = expected.lower_bound(probe);
+      assert(bitmap.find_next(probe) ==
+             (next == expected.end() ? PriceBitmap::npos : *next));
+      auto prev = expected.upper_bound(probe);
+      assert(bitmap.find_prev(probe) ==
+             (prev == expected.begin() ? PriceBitmap::npos : *std::prev(prev)));
+    }
+    assert(bitmap.empty() == expected.empty());
+    std::cout << "PASS: test_price_bitmap_matches_ordered_set" << std::endl;
+  }
+
+  /* ==================== price ladder tests ==================== */
+
+  template <typename Ladder> static std::vector<Price> ladder_prices(Ladder &l) {
+    std::vector<Price> prices;
+    for (const auto &[price, level] : l)
+      prices.push_back(price);
+    return prices;
+  }
+
+  static void test_ladder_window_and_overflow() {
+    NodePool pool;
+    HybridLadder<ListLevel, std::less<Price>, 64> asks;
+    /*the first level puts the window at [984, 1047]*/
+    auto handle = asks.try_emplace(1000, &pool).first->second.push_back(
+        Order(Side::SELL, 1, 1000, 10, orderType::GOODTOCANCEL));
+    for (Price price : {1010u, 1040u, 5000u, 1048u, 990u})
+      (void)asks.try_emplace(price, &pool);
+    assert(asks.get_window_front() == 984);
+    assert(ladder_prices(asks) ==
+           (std::vector<Price>{990, 1000, 1010, 1040, 1048, 5000}));
+    assert(asks.get_window_levels() == 4 && asks.get_overflow_levels() == 2);
+    assert(asks.find(5000) != asks.end() && asks.find(1001) == asks.end());
+    assert(!asks.try_emplace(1010, &pool).second);
+    assert(asks.get_recentre_count() == 0);
+
+    /*a better price moves the window down, the top of it spills over*/
+    (void)asks.try_emplace(900, &pool);
+    assert(asks.get_recentre_count() == 1 && asks.get_window_front() == 884);
+    assert(asks.get_window_levels() == 1 && asks.get_overflow_levels() == 6);
+    assert(ladder_prices(asks) ==
+           (std::vector<Price>{900, 990, 1000, 1010, 1040, 1048, 5000}));
+    /*the level moved with its orders, the handle still points at them*/
+    assert(&asks.find(1000)->second.front() == &*handle);
+
+    /*the window follows the best price back up*/
+    asks.erase(900);
+    assert(asks.get_window_front() == 974 && asks.get_window_levels() == 3);
+    asks.erase(990);
+    asks.erase(asks.find(1000));
+    assert(asks.get_window_front() == 994);
+    assert(asks.get_window_levels() == 3 && asks.get_overflow_levels() == 1);
+    assert(ladder_prices(asks) == (std::vector<Price>{1010, 1040, 1048, 5000}));
+    assert(asks.size() == 4);
+    asks.clear();
+    assert(asks.empty() && asks.begin() == asks.end());
+    std::cout << "PASS: test_ladder_window_and_overflow" << std::endl;
+  }
+
+  static void test_ladder_bid_side() {
+    HybridLadder<RingLevel, std::greater<Price>, 64> bids;
+    /*window [953, 1016] with 1016 at the front*/
+    for (Price price : {1000u, 1u, 999u, 1016u, 940u})
+      (void)bids.try_emplace(price);
+    assert(bids.get_window_front() == 1016 && bids.get_recentre_count() == 0);
+    assert(ladder_prices(bids) == (std::vector<Price>{1016, 1000, 999, 940, 1}));
+    assert(bids.get_overflow_levels() == 2);
+    (void)bids.try_emplace(1017);
+    assert(bids.get_window_front() == 1033);
+    assert(ladder_prices(bids) ==
+           (std::vector<Price>{1017, 1016, 1000, 999, 940, 1}));
+    /*only the stub is left: the window jumps to it rather than scanning*/
+    for (Price price : {1017u, 1016u, 1000u, 999u, 940u})
+      assert(bids.erase(price) == 1);
+    assert(bids.erase(940) == 0);
+    assert(bids.get_window_levels() == 1 && bids.get_overflow_levels() == 0);
+    assert(bids.begin()->first == 1);
+    /*prices near the top of the range clamp the window*/
+    (void)bids.try_emplace(std::numeric_limits<Price>::max());
+    assert(bids.get_window_front() == std::numeric_limits<Price>::max());
+    assert(ladder_prices(bids) ==
+           (std::vector<Price>{std::numeric_limits<Price>::max(), 1}));
+    std::cout << "PASS: test_ladder_bid_side" << std::endl;
+  }
+
+  /*stubs stay out of the array, near-market adds stay in it*/
+  static void test_ladder_book_with_stub_quotes() {
+    OrderFlowConfig config;
+    config.stub_ratio = 0.05;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(50'000);
+    LadderOrderbook ladder;
+    Orderbook reference;
+    OrderbookLevelInfos expected = run_flow(reference, records);
+    OrderbookLevelInfos got = run_flow(ladder, records);
+    assert(same_levels(expected.get_bids(), got.get_bids()));
+    assert(same_levels(expected.get_asks(), got.get_asks()));
+
+    std::size_t stubs = 0;
+    for (const auto &[price, level] : ladder.asks_)
+      stubs += price > 500'000;
+    assert(stubs > 0 && ladder.asks_.get_overflow_levels() >= stubs);
+    std::uint64_t overflow_inserts = ladder.asks_.get_overflow_inserts() +
+                                     ladder.bids_.get_overflow_inserts();
+    assert(overflow_inserts < records.size() / 10);
+    assert(ladder.asks_.get_recentre_count() < 100);
+
+    /*snapshots move between storage backends*/
+    LadderOrderbook restored;
+    assert(restored.restore_snapshot(reference.take_snapshot()) == 0);
+    OrderbookLevelInfos again = restored.get_levelInfos();
+    assert(same_levels(expected.get_bids(), again.get_bids()));
+    assert(same_levels(expected.get_asks(), again.get_asks()));
+    assert(restored.cancel_order(records.back().id) ==
+           reference.cancel_order(records.back().id));
+    std::cout << "PASS: test_ladder_book_with_stub_quotes" << std::endl;
+  }
+
+  /* ==================== iceberg tests ==================== */
+
+  static void test_iceberg_tranches() {
+    Order order(Side::SELL, 1, 100, 25, orderType::GOODTOCANCEL, 10);
+    assert(order.is_iceberg());
+    assert(order.get_remaining_quantity() == 10);
+    assert(order.get_hidden_quantity() == 15);
+    order.fill(10);
+    assert(!order.isFilled() && order.needs_replenish());
+    order.replenish();
+    assert(order.get_remaining_quantity() == 10);
+    assert(order.get_filled_quantity() == 10);
+    order.fill(10);
+    order.replenish(); /*last tranche is what is left*/
+    assert(order.get_remaining_quantity() == 5);
+    assert(order.get_hidden_quantity() == 0);
+    order.fill(5);
+    assert(order.isFilled() && !order.needs_replenish());
+    /*a peak at or above the quantity is a plain order*/
+    Order plain(Side::BUY, 2, 100, 10, orderType::GOODTOCANCEL, 10);
+    assert(!plain.is_iceberg() && plain.get_remaining_quantity() == 10);
+    std::cout << "PASS: test_iceberg_tranches" << std::endl;
+  }
+
+  static void test_iceberg_refill_loses_priority() {
+    Orderbook ob;
+    (void)ob.add_iceberg_order(Side::SELL, 100, 30, 10);             /*id 1*/
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL); /*id 2*/
+    /*only the shown tranche counts towards the level, the reserve still
+     * counts towards what a FOK can fill*/
+    assert(ob.get_levelInfos().get_asks()[0].quantity == 20);
+    assert(ob.get_depth_to_cover(Side::BUY, 100, 21).quantity == 20);
+    assert(ob.can_fully_fill(Side::BUY, 100, 40));
+    assert(!ob.can_fully_fill(Side::BUY, 100, 41));
+
+    Trades trades = ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 1);
+    const Order &refilled = *ob.orders_.find(1)->itr;
+    assert(refilled.get_remaining_quantity() == 10);
+    assert(refilled.get_hidden_quantity() == 10);
+    assert(ob.get_levelInfos().get_asks()[0].quantity == 20);
+
+    /*the refill queued behind order 2*/
+    trades = ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 2);
+
+    /*one aggressor takes the last two tranches*/
+    trades = ob.add_order(Side::BUY, 100, 25, orderType::GOODTOCANCEL);
+    assert(trades.size() == 2);
+    assert(trades[0].get_ask_info().orderID_ == 1);
+    assert(trades[1].get_ask_info().orderID_ == 1);
+    assert(ob.get_levelInfos().get_asks().empty());
+    assert(ob.get_levelInfos().get_bids()[0].quantity == 5);
+    assert(ob.snapshot_stats().iceberg_refills == 2);
+    std::cout << "PASS: test_iceberg_refill_loses_priority" << std::endl;
+  }
+
+  /*the same sweep through tranches on every storage backend, then the
+   * iceberg is cancelled through its (possibly moved) index entry*/
+  template <typename Book> static std::vector<OrderID> iceberg_sweep() {
+    Book ob;
+    (void)ob.add_iceberg_order(Side::SELL, 100, 100, 7);            /*id 1*/
+    (void)ob.add_order(Side::SELL, 100, 5, orderType::GOODTOCANCEL); /*id 2*/
+    Trades trades = ob.add_order(Side::BUY, 100, 50, orderType::FILLANDKILL);
+    std::vector<OrderID> hit;
+    Quantity traded = 0;
+    for (const auto &trade : trades) {
+      hit.push_back(trade.get_ask_info().orderID_);
+      traded += trade.get_ask_info().quantity_;
+    }
+    assert(traded == 50);
+    const Order &left = *ob.orders_.find(1)->itr;
+    assert(left.get_remaining_quantity() == 4);
+    assert(left.get_hidden_quantity() == 51);
+    assert(ob.cancel_order(1) == 0);
+    assert(ob.get_size() == 0 && ob.asks_.empty());
+    return hit;
+  }
+
+  /*a FOK that only the reserve can cover is filled, not killed*/
+  template <typename Book> static bool iceberg_fok_fills() {
+    Book ob;
+    (void)ob.add_iceberg_order(Side::SELL, 100, 100, 10);
+    Trades trades = ob.add_order(Side::BUY, 100, 50, orderType::FILLORKILL);
+    Quantity traded = 0;
+    for (const auto &trade : trades)
+      traded += trade.get_bid_info().quantity_;
+    trades = ob.add_order(Side::BUY, 100, 51, orderType::FILLORKILL);
+    return traded == 50 && trades.empty() &&
+           ob.orders_.find(1)->itr->get_hidden_quantity() +
+                   ob.orders_.find(1)->itr->get_remaining_quantity() ==
+               50 &&
+           level_totals_exact(ob);
+  }
+
+  static void test_iceberg_sweep_agrees_across_storage() {
+    std::vector<OrderID> expected{1, 2, 1, 1, 1, 1, 1, 1};
+    assert(iceberg_sweep<Orderbook>() == expected);
+    assert(iceberg_sweep<RingOrderbook>() == expected);
+    assert(iceberg_sweep<LeanRingOrderbook>() == expected);
+    assert(iceberg_sweep<LadderOrderbook>() == expected);
+    assert(iceberg_sweep<LeanLadderOrderbook>() == expected);
+    assert(iceberg_fok_fills<Orderbook>());
+    assert(iceberg_fok_fills<RingOrderbook>());
+    assert(iceberg_fok_fills<LeanLadderOrderbook>());
+
+    /*an aggressive iceberg trades its whole quantity before it rests*/
+    Orderbook ob;
+    (void)ob.add_order(Side::SELL, 100, 40, orderType::GOODTOCANCEL);
+    Trades trades = ob.add_iceberg_order(Side::BUY, 100, 50, 15);
+    Quantity traded = 0;
+    for (const auto &trade : trades)
+      traded += trade.get_bid_info().quantity_;
+    assert(traded == 40);
+    assert(ob.get_levelInfos().get_bids()[0].quantity == 5);
+    std::cout << "PASS: test_iceberg_sweep_agrees_across_storage" << std::endl;
+  }
+
+  static void test_iceberg_flow_recovers_and_replicates() {
+    OrderFlowConfig config;
+    config.iceberg_ratio = 0.2;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+
+    Orderbook live;
+    L3Feed feed;
+    L3BookBuilder replica;
+    live.attach_l3_feed(&feed);
+    for (const auto &record : records) {
+      (void)live.apply_command(record);
+      replica.drain(feed);
+    }
+    OrderbookLevelInfos expected = live.get_levelInfos();
+    assert(live.snapshot_stats().iceberg_refills > 0);
+    assert(replica.get_sequence_gaps() == 0);
+    assert(replica.get_size() == live.get_size());
+    OrderbookLevelInfos rebuilt = replica.get_levelInfos();
+    assert(same_levels(expected.get_bids(), rebuilt.get_bids()));
+    assert(same_levels(expected.get_asks(), rebuilt.get_asks()));
+
+    assert(agrees_with<RingOrderbook>(expected, records));
+    assert(agrees_with<LeanOrderbook>(expected, records));
+    assert(agrees_with<LadderOrderbook>(expected, records));
+
+    /*reserves survive a snapshot: the same sweep hits the same orders*/
+    Orderbook restored;
+    assert(restored.restore_snapshot(live.take_snapshot()) == 0);
+    Trades live_trades =
+        live.add_order(Side::BUY, 20'000, 5'000, orderType::FILLANDKILL);
+    Trades restored_trades =
+        restored.add_order(Side::BUY, 20'000, 5'000, orderType::FILLANDKILL);
+    assert(!live_trades.empty());
+    assert(live_trades.size() == restored_trades.size());
+    for (std::size_t i = 0; i < live_trades.size(); ++i)
+      assert(live_trades[i].get_ask_info().orderID_ ==
+             restored_trades[i].get_ask_info().orderID_);
+    std::cout << "PASS: test_iceberg_flow_recovers_and_replicates" << std::endl;
+  }
+
+  /* ==================== stop order tests ==================== */
+
+  static void test_stop_fires_on_last_trade() {
+    Orderbook ob;
+    (void)ob.add_order(Side::SELL, 101, 10, orderType::GOODTOCANCEL); /*id 1*/
+    (void)ob.add_order(Side::SELL, 102, 10, orderType::GOODTOCANCEL); /*id 2*/
+    (void)ob.add_order(Side::SELL, 103, 10, orderType::GOODTOCANCEL); /*id 3*/
+    /*stop-limit: buy 5 at 103 once 102 trades*/
+    Trades none =
+        ob.add_stop_order(Side::BUY, 102, 103, 5, orderType::GOODTOCANCEL);
+    assert(none.empty());
+    assert(ob.get_stop_count() == 1 && ob.get_size() == 3);
+    assert(ob.get_levelInfos().get_bids().empty());
+
+    Trades trades = ob.add_order(Side::BUY, 101, 10, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1 && ob.get_stop_count() == 1);
+
+    /*102 prints, the stop fires and takes the rest of 102*/
+    trades = ob.add_order(Side::BUY, 102, 5, orderType::GOODTOCANCEL);
+    assert(trades.size() == 2);
+    assert(trades[1].get_bid_info().orderID_ == 4);
+    assert(trades[1].get_ask_info().price_ == 102);
+    assert(ob.get_stop_count() == 0);
+    assert(ob.snapshot_stats().stops_triggered == 1);
+
+    /*the last trade is already through the trigger: enters at once*/
+    trades = ob.add_stop_order(Side::BUY, 100, 103, 3, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 3);
+
+    /*a sell stop far below never fires and cancels like an order*/
+    (void)ob.add_stop_order(Side::SELL, 50, 50, 5, orderType::GOODTOCANCEL);
+    assert(ob.get_stop_count() == 1);
+    assert(ob.cancel_order(8) == 0);
+    assert(ob.get_stop_count() == 0 && ob.cancel_order(8) == -1);
+    std::cout << "PASS: test_stop_fires_on_last_trade" << std::endl;
+  }
+
+  /*each stop-market sell knocks the price down into the next trigger*/
+  static void test_stop_cascade_order() {
+    Orderbook ob;
+    for (Price price : {100, 99, 98, 97})
+      (void)ob.add_order(Side::BUY, price, 1, orderType::GOODTOCANCEL);
+    (void)ob.add_order(Side::BUY, 96, 10, orderType::GOODTOCANCEL); /*id 5*/
+    (void)ob.add_stop_order(Side::SELL, 99, 0, 1, orderType::MARKET); /*id 6*/
+    (void)ob.add_stop_order(Side::SELL, 98, 0, 1, orderType::MARKET); /*id 7*/
+    (void)ob.add_stop_order(Side::SELL, 97, 0, 1, orderType::MARKET); /*id 8*/
+    (void)ob.add_stop_order(Side::SELL, 99, 0, 1, orderType::MARKET); /*id 9*/
+    (void)ob.add_stop_order(Side::SELL, 90, 0, 1, orderType::MARKET); /*id 10*/
+
+    Trades trades = ob.add_order(Side::SELL, 100, 1, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1 && ob.get_stop_count() == 5);
+
+    /*99 prints: 6 and 9 fire in arrival order, 6 hits 98 and fires 7, 9
+     * hits 97 and fires 8, both of which land on 96*/
+    trades = ob.add_order(Side::SELL, 99, 1, orderType::GOODTOCANCEL);
+    std::vector<OrderID> sellers;
+    std::vector<Price> prices;
+    for (const auto &trade : trades) {
+      sellers.push_back(trade.get_ask_info().orderID_);
+      prices.push_back(trade.get_ask_info().price_);
+    }
+    assert(sellers == (std::vector<OrderID>{12, 6, 9, 7, 8}));
+    assert(prices == (std::vector<Price>{99, 98, 97, 96, 96}));
+    assert(ob.get_stop_count() == 1);
+    assert(ob.get_levelInfos().get_bids()[0].quantity == 8);
+    std::cout << "PASS: test_stop_cascade_order" << std::endl;
+  }
+
+  static void add_stops_and_flow(Orderbook &ob, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+      ob.set_sim_tick(static_cast<SimTick>(i));
+      Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+      Price price = 1000 + (i * 17 % 60) - 30;
+      if (i % 5 == 0) {
+        Price trigger = side == Side::BUY ? price + 20 : price - 20;
+        (void)ob.add_stop_order(side, trigger, price, 1 + (i % 7),
+                                i % 3 ? orderType::GOODTOCANCEL
+                                      : orderType::MARKET);
+      } else {
+        (void)ob.add_order(side, price, 1 + (i % 15), orderType::GOODTOCANCEL);
+      }
+      if (i % 6 == 0)
+        (void)ob.cancel_order(static_cast<OrderID>(i / 2 + 1));
+    }
+  }
+
+  static void test_stops_survive_snapshot_and_journal() {
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_stops.journal")
+            .string();
+    Orderbook live;
+    BookSnapshot snapshot;
+    {
+      CommandJournal journal;
+      journal.open_Journal(path);
+      live.attach_journal(&journal);
+      add_stops_and_flow(live, 0, 3'000);
+      snapshot = live.take_snapshot();
+      add_stops_and_flow(live, 3'000, 3'000);
+      live.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+    assert(snapshot.header.stop_count > 0);
+    assert(live.snapshot_stats().stops_triggered > 0);
+
+    Orderbook replayed;
+    assert(replayed.recover_from_journal(path) == 0);
+    Orderbook resumed;
+    assert(resumed.restore_snapshot(snapshot) == 0);
+    assert(resumed.recover_from_journal(path) == 0);
+    std::filesystem::remove(path);
+
+    auto a = live.get_levelInfos();
+    for (Orderbook *ob : {&replayed, &resumed}) {
+      auto b = ob->get_levelInfos();
+      assert(ob->get_size() == live.get_size());
+      assert(ob->get_stop_count() == live.get_stop_count());
+      assert(same_levels(a.get_bids(), b.get_bids()));
+      assert(same_levels(a.get_asks(), b.get_asks()));
+    }
+    /*the same sweep fires the same stops*/
+    Trades expected =
+        live.add_order(Side::BUY, 2000, 2000, orderType::GOODTOCANCEL);
+    Trades got =
+        resumed.add_order(Side::BUY, 2000, 2000, orderType::GOODTOCANCEL);
+    assert(expected.size() == got.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+      assert(expected[i].get_bid_info().orderID_ ==
+             got[i].get_bid_info().orderID_);
+    assert(live.get_stop_count() == resumed.get_stop_count());
+    std::cout << "PASS: test_stops_survive_snapshot_and_journal" << std::endl;
+  }
+
+  /* ==================== pegged order tests ==================== */
+
+  static void test_primary_peg_follows_the_bid() {
+    Orderbook ob;
+    (void)ob.add_order(Side::BUY, 100, 5, orderType::GOODTOCANCEL);   /*id 1*/
+    (void)ob.add_order(Side::SELL, 104, 10, orderType::GOODTOCANCEL); /*id 2*/
+    Trades trades = ob.add_pegged_order(Side::BUY, PegType::PRIMARY, 0, 5);
+    assert(trades.empty() && ob.get_size() == 3);
+    assert(ob.get_levelInfos().get_bids().size() == 1); /*not displayed*/
+
+    /*a better bid moves the peg to 101 without touching it*/
+    (void)ob.add_order(Side::BUY, 101, 1, orderType::GOODTOCANCEL); /*id 4*/
+    assert(ob.orders_.find(3)->itr->get_peg_offset() == 0);
+    assert(ob.peg_bids_.buckets(PegType::PRIMARY).size() == 1);
+
+    /*the limit order at 101 goes first, then the peg, still at 101 while
+     * the sell that emptied the level matches*/
+    trades = ob.add_order(Side::SELL, 101, 3, orderType::GOODTOCANCEL);
+    assert(trades.size() == 2);
+    assert(trades[0].get_bid_info().orderID_ == 4);
+    assert(trades[1].get_bid_info().orderID_ == 3);
+    assert(trades[1].get_bid_info().price_ == 101);
+
+    /*back at 100 behind the limit order, and counted in depth*/
+    auto cover = ob.get_depth_to_cover(Side::SELL, 100, 8);
+    assert(cover.levels == 1 && cover.quantity == 8);
+    trades = ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    assert(trades.size() == 2);
+    assert(trades[0].get_bid_info().orderID_ == 1);
+    assert(trades[1].get_bid_info().orderID_ == 3);
+    assert(ob.peg_bids_.empty() && ob.get_size() == 2);
+    std::cout << "PASS: test_primary_peg_follows_the_bid" << std::endl;
+  }
+
+  static void test_midpoint_pegs_cross() {
+    Orderbook ob;
+    (void)ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL);  /*id 1*/
+    (void)ob.add_order(Side::SELL, 110, 10, orderType::GOODTOCANCEL); /*id 2*/
+    (void)ob.add_pegged_order(Side::BUY, PegType::MIDPOINT, 0, 10);   /*id 3*/
+    Trades trades =
+        ob.add_pegged_order(Side::SELL, PegType::MIDPOINT, 0, 15); /*id 4*/
+    assert(trades.size() == 1);
+    assert(trades[0].get_bid_info().orderID_ == 3);
+    assert(trades[0].get_ask_info().price_ == 105);
+
+    /*a bid at 104 puts the midpoint at 107: too high for the bid itself*/
+    trades = ob.add_order(Side::BUY, 104, 1, orderType::GOODTOCANCEL);
+    assert(trades.empty());
+    trades = ob.add_order(Side::BUY, 107, 5, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1);
+    assert(trades[0].get_ask_info().orderID_ == 4);
+    assert(trades[0].get_ask_info().price_ == 107);
+    assert(ob.peg_asks_.empty());
+
+    /*no reference, no price: an empty side leaves midpoint pegs idle*/
+    Orderbook idle;
+    (void)idle.add_pegged_order(Side::BUY, PegType::MIDPOINT, 0, 10);
+    trades = idle.add_order(Side::SELL, 1, 10, orderType::GOODTOCANCEL);
+    assert(trades.empty() && idle.get_size() == 2);
+    std::cout << "PASS: test_midpoint_pegs_cross" << std::endl;
+  }
+
+  static void test_peg_depth_and_cancel() {
+    Orderbook ob;
+    (void)ob.add_order(Side::SELL, 105, 5, orderType::GOODTOCANCEL); /*id 1*/
+    (void)ob.add_pegged_order(Side::SELL, PegType::PRIMARY, 1, 10);  /*id 2*/
+    auto cover = ob.get_depth_to_cover(Side::BUY, 106, 12);
+    assert(cover.levels == 2 && cover.quantity == 15);
+    assert(ob.get_depth_to_cover(Side::BUY, 105, 12).quantity == 5);
+
+    Trades trades = ob.add_order(Side::BUY, 106, 20, orderType::FILLORKILL);
+    assert(trades.empty());
+    trades = ob.add_order(Side::BUY, 106, 12, orderType::FILLORKILL);
+    assert(trades.size() == 2);
+    assert(trades[1].get_ask_info().orderID_ == 2);
+    assert(trades[1].get_ask_info().price_ == 106);
+
+    /*a modify moves the peg by offset and keeps it pegged*/
+    (void)ob.add_order(Side::SELL, 110, 5, orderType::GOODTOCANCEL); /*id 5*/
+    (void)ob.modify_order(2, static_cast<Price>(-2), 3);
+    assert(ob.peg_asks_.buckets(PegType::PRIMARY).count(-2) == 1);
+    assert(ob.get_depth_to_cover(Side::BUY, 108, 10).quantity == 3);
+    assert(ob.cancel_order(2) == 0);
+    assert(ob.peg_asks_.empty() && ob.get_size() == 1);
+    assert(ob.cancel_order(2) == -1);
+    std::cout << "PASS: test_peg_depth_and_cancel" << std::endl;
+  }
+
+  static void test_peg_flow_replicates_and_recovers() {
+    OrderFlowConfig config;
+    config.peg_ratio = 0.2;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    std::set<OrderID> pegged;
+    for (const auto &record : records)
+      if (record.type == CommandType::ADD_PEG)
+        pegged.insert(record.id);
+
+    Orderbook live;
+    L3Feed feed;
+    L3BookBuilder replica;
+    live.attach_l3_feed(&feed);
+    std::size_t peg_trades = 0;
+    for (const auto &record : records) {
+      for (const auto &trade : live.apply_command(record))
+        peg_trades += pegged.count(trade.get_bid_info().orderID_) +
+                      pegged.count(trade.get_ask_info().orderID_);
+      replica.drain(feed);
+    }
+    assert(peg_trades > 0);
+    /*the feed never sees a peg, the levels it rebuilds are still exact*/
+    OrderbookLevelInfos expected = live.get_levelInfos();
+    OrderbookLevelInfos rebuilt = replica.get_levelInfos();
+    assert(replica.get_sequence_gaps() == 0);
+    assert(same_levels(expected.get_bids(), rebuilt.get_bids()));
+    assert(same_levels(expected.get_asks(), rebuilt.get_asks()));
+
+    assert(agrees_with<LeanOrderbook>(expected, records));
+    assert(agrees_with<RingOrderbook>(expected, records));
+    assert(agrees_with<LadderOrderbook>(expected, records));
+
+    /*pegs survive a snapshot in bucket order: the same sweep hits the same
+     * orders*/
+    BookSnapshot snapshot = live.take_snapshot();
+    assert(!snapshot.pegs.empty());
+    Orderbook restored;
+    assert(restored.restore_snapshot(snapshot) == 0);
+    assert(restored.get_size() == live.get_size());
+    Trades live_trades =
+        live.add_order(Side::SELL, 1, 5'000, orderType::FILLANDKILL);
+    Trades restored_trades =
+        restored.add_order(Side::SELL, 1, 5'000, orderType::FILLANDKILL);
+    assert(!live_trades.empty());
+    assert(live_trades.size() == restored_trades.size());
+    for (std::size_t i = 0; i < live_trades.size(); ++i)
+      assert(live_trades[i].get_bid_info().orderID_ ==
+             restored_trades[i].get_bid_info().orderID_);
+    std::cout << "PASS: test_peg_flow_replicates_and_recovers" << std::endl;
+  }
+
+  /* ==================== auction tests ==================== */
+
+  static void test_auction_uncross_at_equilibrium() {
+    Orderbook ob;
+    ob.start_auction();
+    for (auto [price, qty] : {std::pair<Price, Quantity>{105, 10}, {103, 20},
+                              {100, 30}})
+      assert(ob.add_order(Side::BUY, price, qty, orderType::GOODTOCANCEL)
+                 .empty());
+    for (auto [price, qty] : {std::pair<Price, Quantity>{99, 15}, {102, 25},
+                              {104, 10}, {107, 5}})
+      assert(ob.add_order(Side::SELL, price, qty, orderType::GOODTOCANCEL)
+                 .empty());
+    assert(ob.in_auction() && ob.get_size() == 7);
+    assert(ob.add_order(Side::BUY, 110, 1, orderType::FILLORKILL).empty());
+    assert(ob.get_size() == 7);
+
+    /*30 trades at 102 and at 103 with 10 left over either way: the lower
+     * price wins without a last trade, the nearer one with*/
+    auction::Uncross indicative = ob.get_indicative_uncross();
+    assert(indicative.price == 102 && indicative.volume == 30 &&
+           indicative.imbalance == 10);
+    ob.last_trade_price_ = 110;
+    assert(ob.get_indicative_uncross().price == 103);
+    ob.last_trade_price_ = 0;
+
+    Trades trades = ob.uncross();
+    assert(!ob.in_auction());
+    std::vector<OrderID> buyers, sellers;
+    Quantity traded = 0;
+    for (const auto &trade : trades) {
+      assert(trade.get_bid_info().price_ == 102);
+      buyers.push_back(trade.get_bid_info().orderID_);
+      sellers.push_back(trade.get_ask_info().orderID_);
+      traded += trade.get_bid_info().quantity_;
+    }
+    assert(traded == 30);
+    assert(buyers == (std::vector<OrderID>{1, 2, 2}));
+    assert(sellers == (std::vector<OrderID>{4, 4, 5}));
+    auto levels = ob.get_levelInfos();
+    assert(levels.get_bids()[0].price == 100);
+    assert(levels.get_asks()[0].price == 102 &&
+           levels.get_asks()[0].quantity == 10);
+    assert(ob.snapshot_stats().auction_uncrosses == 1);
+
+    /*continuous again*/
+    trades = ob.add_order(Side::BUY, 102, 4, orderType::GOODTOCANCEL);
+    assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 5);
+    assert(ob.uncross().empty()); /*nothing crossed*/
+    std::cout << "PASS: test_auction_uncross_at_equilibrium" << std::endl;
+  }
+
+  /*the price only sees the iceberg's shown tranche, the reserve behind it
+   * still crosses and trades once continuous matching is back*/
+  static void test_auction_leaves_icebergs_uncrossed() {
+    Orderbook ob;
+    ob.start_auction();
+    (void)ob.add_iceberg_order(Side::BUY, 105, 100, 10); /*id 1*/
+    (void)ob.add_order(Side::SELL, 100, 50, orderType::GOODTOCANCEL);
+    Trades trades = ob.uncross();
+    Quantity traded = 0;
+    for (const auto &trade : trades)
+      traded += trade.get_bid_info().quantity_;
+    assert(traded == 50 && trades.front().get_bid_info().price_ == 100);
+    assert(ob.asks_.empty() && ob.get_size() == 1);
+    const Order &iceberg = *ob.orders_.find(1)->itr;
+    assert(iceberg.get_remaining_quantity() + iceberg.get_hidden_quantity() ==
+           50);
+    assert(ob.add_order(Side::BUY, 1, 1, orderType::GOODTOCANCEL).empty());
+    std::cout << "PASS: test_auction_leaves_icebergs_uncrossed" << std::endl;
+  }
+
+  static void test_auction_matches_brute_force() {
+    std::mt19937 rng(7);
+    for (int round = 0; round < 200; ++round) {
+      LadderOrderbook ob;
+      ob.last_trade_price_ = round % 2 ? 90 + rng() % 30 : 0;
+      ob.start_auction();
+      std::vector<std::pair<Price, Quantity>> bids, asks;
+      int orders = 1 + rng() % 60;
+      for (int i = 0; i < orders; ++i) {
+        Price price = 90 + rng() % 30;
+        Quantity qty = 1 + rng() % 50;
+        bool buy = rng() % 2;
+        (buy ? bids : asks).emplace_back(price, qty);
+        (void)ob.add_order(buy ? Side::BUY : Side::SELL, price, qty,
+                           orderType::GOODTOCANCEL);
+      }
+
+      /*every level price, scored from scratch*/
+      std::set<Price> candidates;
+      for (auto &[price, qty] : bids)
+        candidates.insert(price);
+      for (auto &[price, qty] : asks)
+        candidates.insert(price);
+      auction::Uncross expected;
+      for (Price price : candidates) {
+        std::uint64_t demand = 0, supply = 0;
+        for (auto &[p, qty] : bids)
+          demand += p >= price ? qty : 0;
+        for (auto &[p, qty] : asks)
+          supply += p <= price ? qty : 0;
+        auction::Uncross candidate{
+            price, std::min(demand, supply),
+            demand > supply ? demand - supply : supply - demand};
+        if (candidate.volume > 0 &&
+            auction::better(candidate, expected, ob.last_trade_price_))
+          expected = candidate;
+      }
+      auction::Uncross got = ob.get_indicative_uncross();
+      assert(got.price == expected.price && got.volume == expected.volume &&
+             got.imbalance == expected.imbalance);
+
+      Trades trades = ob.uncross();
+      std::uint64_t traded = 0;
+      for (const auto &trade : trades) {
+        assert(trade.get_ask_info().price_ == expected.price);
+        traded += trade.get_ask_info().quantity_;
+      }
+      assert(traded == expected.volume);
+      auto levels = ob.get_levelInfos();
+      assert(levels.get_bids().empty() || levels.get_asks().empty() ||
+             levels.get_bids()[0].price < levels.get_asks()[0].price);
+    }
+    std::cout << "PASS: test_auction_matches_brute_force" << std::endl;
+  }
+
+  static void test_auction_survives_snapshot_and_journal() {
+    std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_auction.journal")
+            .string();
+    OrderFlowGenerator gen;
+    std::vector<JournalRecord> records = gen.generate(4'000);
+    Orderbook live;
+    BookSnapshot snapshot;
+    Trades expected;
+    {
+      CommandJournal journal;
+      journal.open_Journal(path);
+      live.attach_journal(&journal);
+      live.start_auction();
+      for (std::size_t i = 0; i < records.size(); ++i) {
+        const auto &record = records[i];
+        Side side = static_cast<Side>(record.side);
+        if (i == records.size() / 2)
+          snapshot = live.take_snapshot();
+        if (record.type == CommandType::CANCEL)
+          (void)live.cancel_order(record.id);
+        else if (record.type == CommandType::MODIFY)
+          (void)live.modify_order(record.id, record.price, record.quantity);
+        else
+          (void)live.add_order(side, record.price, record.quantity,
+                               static_cast<orderType>(record.order_type));
+      }
+      expected = live.uncross();
+      live.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+    assert(snapshot.header.flags & SNAPSHOT_IN_AUCTION);
+    assert(!expected.empty());
+
+    Orderbook replayed;
+    assert(replayed.recover_from_journal(path) == 0);
+    Orderbook resumed;
+    assert(resumed.restore_snapshot(snapshot) == 0 && resumed.in_auction());
+    assert(resumed.recover_from_journal(path) == 0);
+    std::filesystem::remove(path);
+    auto a = live.get_levelInfos();
+    for (Orderbook *ob : {&replayed, &resumed}) {
+      auto b = ob->get_levelInfos();
+      assert(!ob->in_auction() && ob->get_size() == live.get_size());
+      assert(same_levels(a.get_bids(), b.get_bids()));
+      assert(same_levels(a.get_asks(), b.get_asks()));
+    }
+    std::cout << "PASS: test_auction_survives_snapshot_and_journal"
+              << std::endl;
+  }
+  /* ==================== allocation tests ==================== */
+
+  /*(ask ID, quantity) of every trade, for books where the buyer aggresses*/
+  static std::vector<std::pair<OrderID, Quantity>> fills(const Trades &trades) {
+    std::vector<std::pair<OrderID, Quantity>> out;
+    for (const auto &trade : trades)
+      out.emplace_back(trade.get_ask_info().orderID_,
+                       trade.get_ask_info().quantity_);
+    return out;
+  }
+
+  static void test_pro_rata_splits_by_size() {
+    ProRataOrderbook ob;
+    for (Quantity qty : {10, 30, 60})
+      assert(ob.add_order(Side::SELL, 100, qty, orderType::GOODTOCANCEL)
+                 .empty());
+
+    /*shares of 25 are 2.5, 7.5 and 15, the lot lost rounding down goes to
+     * the first in time*/
+    Trades trades = ob.add_order(Side::BUY, 100, 25, orderType::GOODTOCANCEL);
+    using Fills = std::vector<std::pair<OrderID, Quantity>>;
+    assert(fills(trades) == (Fills{{1, 3}, {2, 7}, {3, 15}}));
+    for (const auto &trade : trades)
+      assert(trade.get_bid_info().orderID_ == 4 &&
+             trade.get_bid_info().price_ == 100);
+    assert(ob.get_size() == 3);
+    assert(ob.orders_.find(1)->itr->get_remaining_quantity() == 7);
+    assert(ob.orders_.find(2)->itr->get_remaining_quantity() == 23);
+    assert(ob.orders_.find(3)->itr->get_remaining_quantity() == 45);
+    auto levels = ob.get_levelInfos();
+    assert(levels.get_bids().empty() && levels.get_asks()[0].quantity == 75);
+
+    /*time priority is untouched: the same order on a FIFO book*/
+    Orderbook fifo;
+    for (Quantity qty : {10, 30, 60})
+      (void)fifo.add_order(Side::SELL, 100, qty, orderType::GOODTOCANCEL);
+    assert(fills(fifo.add_order(Side::BUY, 100, 25,
+                                           orderType::GOODTOCANCEL)) ==
+           (Fills{{1, 10}, {2, 15}}));
+
+    /*taking the whole level fills everyone, the rest sweeps on and rests*/
+    trades = ob.add_order(Side::BUY, 101, 80, orderType::GOODTOCANCEL);
+    assert(fills(trades) == (Fills{{1, 7}, {2, 23}, {3, 45}}));
+    levels = ob.get_levelInfos();
+    assert(levels.get_asks().empty() && levels.get_bids()[0].price == 101 &&
+           levels.get_bids()[0].quantity == 5);
+    std::cout << "PASS: test_pro_rata_splits_by_size" << std::endl;
+  }
+
+  static void test_top_order_then_pro_rata() {
+    using Fills = std::vector<std::pair<OrderID, Quantity>>;
+    TopOrderProRataOrderbook ob;
+    for (Quantity qty : {10, 30, 60})
+      (void)ob.add_order(Side::SELL, 100, qty, orderType::GOODTOCANCEL);
+    /*the top order takes its 10, 20 is shared 6.67 and 13.33*/
+    assert(fills(ob.add_order(
+               Side::BUY, 100, 30, orderType::GOODTOCANCEL)) ==
+           (Fills{{1, 10}, {2, 7}, {3, 13}}));
+    assert(ob.get_size() == 2);
+
+    /*an iceberg on top trades its tranche and refills at the back*/
+    TopOrderProRataOrderbook icebergs;
+    (void)icebergs.add_iceberg_order(Side::SELL, 100, 40, 5);
+    (void)icebergs.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL);
+    (void)icebergs.add_order(Side::SELL, 100, 20, orderType::GOODTOCANCEL);
+    const Order *node = &*icebergs.orders_.find(1)->itr;
+    assert(fills(icebergs.add_order(
+               Side::BUY, 100, 15, orderType::GOODTOCANCEL)) ==
+           (Fills{{1, 5}, {2, 4}, {3, 6}}));
+    const Order &iceberg = *icebergs.orders_.find(1)->itr;
+    assert(&iceberg == node); /*requeued, it keeps its node*/
+    assert(iceberg.get_remaining_quantity() == 5 &&
+           iceberg.get_hidden_quantity() == 30);
+    assert(icebergs.get_levelInfos().get_asks()[0].quantity == 25);
+    assert(icebergs.snapshot_stats().iceberg_refills == 1);
+    /*order 2 is on top now*/
+    assert(fills(icebergs.add_order(
+               Side::BUY, 100, 6, orderType::GOODTOCANCEL)) ==
+           (Fills{{2, 6}}));
+    std::cout << "PASS: test_top_order_then_pro_rata" << std::endl;
+  }
+
+  /*allocation decides who trades, never how much: on a flow without
+   * cancels every book shows the same depth after every order*/
+  static void test_allocation_keeps_depth() {
+    std::mt19937 rng(45);
+    std::uniform_int_distribution<Price> price(95, 105);
+    std::uniform_int_distribution<Quantity> qty(1, 50);
+    Orderbook fifo;
+    ProRataOrderbook pro_rata;
+    TopOrderProRataOrderbook top_pro_rata;
+    std::size_t fifo_trades = 0, pro_rata_trades = 0;
+    for (int i = 0; i < 5000; ++i) {
+      Side side = rng() % 2 ? Side::BUY : Side::SELL;
+      Price p = price(rng);
+      Quantity q = qty(rng);
+      fifo_trades +=
+          fifo.add_order(side, p, q, orderType::GOODTOCANCEL).size();
+      pro_rata_trades +=
+          pro_rata.add_order(side, p, q, orderType::GOODTOCANCEL).size();
+      (void)top_pro_rata.add_order(side, p, q, orderType::GOODTOCANCEL);
+      auto a = fifo.get_levelInfos();
+      auto b = pro_rata.get_levelInfos();
+      auto c = top_pro_rata.get_levelInfos();
+      assert(same_levels(a.get_bids(), b.get_bids()) &&
+             same_levels(a.get_asks(), b.get_asks()));
+      assert(same_levels(a.get_bids(), c.get_bids()) &&
+             same_levels(a.get_asks(), c.get_asks()));
+    }
+    /*sharing splits fills across more orders*/
+    assert(pro_rata_trades > fifo_trades);
+    std::cout << "PASS: test_allocation_keeps_depth" << std::endl;
+  }
+  /* ==================== pre-trade risk tests ==================== */
+
+  static void test_risk_refuses_orders_over_limits() {
+    PreTradeRisk risk(4);
+    RiskLimits limits;
+    limits.max_order_quantity = 100;
+    limits.max_open_quantity = 150;
+    limits.max_open_notional = 150 * 100;
+    limits.price_band = 5;
+    risk.set_limits(1, limits);
+
+    Orderbook ob;
+    L3Feed feed;
+    ob.attach_l3_feed(&feed);
+    ob.attach_risk(&risk);
+    assert(ob.add_order(Side::BUY, 100, 101, orderType::GOODTOCANCEL, 1)
+               .empty());
+    assert(ob.get_size() == 0);
+    L3Event event{};
+    assert(feed.poll(event) && event.type == L3EventType::REJECT &&
+           event.quantity == 101);
+    assert(risk.get_rejects(RiskReject::ORDER_QUANTITY) == 1);
+
+    (void)ob.add_order(Side::BUY, 100, 100, orderType::GOODTOCANCEL, 1);
+    (void)ob.add_order(Side::BUY, 100, 60, orderType::GOODTOCANCEL, 1);
+    assert(risk.get_rejects(RiskReject::OPEN_QUANTITY) == 1);
+    (void)ob.add_order(Side::BUY, 110, 50, orderType::GOODTOCANCEL, 1);
+    assert(risk.get_rejects(RiskReject::OPEN_NOTIONAL) == 1);
+    (void)ob.add_order(Side::BUY, 95, 50, orderType::GOODTOCANCEL, 1);
+    assert(ob.get_size() == 2 && risk.get_open_quantity(1) == 150);
+
+    /*the band needs a last trade to centre on*/
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 2);
+    assert(ob.last_trade_price_ == 100);
+    (void)ob.add_order(Side::BUY, 94, 5, orderType::GOODTOCANCEL, 1);
+    assert(risk.get_rejects(RiskReject::PRICE_BAND) == 1);
+    (void)ob.add_order(Side::BUY, 95, 5, orderType::GOODTOCANCEL, 1);
+    assert(ob.get_size() == 3);
+
+    /*a MARKET stop's price is not where it enters, only a stop-limit's is
+     * banded*/
+    RiskLimits band;
+    band.price_band = 5;
+    risk.set_limits(2, band);
+    (void)ob.add_stop_order(Side::SELL, 90, 50, 5, orderType::GOODTOCANCEL, 2);
+    assert(risk.get_rejects(RiskReject::PRICE_BAND) == 2);
+    (void)ob.add_stop_order(Side::SELL, 90, 50, 5, orderType::MARKET, 2);
+    assert(risk.get_rejects(RiskReject::PRICE_BAND) == 2);
+    assert(ob.get_stop_count() == 1);
+
+    (void)ob.add_order(Side::SELL, 100, 1, orderType::GOODTOCANCEL, 4);
+    assert(risk.get_rejects(RiskReject::UNKNOWN_ACCOUNT) == 1);
+    assert(ob.snapshot_stats().risk_rejects == 6);
+    std::cout << "PASS: test_risk_refuses_orders_over_limits" << std::endl;
+  }
+
+  static void test_risk_exposure_follows_fills_and_cancels() {
+    PreTradeRisk risk(3);
+    Orderbook ob;
+    ob.attach_risk(&risk);
+    (void)ob.add_iceberg_order(Side::SELL, 100, 50, 10, 1);
+    (void)ob.add_order(Side::SELL, 101, 20, orderType::GOODTOCANCEL, 1);
+    assert(risk.get_open_quantity(1) == 70);
+    assert(risk.get_open_notional(1) == 50 * 100 + 20 * 101);
+
+    /*fills come out at the resting order's price, whatever the aggressor
+     * bid*/
+    Trades trades = ob.add_order(Side::BUY, 101, 25, orderType::GOODTOCANCEL, 2);
+    assert(!trades.empty());
+    assert(risk.get_open_quantity(1) == 45);
+    assert(risk.get_open_notional(1) == 25 * 100 + 20 * 101);
+    assert(risk.get_open_quantity(2) == 0 && risk.get_open_notional(2) == 0);
+
+    /*a modify is checked net of the order it replaces*/
+    RiskLimits limits;
+    limits.max_open_quantity = 50;
+    risk.set_limits(1, limits);
+    assert(ob.modify_order(2, 101, 25).empty());
+    assert(risk.get_open_quantity(1) == 50);
+    assert(ob.modify_order(2, 101, 26).empty());
+    assert(risk.get_rejects(RiskReject::OPEN_QUANTITY) == 1);
+    assert(ob.orders_.find(2)->itr->get_remaining_quantity() == 25);
+
+    assert(ob.cancel_order(1) == 0 && ob.cancel_order(2) == 0);
+    assert(risk.get_open_quantity(1) == 0 && risk.get_open_notional(1) == 0);
+    std::cout << "PASS: test_risk_exposure_follows_fills_and_cancels"
+              << std::endl;
+  }
+
+  /*on a mixed flow the running exposure always equals what is resting*/
+  static void test_risk_exposure_matches_the_book() {
+    OrderFlowConfig config;
+    config.peg_ratio = 0.1;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    PreTradeRisk risk(1);
+    Orderbook ob;
+    ob.attach_risk(&risk);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+      (void)ob.apply_command(records[i]);
+      if (i % 1'000 != 0)
+        continue;
+      std::uint64_t open = 0, notional = 0;
+      ob.orders_.for_each([&](OrderID, const auto &entry) {
+        const Order &order = *entry.itr;
+        std::uint64_t quantity = std::uint64_t(order.get_remaining_quantity()) +
+                                 order.get_hidden_quantity();
+        open += quantity;
+        notional += order.is_pegged() ? 0 : quantity * order.get_order_price();
+      });
+      assert(risk.get_open_quantity(0) == open);
+      assert(risk.get_open_notional(0) == notional);
+    }
+    ob.flush_orderbook();
+    assert(risk.get_open_quantity(0) == 0 && risk.get_open_notional(0) == 0);
+    std::cout << "PASS: test_risk_exposure_matches_the_book" << std::endl;
+  }
+
+  /*restored orders, and orders resting before risk was attached, bring their
+   * exposure with them. an account the risk object does not know is left
+   * alone*/
+  static void test_risk_exposure_survives_restore() {
+    Orderbook live;
+    (void)live.add_iceberg_order(Side::SELL, 100, 50, 10, 1);
+    (void)live.add_order(Side::BUY, 90, 20, orderType::GOODTOCANCEL, 1);
+    (void)live.add_order(Side::BUY, 89, 5, orderType::GOODTOCANCEL, 7);
+    PreTradeRisk risk(2);
+    live.attach_risk(&risk);
+    assert(risk.get_open_quantity(1) == 70);
+    assert(risk.get_open_notional(1) == 50 * 100 + 20 * 90);
+    BookSnapshot snapshot = live.take_snapshot();
+    live.attach_risk(nullptr);
+    assert(risk.get_open_quantity(1) == 0 && risk.get_open_notional(1) == 0);
+
+    Orderbook restored;
+    restored.attach_risk(&risk);
+    (void)restored.add_order(Side::SELL, 120, 4, orderType::GOODTOCANCEL, 1);
+    assert(restored.restore_snapshot(snapshot) == 0);
+    assert(risk.get_open_quantity(1) == 70);
+    assert(risk.get_open_notional(1) == 50 * 100 + 20 * 90);
+
+    Trades trades =
+        restored.add_order(Side::BUY, 100, 15, orderType::GOODTOCANCEL, 0);
+    assert(!trades.empty() && risk.get_open_quantity(1) == 55);
+    assert(restored.cancel_order(3) == 0);
+    restored.flush_orderbook();
+    assert(risk.get_open_quantity(1) == 0 && risk.get_open_notional(1) == 0);
+    assert(risk.get_open_quantity(0) == 0);
+    std::cout << "PASS: test_risk_exposure_survives_restore" << std::endl;
+  }
+  /* ==================== self-trade prevention tests ==================== */
+
+  /*account 1 rests 10 ahead of account 2's 10, then buys 15 itself*/
+  static Trades self_cross(Orderbook &ob, StpMode mode) {
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 1);
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 2);
+    return ob.add_order(Side::BUY, 100, 15, orderType::GOODTOCANCEL, 1, mode);
+  }
+
+  static void test_stp_cancel_modes() {
+    {
+      Orderbook ob;
+      Trades trades = self_cross(ob, StpMode::NONE);
+      assert(trades.size() == 2 && trades[0].get_ask_info().orderID_ == 1);
+    }
+    {
+      Orderbook ob;
+      Trades trades = self_cross(ob, StpMode::CANCEL_RESTING);
+      assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 2 &&
+             trades[0].get_bid_info().quantity_ == 10);
+      assert(ob.get_size() == 1 && ob.orders_.find(1) == nullptr);
+      assert(ob.orders_.find(3)->itr->get_remaining_quantity() == 5);
+      assert(ob.snapshot_stats().self_trades_prevented == 1);
+    }
+    {
+      Orderbook ob;
+      assert(self_cross(ob, StpMode::CANCEL_AGGRESSOR).empty());
+      assert(ob.get_size() == 2 && ob.orders_.find(3) == nullptr);
+      assert(ob.get_levelInfos().get_asks()[0].quantity == 20);
+    }
+    {
+      Orderbook ob;
+      assert(self_cross(ob, StpMode::CANCEL_BOTH).empty());
+      assert(ob.get_size() == 1 && ob.orders_.find(2) != nullptr);
+    }
+    /*the incoming order's instruction decides, not the resting one's*/
+    {
+      Orderbook ob;
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 1,
+                         StpMode::CANCEL_BOTH);
+      assert(ob.add_order(Side::BUY, 100, 10, orderType::GOODTOCANCEL, 1)
+                 .size() == 1);
+    }
+    std::cout << "PASS: test_stp_cancel_modes" << std::endl;
+  }
+
+  static void test_stp_decrement() {
+    Orderbook ob;
+    L3Feed feed;
+    L3BookBuilder replica;
+    PreTradeRisk risk(3);
+    ob.attach_l3_feed(&feed);
+    ob.attach_risk(&risk);
+    (void)ob.add_order(Side::SELL, 100, 20, orderType::GOODTOCANCEL, 1);
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 2);
+
+    /*both lose 15: the buy is gone, the sell shows 5 and keeps its place*/
+    assert(ob.add_order(Side::BUY, 100, 15, orderType::GOODTOCANCEL, 1,
+                        StpMode::DECREMENT)
+               .empty());
+    assert(ob.get_size() == 2);
+    assert(ob.orders_.find(1)->itr->get_remaining_quantity() == 5);
+    replica.drain(feed);
+    assert(same_levels(ob.get_levelInfos().get_asks(),
+                       replica.get_levelInfos().get_asks()));
+    assert(replica.get_levelInfos().get_bids().empty());
+
+    /*now the sell is the smaller one, the buy carries on to account 2*/
+    Trades trades = ob.add_order(Side::BUY, 100, 8, orderType::GOODTOCANCEL, 1,
+                                 StpMode::DECREMENT);
+    assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 2 &&
+           trades[0].get_ask_info().quantity_ == 3);
+    assert(ob.get_size() == 1 && ob.orders_.find(1) == nullptr);
+    replica.drain(feed);
+    assert(replica.get_sequence_gaps() == 0);
+    assert(same_levels(ob.get_levelInfos().get_asks(),
+                       replica.get_levelInfos().get_asks()));
+    assert(ob.snapshot_stats().self_trades_prevented == 2);
+    assert(risk.get_open_quantity(1) == 0 && risk.get_open_quantity(2) == 7);
+    std::cout << "PASS: test_stp_decrement" << std::endl;
+  }
+
+  /*the same-account liquidity an armed FOK would be counting on is cancelled
+   * or decremented away, so only other accounts' covers it*/
+  static void test_stp_fok_skips_own_liquidity() {
+    for (StpMode mode : {StpMode::CANCEL_RESTING, StpMode::DECREMENT}) {
+      Orderbook ob;
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 2);
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 1);
+      assert(ob.add_order(Side::BUY, 100, 20, orderType::FILLORKILL, 1, mode)
+                 .empty());
+      assert(ob.get_size() == 2 && ob.orders_.find(3) == nullptr);
+      assert(ob.snapshot_stats().fok_rejects == 1);
+      Trades trades =
+          ob.add_order(Side::BUY, 100, 10, orderType::FILLORKILL, 1, mode);
+      assert(trades.size() == 1 && trades[0].get_ask_info().orderID_ == 1);
+      assert(ob.get_size() == 1 && ob.orders_.find(4) == nullptr);
+    }
+    /*without an instruction the account's own orders trade and count*/
+    Orderbook ob;
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 2);
+    (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 1);
+    assert(ob.add_order(Side::BUY, 100, 20, orderType::FILLORKILL, 1).size() ==
+           2);
+    assert(ob.get_size() == 0);
+    std::cout << "PASS: test_stp_fok_skips_own_liquidity" << std::endl;
+  }
+
+  /*the FOK reaches its own account's order after 10: every mode but
+   * CANCEL_RESTING stops it there, with 20 behind it left unreached*/
+  static void test_stp_fok_stops_at_own_order() {
+    for (StpMode mode : {StpMode::CANCEL_AGGRESSOR, StpMode::CANCEL_BOTH,
+                         StpMode::DECREMENT, StpMode::CANCEL_RESTING}) {
+      Orderbook ob;
+      L3Feed feed;
+      L3BookBuilder replica;
+      ob.attach_l3_feed(&feed);
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 2);
+      (void)ob.add_order(Side::SELL, 100, 10, orderType::GOODTOCANCEL, 1);
+      (void)ob.add_order(Side::SELL, 101, 10, orderType::GOODTOCANCEL, 3);
+      Trades trades =
+          ob.add_order(Side::BUY, 101, 15, orderType::FILLORKILL, 1, mode);
+      if (mode == StpMode::CANCEL_RESTING) {
+        assert(trades.size() == 2 && trades[0].get_ask_info().orderID_ == 1 &&
+               trades[1].get_ask_info().orderID_ == 3 &&
+               trades[1].get_ask_info().quantity_ == 5);
+        assert(ob.get_size() == 1 && ob.orders_.find(2) == nullptr);
+      } else {
+        assert(trades.empty());
+        assert(ob.get_size() == 3 && ob.orders_.find(4) == nullptr);
+        assert(ob.snapshot_stats().fok_rejects == 1);
+        assert(ob.snapshot_stats().self_trades_prevented == 0);
+      }
+      replica.drain(feed);
+      assert(same_levels(ob.get_levelInfos().get_asks(),
+                         replica.get_levelInfos().get_asks()));
+      assert(replica.get_levelInfos().get_bids().empty());
+    }
+    std::cout << "PASS: test_stp_fok_stops_at_own_order" << std::endl;
+  }
+
+  /*accounts and instructions travel with the command, so every
+   * configuration and a restored snapshot prevent the same self-trades*/
+  static void test_stp_flow_replicates() {
+    OrderFlowConfig config;
+    config.iceberg_ratio = 0.1;
+    config.peg_ratio = 0.05;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    for (auto &record : records) {
+      record.account = static_cast<AccountID>(record.id % 4);
+      record.stp_mode = static_cast<std::uint8_t>(record.id % 5);
+    }
+    std::size_t half = records.size() / 2;
+    Orderbook live;
+    for (std::size_t i = 0; i < half; ++i)
+      (void)live.apply_command(records[i]);
+    BookSnapshot snapshot = live.take_snapshot();
+    Orderbook restored;
+    assert(restored.restore_snapshot(snapshot) == 0);
+    for (std::size_t i = half; i < records.size(); ++i) {
+      (void)live.apply_command(records[i]);
+      (void)restored.apply_command(records[i]);
+    }
+    assert(live.snapshot_stats().self_trades_prevented > 0);
+    OrderbookLevelInfos expected = live.get_levelInfos();
+    OrderbookLevelInfos got = restored.get_levelInfos();
+    assert(same_levels(expected.get_bids(), got.get_bids()));
+    assert(same_levels(expected.get_asks(), got.get_asks()));
+    assert(agrees_with<RingOrderbook>(expected, records));
+    assert(agrees_with<LadderOrderbook>(expected, records));
+    std::cout << "PASS: test_stp_flow_replicates" << std::endl;
+  }
+  /* ==================== cancel on disconnect tests ==================== */
+
+  static void test_owner_cancel_takes_only_its_orders() {
+    SessionOrderbook ob;
+    L3Feed feed;
+    L3BookBuilder replica;
+    PreTradeRisk risk(3);
+    ob.attach_l3_feed(&feed);
+    ob.attach_risk(&risk);
+    (void)ob.add_order(Side::BUY, 99, 10, orderType::GOODTOCANCEL, 1);
+    (void)ob.add_order(Side::BUY, 99, 10, orderType::GOODTOCANCEL, 2);
+    (void)ob.add_iceberg_order(Side::SELL, 101, 50, 10, 1);
+    (void)ob.add_pegged_order(Side::BUY, PegType::PRIMARY, -1, 5, 1);
+    (void)ob.add_stop_order(Side::SELL, 90, 90, 5, orderType::GOODTOCANCEL, 1);
+    (void)ob.add_order(Side::SELL, 102, 10, orderType::GOODTOCANCEL, 1);
+
+    assert(ob.cancel_all_for_owner(1) == 5);
+    assert(ob.get_size() == 1 && ob.orders_.find(2) != nullptr);
+    assert(ob.get_stop_count() == 0);
+    assert(risk.get_open_quantity(1) == 0 && risk.get_open_quantity(2) == 10);
+    replica.drain(feed);
+    assert(replica.get_sequence_gaps() == 0);
+    auto a = ob.get_levelInfos();
+    auto b = replica.get_levelInfos();
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(a.get_asks().empty() && b.get_asks().empty());
+
+    assert(ob.cancel_all_for_owner(1) == 0);
+    assert(ob.cancel_all_for_owner(7) == 0); /*never seen*/
+    /*the owner can come back, its list starts over*/
+    (void)ob.add_order(Side::SELL, 101, 10, orderType::GOODTOCANCEL, 1);
+    assert(ob.cancel_all_for_owner(2) == 1);
+    assert(ob.cancel_all_for_owner(1) == 1 && ob.get_size() == 0);
+    assert(ob.snapshot_stats().cancels == 7);
+    std::cout << "PASS: test_owner_cancel_takes_only_its_orders" << std::endl;
+  }
+
+  /*accounts are not dense, the highest one costs one head like any other and
+   * an owner with nothing resting keeps none*/
+  static void test_owner_lists_take_any_account() {
+    SessionOrderbook ob;
+    const AccountID far = 0xFFFFFFFF;
+    (void)ob.add_order(Side::BUY, 99, 10, orderType::GOODTOCANCEL, far);
+    (void)ob.add_order(Side::BUY, 98, 10, orderType::GOODTOCANCEL, far);
+    (void)ob.add_order(Side::SELL, 101, 10, orderType::GOODTOCANCEL, 0);
+    assert(ob.owner_heads_.size() == 2);
+    assert(ob.cancel_all_for_owner(far) == 2 && ob.get_size() == 1);
+    assert(ob.cancel_order(3) == 0);
+    assert(ob.owner_heads_.empty());
+    std::cout << "PASS: test_owner_lists_take_any_account" << std::endl;
+  }
+
+  /*eight owners, one of them disconnecting every 1'000 commands*/
+  static std::vector<JournalRecord> disconnect_flow() {
+    OrderFlowConfig config;
+    config.iceberg_ratio = 0.1;
+    config.peg_ratio = 0.05;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records;
+    for (const auto &record : gen.generate(20'000)) {
+      records.push_back(record);
+      records.back().account = static_cast<AccountID>(record.id % 8);
+      if (records.size() % 1'000 == 0) {
+        JournalRecord disconnect{};
+        disconnect.tick = record.tick;
+        disconnect.type = CommandType::CANCEL_OWNER;
+        disconnect.account = static_cast<AccountID>(records.size() / 1'000 % 8);
+        records.push_back(disconnect);
+      }
+    }
+    return records;
+  }
+
+  /*walking the owner lists cancels what scanning the index does, and every
+   * list holds exactly its owner's resting orders*/
+  static void test_owner_lists_match_scan() {
+    std::vector<JournalRecord> records = disconnect_flow();
+    Orderbook scanned;
+    SessionOrderbook listed;
+    for (const auto &record : records) {
+      (void)scanned.apply_command(record);
+      (void)listed.apply_command(record);
+      if (record.type == CommandType::CANCEL_OWNER)
+        assert(scanned.get_size() == listed.get_size());
+    }
+    auto a = scanned.get_levelInfos();
+    auto b = listed.get_levelInfos();
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(same_levels(a.get_asks(), b.get_asks()));
+
+    std::size_t linked = 0;
+    for (const auto &[owner, head] : listed.owner_heads_) {
+      OrderID prev = 0;
+      assert(head != 0);
+      for (OrderID id = head; id != 0;) {
+        const auto *entry = listed.orders_.find(id);
+        assert(entry->itr->get_account() == owner);
+        assert(entry->owner_prev == prev);
+        prev = id;
+        id = entry->owner_next;
+        ++linked;
+      }
+    }
+    assert(linked == listed.get_size());
+    std::cout << "PASS: test_owner_lists_match_scan" << std::endl;
+  }
+
+  /*one journal record per disconnect, replayed into either configuration or
+   * on top of a snapshot*/
+  static void test_owner_cancel_replays() {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "yinhe_owner.journal")
+            .string();
+    std::vector<JournalRecord> records = disconnect_flow();
+    SessionOrderbook live;
+    BookSnapshot snapshot;
+    {
+      CommandJournal journal;
+      journal.open_Journal(path);
+      live.attach_journal(&journal);
+      for (std::size_t i = 0; i < records.size(); ++i) {
+        const auto &record = records[i];
+        Side side = static_cast<Side>(record.side);
+        if (i == records.size() / 2)
+          snapshot = live.take_snapshot();
+        if (record.type == CommandType::CANCEL_OWNER)
+          (void)live.cancel_all_for_owner(record.account);
+        else if (record.type == CommandType::CANCEL)
+          (void)live.cancel_order(record.id);
+        else if (record.type == CommandType::MODIFY)
+          (void)live.modify_order(record.id, record.price, record.quantity);
+        else if (record.type == CommandType::ADD)
+          (void)live.add_order(side, record.price, record.quantity,
+                               static_cast<orderType>(record.order_type),
+                               record.account);
+      }
+      live.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+    Orderbook replayed;
+    assert(replayed.recover_from_journal(path) == 0);
+    SessionOrderbook resumed;
+    assert(resumed.restore_snapshot(snapshot) == 0);
+    assert(resumed.recover_from_journal(path) == 0);
+    std::filesystem::remove(path);
+    auto a = live.get_levelInfos();
+    auto b = replayed.get_levelInfos();
+    auto c = resumed.get_levelInfos();
+    assert(replayed.get_size() == live.get_size() &&
+           resumed.get_size() == live.get_size());
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(same_levels(a.get_asks(), b.get_asks()));
+    assert(same_levels(a.get_bids(), c.get_bids()));
+    assert(same_levels(a.get_asks(), c.get_asks()));
+    std::cout << "PASS: test_owner_cancel_replays" << std::endl;
+  }
+  /* ==================== command batches tests ==================== */
+
+  /*the same command through the public single-call API*/
+  template <typename Book>
+  static Trades submit_single(Book &ob, const JournalRecord &record) {
+    Side side = static_cast<Side>(record.side);
+    switch (record.type) {
+    case CommandType::ADD:
+      if (record.display_quantity != 0)
+        return ob.add_iceberg_order(side, record.price, record.quantity,
+                                    record.display_quantity, record.account);
+      return ob.add_order(side, record.price, record.quantity,
+                          static_cast<orderType>(record.order_type),
+                          record.account);
+    case CommandType::CANCEL:
+      (void)ob.cancel_order(record.id);
+      return Trades{};
+    case CommandType::MODIFY:
+      return ob.modify_order(record.id, record.price, record.quantity);
+    default:
+      return Trades{};
+    }
+  }
+
+  static bool same_trades(const Trades &a, const Trades &b) {
+    if (a.size() != b.size())
+      return false;
+    for (std::size_t i = 0; i < a.size(); ++i)
+      if (a[i].get_bid_info().orderID_ != b[i].get_bid_info().orderID_ ||
+          a[i].get_ask_info().orderID_ != b[i].get_ask_info().orderID_ ||
+          a[i].get_ask_info().price_ != b[i].get_ask_info().price_ ||
+          a[i].get_ask_info().quantity_ != b[i].get_ask_info().quantity_)
+        return false;
+    return true;
+  }
+
+  /*generator IDs count up from 1 like the book's, so batches of recorded
+   * commands and single calls build the same book and trades*/
+  static void test_batch_matches_single_calls() {
+    OrderFlowConfig config;
+    config.iceberg_ratio = 0.1;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    Orderbook single;
+    std::vector<Trades> expected;
+    std::size_t misses = 0; /*cancels and modifies of orders already gone*/
+    for (const auto &record : records) {
+      if ((record.type == CommandType::CANCEL ||
+           record.type == CommandType::MODIFY) &&
+          single.orders_.find(record.id) == nullptr)
+        ++misses;
+      expected.push_back(submit_single(single, record));
+    }
+
+    Orderbook batched;
+    TradeSink sink;
+    const std::size_t BATCH = 64;
+    std::size_t applied = 0;
+    for (std::size_t i = 0; i < records.size(); i += BATCH) {
+      std::size_t count = std::min(BATCH, records.size() - i);
+      applied += batched.apply_batch(&records[i], count, sink);
+      assert(sink.ends.size() == count);
+      for (std::size_t k = 0; k < count; ++k) {
+        Trades got(sink.trades.begin() + sink.first_trade(k),
+                   sink.trades.begin() + sink.ends[k]);
+        assert(same_trades(expected[i + k], got));
+      }
+    }
+    assert(applied == records.size() - misses);
+    assert(batched.get_size() == single.get_size());
+    auto a = single.get_levelInfos();
+    auto b = batched.get_levelInfos();
+    assert(same_levels(a.get_bids(), b.get_bids()));
+    assert(same_levels(a.get_asks(), b.get_asks()));
+
+    /*ID 0 takes the book's next one, usable later in the same batch*/
+    Orderbook ob;
+    std::vector<JournalRecord> commands(3);
+    commands[0].type = commands[1].type = CommandType::ADD;
+    commands[0].side = static_cast<std::uint8_t>(Side::SELL);
+    commands[1].side = static_cast<std::uint8_t>(Side::BUY);
+    for (int k = 0; k < 2; ++k) {
+      commands[k].price = 100;
+      commands[k].quantity = 10;
+      commands[k].order_type =
+          static_cast<std::uint8_t>(orderType::GOODTOCANCEL);
+    }
+    commands[1].quantity = 15;
+    commands[2].type = CommandType::CANCEL;
+    commands[2].id = 2;
+    (void)ob.apply_batch(commands.data(), commands.size(), sink);
+    assert(sink.trades.size() == 1 && sink.ends[0] == 0 && sink.ends[1] == 1);
+    assert(sink.trades[0].get_bid_info().orderID_ == 2 &&
+           sink.trades[0].get_ask_info().orderID_ == 1);
+    assert(ob.get_size() == 0);
+    std::cout << "PASS: test_batch_matches_single_calls" << std::endl;
+  }
+
+  /*look-ahead only hints memory, at any distance: none, shorter than the
+   * batch, longer than it. cancels of IDs already gone are looked up ahead
+   * too*/
+  template <typename Book>
+  static void batches_agree_at_any_distance(
+      const std::vector<JournalRecord> &records) {
+    const std::size_t BATCH = 64;
+    Book reference;
+    reference.set_prefetch_distance(0);
+    TradeSink expected, sink;
+    for (std::size_t distance : {1, 8, 200}) {
+      Book ob;
+      ob.set_prefetch_distance(distance);
+      for (std::size_t i = 0; i < records.size(); i += BATCH) {
+        std::size_t count = std::min(BATCH, records.size() - i);
+        if (distance == 1)
+          (void)reference.apply_batch(&records[i], count, expected);
+        (void)ob.apply_batch(&records[i], count, sink);
+        if (distance == 1)
+          assert(same_trades(expected.trades, sink.trades) &&
+                 expected.ends == sink.ends);
+      }
+      assert(ob.get_size() == reference.get_size());
+      auto a = reference.get_levelInfos();
+      auto b = ob.get_levelInfos();
+      assert(same_levels(a.get_bids(), b.get_bids()));
+      assert(same_levels(a.get_asks(), b.get_asks()));
+    }
+  }
+
+  static void test_prefetch_distance_changes_nothing() {
+    static_assert(LeanLadderOrderbook::default_prefetch_distance == 8);
+    static_assert(LeanOrderbook::default_prefetch_distance == 0);
+    static_assert(Orderbook::default_prefetch_distance == 0);
+    OrderFlowConfig config;
+    config.iceberg_ratio = 0.1;
+    OrderFlowGenerator gen(config);
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    batches_agree_at_any_distance<Orderbook>(records);
+    batches_agree_at_any_distance<LeanOrderbook>(records);
+    batches_agree_at_any_distance<LeanLadderOrderbook>(records);
+    std::cout << "PASS: test_prefetch_distance_changes_nothing" << std::endl;
+  }
+
+  static std::vector<LogEntry> read_log(const std::string &location) {
+    std::vector<LogEntry> entries(std::filesystem::file_size(location) /
+                                  sizeof(LogEntry));
+    std::ifstream in(location, std::ios::binary);
+    in.read(reinterpret_cast<char *>(entries.data()),
+            static_cast<std::streamsize>(entries.size() * sizeof(LogEntry)));
+    return entries;
+  }
+
+  /*an ADD under the ID of a resting order or a pending stop is dropped, it
+   * would rest without an index entry and could never be cancelled*/
+  static void test_batch_refuses_live_ids() {
+    SessionOrderbook ob;
+    (void)ob.add_order(Side::BUY, 90, 10, orderType::GOODTOCANCEL, 5);
+    (void)ob.add_stop_order(Side::SELL, 80, 80, 5, orderType::GOODTOCANCEL, 5);
+    JournalRecord commands[3]{};
+    for (JournalRecord &command : commands) {
+      command.type = CommandType::ADD;
+      command.side = static_cast<std::uint8_t>(Side::BUY);
+      command.price = 91;
+      command.quantity = 10;
+      command.order_type = static_cast<std::uint8_t>(orderType::GOODTOCANCEL);
+      command.account = 5;
+    }
+    commands[0].id = 1;
+    commands[1].id = 2;
+    commands[2].id = 7;
+    TradeSink sink;
+    assert(ob.apply_batch(commands, 3, sink) == 1);
+    assert(ob.get_size() == 2 && ob.orders_.find(7) != nullptr);
+    assert(ob.cancel_all_for_owner(5) == 3);
+    assert(ob.get_size() == 0 && ob.get_levelInfos().get_bids().empty());
+
+    /*a dense index refuses IDs that would grow it without bound*/
+    LeanOrderbook dense;
+    commands[0].id = OrderID(1) << 40;
+    (void)dense.apply_batch(commands, 1, sink);
+    assert(dense.get_size() == 0);
+    std::cout << "PASS: test_batch_refuses_live_ids" << std::endl;
+  }
+
+  /*enum bytes out of range are refused before risk or the journal sees them*/
+  static void test_batch_refuses_bad_enums() {
+    Orderbook ob;
+    JournalRecord commands[6]{};
+    for (JournalRecord &command : commands) {
+      command.type = CommandType::ADD;
+      command.side = static_cast<std::uint8_t>(Side::BUY);
+      command.price = 100;
+      command.quantity = 10;
+      command.order_type = static_cast<std::uint8_t>(orderType::GOODTOCANCEL);
+    }
+    commands[0].order_type = 6;
+    commands[1].side = 2;
+    commands[2].stp_mode = 5;
+    commands[3].type = CommandType::ADD_PEG;
+    commands[3].peg_type = static_cast<std::uint8_t>(PegType::NONE);
+    commands[4].type = static_cast<CommandType>(8);
+    TradeSink sink;
+    assert(ob.apply_batch(commands, 6, sink) == 1);
+    assert(ob.get_size() == 1 && ob.command_seq_ == 1);
+    std::cout << "PASS: test_batch_refuses_bad_enums" << std::endl;
+  }
+
+  /*a batch logs, journals and risk checks what single calls do*/
+  static void test_batch_logs_journals_and_checks() {
+    auto dir = std::filesystem::temp_directory_path() / "yinhe_batch";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "single");
+    std::filesystem::create_directories(dir / "batched");
+    const std::string path = (dir / "batched.journal").string();
+    OrderFlowGenerator gen;
+    std::vector<JournalRecord> records = gen.generate(20'000);
+    RiskLimits limits;
+    limits.max_order_quantity = 90; /*refuses some adds and modifies*/
+    PreTradeRisk single_risk(1), batched_risk(1);
+    single_risk.set_limits(0, limits);
+    batched_risk.set_limits(0, limits);
+
+    std::string single_log, batched_log;
+    BinaryLogOrderbook single, batched;
+    {
+      BinaryOrderbookLogger logger;
+      logger.set_logfile_save_location((dir / "single" / "").string());
+      logger.init_Log();
+      single_log = logger.get_logfile_location();
+      single.attach_logger(&logger);
+      single.attach_risk(&single_risk);
+      for (const auto &record : records) {
+        single.set_sim_tick(record.tick);
+        (void)submit_single(single, record);
+      }
+      single.attach_logger(nullptr);
+    }
+    {
+      BinaryOrderbookLogger logger;
+      logger.set_logfile_save_location((dir / "batched" / "").string());
+      logger.init_Log();
+      batched_log = logger.get_logfile_location();
+      CommandJournal journal;
+      journal.open_Journal(path);
+      batched.attach_logger(&logger);
+      batched.attach_journal(&journal);
+      batched.attach_risk(&batched_risk);
+      TradeSink sink;
+      for (std::size_t i = 0; i < records.size(); i += 100)
+        (void)batched.apply_batch(&records[i],
+                                  std::min<std::size_t>(100, records.size() - i),
+                                  sink);
+      batched.attach_logger(nullptr);
+      batched.attach_journal(nullptr);
+      journal.close_Journal();
+    }
+    assert(batched_risk.get_rejects(RiskReject::ORDER_QUANTITY) > 0);
+    assert(batched_risk.get_rejects(RiskReject::ORDER_QUANTITY) ==
+           single_risk.get_rejects(RiskReject::ORDER_QUANTITY));
+
+    std::vector<LogEntry> a = read_log(single_log);
+    std::vector<LogEntry> b = read_log(batched_log);
+    assert(!a.empty() && a.size() == b.size());
+    for (std::size_t i = 0; i < a.size(); ++i)
+      assert(a[i].type == b[i].type && a[i].tick == b[i].tick &&
+             a[i].id1 == b[i].id1 && a[i].id2 == b[i].id2 &&
+             a[i].price == b[i].price && a[i].quantity == b[i].quantity);
+
+    Orderbook recovered;
+    assert(recovered.recover_from_journal(path) == 0);
+    std::filesystem::remove_all(dir);
+    auto x = batched.get_levelInfos();
+    auto y = recovered.get_levelInfos();
+    assert(recovered.get_size() == batched.get_size() &&
+           batched.get_size() == single.get_size());
+    assert(same_levels(x.get_bids(), y.get_bids()));
+    assert(same_levels(x.get_asks(), y.get_asks()));
+    std::cout << "PASS: test_batch_logs_journals_and_checks" << std::endl;
+  }
 };
 
 int main() {
@@ -437,6 +3056,120 @@ int main() {
   OrderbookTest::test_can_fully_fill_insufficient();
   OrderbookTest::test_can_fully_fill_across_levels();
 
+  std::cout << "\n=== L3 event stream ===" << std::endl;
+  OrderbookTest::test_l3_event_sequence();
+  OrderbookTest::test_l3_replica_matches_book();
+  OrderbookTest::test_l3_full_feed_drops();
+  OrderbookTest::test_l3_leaves_out_pegs();
+
+  std::cout << "\n=== command journal ===" << std::endl;
+  OrderbookTest::test_journal_replay_rebuilds_book();
+  OrderbookTest::test_recover_missing_journal();
+  OrderbookTest::test_recover_refuses_corrupt_journal();
+  OrderbookTest::test_modify_loses_priority();
+
+  std::cout << "\n=== snapshot ===" << std::endl;
+  OrderbookTest::test_snapshot_round_trip();
+  OrderbookTest::test_snapshot_then_journal_tail();
+  OrderbookTest::test_restore_rejects_inconsistent_snapshot();
+
+  std::cout << "\n=== latency histograms ===" << std::endl;
+  OrderbookTest::test_histogram_bucket_precision();
+  OrderbookTest::test_histogram_percentiles();
+  OrderbookTest::test_latency_readable_while_matching();
+
+  std::cout << "\n=== engine stats ===" << std::endl;
+  OrderbookTest::test_stats_counters();
+  OrderbookTest::test_stats_dump_text_and_json();
+  OrderbookTest::test_stats_monitor_thread();
+
+  std::cout << "\n=== policy configurations ===" << std::endl;
+  OrderbookTest::test_configurations_agree();
+  OrderbookTest::test_disabled_features_compile_away();
+  OrderbookTest::test_dense_index();
+  OrderbookTest::test_binary_logger_writes_records();
+
+  std::cout << "\n=== construction ===" << std::endl;
+  OrderbookTest::test_construction_has_no_side_effects();
+
+  std::cout << "\n=== order layout ===" << std::endl;
+  OrderbookTest::test_order_is_compact();
+  OrderbookTest::test_level_nodes_are_contiguous();
+  OrderbookTest::test_node_pool_reuses_blocks();
+
+  std::cout << "\n=== ring level ===" << std::endl;
+  OrderbookTest::test_ring_level_fifo_and_tombstones();
+  OrderbookTest::test_ring_level_compaction();
+  OrderbookTest::test_ring_book_cancel_after_compaction();
+
+  std::cout << "\n=== depth scan ===" << std::endl;
+  OrderbookTest::test_depth_scan_kernels_agree();
+  OrderbookTest::test_depth_to_cover_both_sides();
+  OrderbookTest::test_level_quantity_tracks_fills();
+
+  std::cout << "\n=== price bitmap ===" << std::endl;
+  OrderbookTest::test_price_bitmap_edges();
+  OrderbookTest::test_price_bitmap_matches_ordered_set();
+
+  std::cout << "\n=== price ladder ===" << std::endl;
+  OrderbookTest::test_ladder_window_and_overflow();
+  OrderbookTest::test_ladder_bid_side();
+  OrderbookTest::test_ladder_book_with_stub_quotes();
+
+  std::cout << "\n=== iceberg ===" << std::endl;
+  OrderbookTest::test_iceberg_tranches();
+  OrderbookTest::test_iceberg_refill_loses_priority();
+  OrderbookTest::test_iceberg_sweep_agrees_across_storage();
+  OrderbookTest::test_iceberg_flow_recovers_and_replicates();
+
+  std::cout << "\n=== stop orders ===" << std::endl;
+  OrderbookTest::test_stop_fires_on_last_trade();
+  OrderbookTest::test_stop_cascade_order();
+  OrderbookTest::test_stops_survive_snapshot_and_journal();
+
+  std::cout << "\n=== pegged orders ===" << std::endl;
+  OrderbookTest::test_primary_peg_follows_the_bid();
+  OrderbookTest::test_midpoint_pegs_cross();
+  OrderbookTest::test_peg_depth_and_cancel();
+  OrderbookTest::test_peg_flow_replicates_and_recovers();
+
+  std::cout << "\n=== auction ===" << std::endl;
+  OrderbookTest::test_auction_uncross_at_equilibrium();
+  OrderbookTest::test_auction_leaves_icebergs_uncrossed();
+  OrderbookTest::test_auction_matches_brute_force();
+  OrderbookTest::test_auction_survives_snapshot_and_journal();
+
+  std::cout << "\n=== allocation ===" << std::endl;
+  OrderbookTest::test_pro_rata_splits_by_size();
+  OrderbookTest::test_top_order_then_pro_rata();
+  OrderbookTest::test_allocation_keeps_depth();
+
+  std::cout << "\n=== pre-trade risk ===" << std::endl;
+  OrderbookTest::test_risk_refuses_orders_over_limits();
+  OrderbookTest::test_risk_exposure_follows_fills_and_cancels();
+  OrderbookTest::test_risk_exposure_matches_the_book();
+  OrderbookTest::test_risk_exposure_survives_restore();
+
+  std::cout << "\n=== self-trade prevention ===" << std::endl;
+  OrderbookTest::test_stp_cancel_modes();
+  OrderbookTest::test_stp_decrement();
+  OrderbookTest::test_stp_fok_skips_own_liquidity();
+  OrderbookTest::test_stp_fok_stops_at_own_order();
+  OrderbookTest::test_stp_flow_replicates();
+
+  std::cout << "\n=== cancel on disconnect ===" << std::endl;
+  OrderbookTest::test_owner_cancel_takes_only_its_orders();
+  OrderbookTest::test_owner_lists_match_scan();
+  OrderbookTest::test_owner_lists_take_any_account();
+  OrderbookTest::test_owner_cancel_replays();
+
+  std::cout << "\n=== command batches ===" << std::endl;
+  OrderbookTest::test_batch_matches_single_calls();
+  OrderbookTest::test_prefetch_distance_changes_nothing();
+  OrderbookTest::test_batch_refuses_live_ids();
+  OrderbookTest::test_batch_refuses_bad_enums();
+  OrderbookTest::test_batch_logs_journals_and_checks();
+
   std::cout << "\n*** All orderbook tests passed. ***" << std::endl;
   return 0;
 }
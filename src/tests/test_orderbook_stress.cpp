@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "order.hpp"
+#include "orderFlowGenerator.hpp"
 #include "orderbook.hpp"
 
 class OrderbookTest {
@@ -10,9 +11,8 @@ public:
                            Quantity qty,
                            orderType type = orderType::GOODTOCANCEL) {
     auto &level = (side == Side::BUY) ? ob.bids_[price] : ob.asks_[price];
-    level.push_back(Order(side, id, price, qty, type));
-    auto it = std::prev(level.end());
-    ob.orders_.insert({id, orderEntry{it}});
+    auto it = level.push_back(Order(side, id, price, qty, type));
+    ob.orders_.insert(id, {it});
   }
 
   static Trades call_match(Orderbook &ob) { return ob.match(); }
@@ -311,6 +311,68 @@ public:
     assert(infos.get_asks().empty());
     std::cout << "PASS: test_levelinfos_after_partial_match" << std::endl;
   }
+
+  /* ==================== 7. Synthetic Flow ==================== */
+
+  /*book is never left crossed and every level is non-empty*/
+  static bool book_consistent(Orderbook &ob) {
+    if (!ob.bids_.empty() && !ob.asks_.empty() &&
+        ob.bids_.begin()->first >= ob.asks_.begin()->first)
+      return false;
+    std::size_t resting = 0;
+    for (const auto &[price, level] : ob.bids_) {
+      if (level.empty())
+        return false;
+      resting += level.size();
+    }
+    for (const auto &[price, level] : ob.asks_) {
+      if (level.empty())
+        return false;
+      resting += level.size();
+    }
+    return resting == ob.get_size();
+  }
+
+  static void test_synthetic_flow_deterministic() {
+    OrderFlowConfig config;
+    config.seed = 7;
+    OrderFlowGenerator a(config), b(config);
+    config.seed = 8;
+    OrderFlowGenerator c(config);
+    bool differs = false;
+    for (int i = 0; i < 10'000; ++i) {
+      JournalRecord ra = a.next(), rb = b.next(), rc = c.next();
+      assert(ra.tick == rb.tick && ra.type == rb.type && ra.id == rb.id &&
+             ra.price == rb.price && ra.quantity == rb.quantity &&
+             ra.side == rb.side && ra.order_type == rb.order_type);
+      differs |= ra.price != rc.price || ra.type != rc.type;
+    }
+    assert(differs);
+    std::cout << "PASS: test_synthetic_flow_deterministic" << std::endl;
+  }
+
+  static void test_synthetic_flow_invariants() {
+    OrderFlowGenerator gen;
+    Orderbook ob;
+    std::size_t max_sweep = 0, fok_adds = 0;
+    for (int i = 0; i < 100'000; ++i) {
+      JournalRecord record = gen.next();
+      if (record.type == CommandType::ADD &&
+          record.order_type == static_cast<std::uint8_t>(orderType::FILLORKILL))
+        ++fok_adds;
+      Trades trades = ob.apply_command(record);
+      if (trades.size() > max_sweep)
+        max_sweep = trades.size();
+      if (i % 1'000 == 0)
+        assert(book_consistent(ob));
+    }
+    assert(book_consistent(ob));
+    /*the flow actually reaches the paths the old modular flow never did*/
+    assert(max_sweep >= 5);
+    assert(fok_adds > 0);
+    assert(ob.get_size() > 0);
+    std::cout << "PASS: test_synthetic_flow_invariants" << std::endl;
+  }
 };
 
 int main() {
@@ -345,6 +407,10 @@ int main() {
   OrderbookTest::test_double_cancel();
   OrderbookTest::test_levelinfos_after_partial_match();
 
-  std::cout << "\n*** All stress tests passed (20 tests). ***" << std::endl;
+  std::cout << "\n=== Synthetic Flow ===" << std::endl;
+  OrderbookTest::test_synthetic_flow_deterministic();
+  OrderbookTest::test_synthetic_flow_invariants();
+
+  std::cout << "\n*** All stress tests passed (22 tests). ***" << std::endl;
   return 0;
 }
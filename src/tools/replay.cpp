@@ -0,0 +1,369 @@
+/*
+ * yinhe_replay: stream a recorded order-flow file through a fresh Orderbook
+ *
+ *   yinhe_replay <file> [--speed X] [--log DIR]
+ *
+ * <file> is either a binary command journal (CommandJournal format) or CSV
+ * with one command per line:
+ *
+ *   tick,type,id,side,price,quantity,order_type[,display|trigger[,account[,stp]]]
+ *   type:       A (add), S (stop add), P (pegged add), C (cancel), M (modify),
+ *               O (open an auction), U (uncross it), D (owner disconnect)
+ *   side:       B, S
+ *   order_type: GTC, FOK, FAK, GFD, MKT, LMT, or PRI, MID for pegged adds
+ *   display:    adds only, optional. shown quantity of an iceberg
+ *   trigger:    stop adds only. trade price that releases the stop
+ *   account:    adds only, optional. the owner, 0 by default. a pegged add
+ *               leaves the column before it empty
+ *   stp:        adds only, optional. CR, CA, CB or DEC: cancel resting,
+ *               cancel aggressor, cancel both or decrement on a self-match
+ *
+ * a pegged add's price is its signed offset from the peg's reference.
+ *
+ * cancels only need tick, type and id, auction commands tick and type, owner
+ * disconnects tick, type and the owner's account in place of the id. lines that don't start with a digit
+ * are skipped so a header row is fine.
+ *
+ * --speed 0 (default) replays as fast as possible. --speed X paces commands
+ * so X simulated milliseconds pass per wall millisecond.
+ *
+ * --log DIR writes the trade log to DIR, by default nothing is logged.
+ */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "commandJournal.hpp"
+#include "latencyHistogram.hpp"
+#include "orderbook.hpp"
+
+/*read-only mapping of the whole input file*/
+class MappedFile {
+public:
+  explicit MappedFile(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      size_ = static_cast<std::size_t>(st.st_size);
+      void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        data_ = static_cast<const char *>(addr);
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+      }
+    }
+    ::close(fd);
+  }
+  ~MappedFile() {
+    if (data_ != nullptr)
+      ::munmap(const_cast<char *>(data_), size_);
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+struct ReplayStats {
+  std::uint64_t adds = 0, cancels = 0, modifies = 0, auctions = 0;
+  std::uint64_t trades = 0, traded_quantity = 0;
+  LatencyHistogram latency;
+};
+
+static bool parse_csv_line(const char *p, const char *end,
+                           JournalRecord &record) {
+  if (p >= end || *p < '0' || *p > '9')
+    return false;
+  auto next_number = [&p, end]() -> std::uint64_t {
+    std::uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+      v = v * 10 + static_cast<std::uint64_t>(*p++ - '0');
+    if (p < end && *p == ',')
+      ++p;
+    return v;
+  };
+  auto next_field = [&p, end]() -> const char * {
+    const char *field = p;
+    while (p < end && *p != ',')
+      ++p;
+    if (p < end)
+      ++p;
+    return field;
+  };
+  /*a field can start at end when the last line is cut short, nothing past
+   * end is read*/
+  auto is = [end](const char *field, const char *name, std::size_t length) {
+    return field + length <= end && std::strncmp(field, name, length) == 0;
+  };
+
+  record = JournalRecord{};
+  record.tick = next_number();
+  const char *type = next_field();
+  if (is(type, "O", 1) || is(type, "U", 1)) {
+    record.type =
+        *type == 'O' ? CommandType::AUCTION_START : CommandType::UNCROSS;
+    return true;
+  }
+  record.id = next_number();
+  switch (type < end ? *type : '\0') {
+  case 'A':
+    record.type = CommandType::ADD;
+    break;
+  case 'S':
+    record.type = CommandType::ADD_STOP;
+    break;
+  case 'P':
+    record.type = CommandType::ADD_PEG;
+    break;
+  case 'C':
+    record.type = CommandType::CANCEL;
+    return true;
+  case 'D':
+    record.type = CommandType::CANCEL_OWNER;
+    record.account = static_cast<AccountID>(record.id);
+    record.id = 0;
+    return true;
+  case 'M':
+    record.type = CommandType::MODIFY;
+    break;
+  default:
+    return false;
+  }
+  const char *side = next_field();
+  record.side =
+      static_cast<std::uint8_t>(is(side, "S", 1) ? Side::SELL : Side::BUY);
+  bool negative = p < end && *p == '-';
+  if (negative)
+    ++p;
+  record.price = static_cast<Price>(next_number());
+  if (negative)
+    record.price = static_cast<Price>(-static_cast<std::int32_t>(record.price));
+  record.quantity = static_cast<Quantity>(next_number());
+
+  const char *type_name = next_field();
+  orderType order_type = orderType::GOODTOCANCEL;
+  if (is(type_name, "FOK", 3))
+    order_type = orderType::FILLORKILL;
+  else if (is(type_name, "FAK", 3))
+    order_type = orderType::FILLANDKILL;
+  else if (is(type_name, "GFD", 3))
+    order_type = orderType::GOODFORDAY;
+  else if (is(type_name, "MKT", 3))
+    order_type = orderType::MARKET;
+  else if (is(type_name, "LMT", 3))
+    order_type = orderType::LIMIT;
+  record.order_type = static_cast<std::uint8_t>(order_type);
+  if (record.type == CommandType::MODIFY)
+    return true;
+  if (record.type == CommandType::ADD_PEG) {
+    record.peg_type = static_cast<std::uint8_t>(
+        is(type_name, "MID", 3) ? PegType::MIDPOINT : PegType::PRIMARY);
+    (void)next_number();
+  } else if (record.type == CommandType::ADD) {
+    record.display_quantity = static_cast<Quantity>(next_number());
+  } else {
+    record.trigger_price = static_cast<Price>(next_number());
+  }
+  record.account = static_cast<AccountID>(next_number());
+
+  const char *stp_name = next_field();
+  StpMode stp = StpMode::NONE;
+  if (is(stp_name, "CR", 2))
+    stp = StpMode::CANCEL_RESTING;
+  else if (is(stp_name, "CA", 2))
+    stp = StpMode::CANCEL_AGGRESSOR;
+  else if (is(stp_name, "CB", 2))
+    stp = StpMode::CANCEL_BOTH;
+  else if (is(stp_name, "DEC", 3))
+    stp = StpMode::DECREMENT;
+  record.stp_mode = static_cast<std::uint8_t>(stp);
+  return true;
+}
+
+class Replayer {
+public:
+  explicit Replayer(double speed) : speed_(speed) {}
+
+  void apply(Orderbook &ob, const JournalRecord &record) {
+    pace(record.tick);
+    std::uint64_t start = LatencyClock::now();
+    Trades trades = ob.apply_command(record);
+    stats_.latency.record(LatencyClock::now() - start);
+
+    switch (record.type) {
+    case CommandType::ADD:
+    case CommandType::ADD_STOP:
+    case CommandType::ADD_PEG:
+      ++stats_.adds;
+      break;
+    case CommandType::CANCEL:
+    case CommandType::CANCEL_OWNER:
+      ++stats_.cancels;
+      break;
+    case CommandType::MODIFY:
+      ++stats_.modifies;
+      break;
+    case CommandType::AUCTION_START:
+    case CommandType::UNCROSS:
+      ++stats_.auctions;
+      break;
+    }
+    stats_.trades += trades.size();
+    for (const auto &trade : trades)
+      stats_.traded_quantity += trade.get_bid_info().quantity_;
+  }
+
+  const ReplayStats &get_stats() const { return stats_; }
+
+private:
+  double speed_;
+  bool started_ = false;
+  SimTick first_tick_ = 0;
+  std::chrono::steady_clock::time_point wall_start_;
+  ReplayStats stats_;
+
+  /*busy-wait until the record's tick is due at the requested speed*/
+  void pace(SimTick tick) {
+    if (speed_ <= 0)
+      return;
+    if (!started_) {
+      started_ = true;
+      first_tick_ = tick;
+      wall_start_ = std::chrono::steady_clock::now();
+      return;
+    }
+    auto due = wall_start_ + std::chrono::duration_cast<
+                                 std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double, std::milli>(
+                                     (tick - first_tick_) / speed_));
+    while (std::chrono::steady_clock::now() < due) {
+    }
+  }
+};
+
+static void print_report(const ReplayStats &stats, double seconds,
+                         std::size_t book_size) {
+  std::uint64_t commands =
+      stats.adds + stats.cancels + stats.modifies + stats.auctions;
+  std::cout << "\n=== replay ===" << std::endl;
+  std::cout << "  Commands:    " << commands << " (" << stats.adds << " add, "
+            << stats.cancels << " cancel, " << stats.modifies << " modify, "
+            << stats.auctions << " auction)" << std::endl;
+  std::cout << "  Trades:      " << stats.trades << " (" << stats.traded_quantity
+            << " quantity)" << std::endl;
+  std::cout << "  Resting:     " << book_size << " orders" << std::endl;
+  std::cout << "  Wall time:   " << std::fixed << std::setprecision(3)
+            << seconds * 1e3 << " ms" << std::endl;
+  std::cout << "  Throughput:  " << std::fixed << std::setprecision(0)
+            << (seconds > 0 ? commands / seconds : 0.0) << " commands/sec"
+            << std::endl;
+
+  LatencyHistogramSnapshot h = stats.latency.snapshot();
+  std::cout << "\n  Latency (ns):" << std::endl;
+  std::cout << std::setprecision(0);
+  std::cout << "    Mean:  " << h.get_mean_ns() << std::endl;
+  std::cout << "    P50:   " << h.percentile_ns(50) << std::endl;
+  std::cout << "    P90:   " << h.percentile_ns(90) << std::endl;
+  std::cout << "    P99:   " << h.percentile_ns(99) << std::endl;
+  std::cout << "    P99.9: " << h.percentile_ns(99.9) << std::endl;
+  std::cout << "    Max:   " << h.get_max_ns() << std::endl;
+  std::cout << "\n  Histogram:" << std::endl;
+  for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+    if (h.get_bucket_count(i) == 0)
+      continue;
+    std::cout << "    <= " << std::setw(12)
+              << LatencyHistogram::bucket_upper(i) * LatencyClock::ns_per_tick()
+              << " ns: " << h.get_bucket_count(i) << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: yinhe_replay <file> [--speed X] [--log DIR]"
+              << std::endl;
+    return 1;
+  }
+  double speed = 0;
+  std::string log_dir;
+  for (int i = 2; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+      speed = std::atof(argv[++i]);
+    else if (std::strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+      log_dir = argv[++i];
+  }
+
+  MappedFile file(argv[1]);
+  if (file.data() == nullptr) {
+    std::cerr << "Error mapping " << argv[1] << std::endl;
+    return 1;
+  }
+
+  OrderbookLogger logger;
+  Orderbook ob;
+  if (!log_dir.empty()) {
+    if (log_dir.back() != '/')
+      log_dir += '/';
+    logger.set_logfile_save_location(log_dir);
+    logger.init_Log();
+    ob.attach_logger(&logger);
+  }
+  Replayer replayer(speed);
+  const char *data = file.data();
+  const std::size_t size = file.size();
+
+  JournalHeader header{};
+  bool binary = size >= sizeof(header);
+  if (binary) {
+    std::memcpy(&header, data, sizeof(header));
+    binary = header.magic == JOURNAL_MAGIC;
+  }
+  if (binary && (header.version != JOURNAL_VERSION ||
+                 header.record_size != sizeof(JournalRecord))) {
+    std::cerr << "Unsupported journal version" << std::endl;
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  if (binary) {
+    std::size_t count = (size - sizeof(header)) / sizeof(JournalRecord);
+    const char *p = data + sizeof(header);
+    JournalRecord record;
+    for (std::size_t i = 0; i < count; ++i, p += sizeof(JournalRecord)) {
+      std::memcpy(&record, p, sizeof(record));
+      replayer.apply(ob, record);
+    }
+  } else {
+    const char *p = data;
+    const char *end = data + size;
+    JournalRecord record;
+    while (p < end) {
+      const char *eol =
+          static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if (eol == nullptr)
+        eol = end;
+      if (parse_csv_line(p, eol, record))
+        replayer.apply(ob, record);
+      p = eol + 1;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  print_report(replayer.get_stats(),
+               std::chrono::duration<double>(t1 - t0).count(), ob.get_size());
+  return 0;
+}